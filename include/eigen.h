@@ -0,0 +1,26 @@
+/*
+  @file eigen.h
+  @author Gerardo Veltri
+  Eigenvalues and eigenvectors
+*/
+#ifndef EIGEN_HEADER
+#define EIGEN_HEADER
+
+/* iterations allowed per eigenvalue before the eigensolvers give up */
+#define EIG_MAX_ITERATIONS 100
+
+/* tridiagonal blocks this small are solved directly by divide and conquer */
+#define DC_LEAF_SIZE 32
+
+int _eigenvalueQR(Matrix A, double *wr, double *wi, Matrix V, Arena workspace);
+size_t eigenvalueQRWorkspaceSize(int n);
+int eigenvalueQR(Matrix A, double *wr, double *wi, Matrix V);
+
+int _tridiagonalEigen(int n, double *d, double *e, Matrix Q, Arena workspace);
+size_t tridiagonalEigenWorkspaceSize(int n);
+
+int _symmetricEigen(Matrix A, int il, int iu, double *w, Matrix Z, Arena workspace);
+size_t symmetricEigenWorkspaceSize(int n);
+int symmetricEigen(Matrix A, int il, int iu, double *w, Matrix Z);
+
+#endif
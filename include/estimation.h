@@ -6,7 +6,12 @@
 #ifndef ESTIMATION_HEADER
 #define ESTIMATION_HEADER
 
-void ordinaryLeastSquares(Matrix A, Matrix x, Matrix b);
-void linearRegression(Matrix A, Matrix x, Matrix b);
+int _ordinaryLeastSquares(Matrix A, Matrix x, Matrix b, Arena arena);
+size_t ordinaryLeastSquaresWorkspaceSize(int n, int m, int k);
+int ordinaryLeastSquares(Matrix A, Matrix x, Matrix b);
+
+int _linearRegression(Matrix A, Matrix x, Matrix b, Arena arena);
+size_t linearRegressionWorkspaceSize(int n, int m, int k);
+int linearRegression(Matrix A, Matrix x, Matrix b);
 
 #endif
@@ -6,20 +6,91 @@
 #ifndef FACTORIZATION_HEADER
 #define FACTORIZATION_HEADER
 
+/* default panel width of the blocked Householder routines */
+#define HH_BLOCK_SIZE 32
+
+/* default panel width of the blocked LU */
+#define LU_BLOCK_SIZE 128
+
+/* blocked LU panels narrower than this are factored without recursing */
+#define LU_PANEL_BASE 8
+
+/* default block width of choleskyDecompositionInPlace */
+#define CHOL_BLOCK_SIZE 128
+
+/* rows of the right-hand sides solved per block by triangularSolve */
+#define TRSM_BLOCK_SIZE 64
+
+/* default block width of blockGramSchmidtQR */
+#define GS_BLOCK_SIZE 32
+
+/* fewest columns of an update handed to one thread of the pool */
+#define SLICE_COLUMNS 64
+
 void gramSchmidtQR(Matrix A, Matrix QR[2], int debug);
+void gramSchmidtQRInPlace(Matrix A, Matrix R, int debug);
+void _blockGramSchmidtQR(Matrix A, Matrix QR[2], int nb, Arena arena, int debug);
+void _blockGramSchmidtQRInPlace(Matrix A, Matrix R, int nb, Arena arena, int debug);
+size_t blockGramSchmidtQRWorkspaceSize(int n, int m, int nb);
+void blockGramSchmidtQR(Matrix A, Matrix QR[2], int nb, int debug);
 
-void _hhReflectionsQR(Matrix A, Matrix QR[2],
-                      MatrixStack mem_stacks[2],
-                      int debug);
+void householderQR(Matrix A, double *tau, Arena workspace);
+size_t householderQRWorkspaceSize(int n, int m);
+void applyHouseholderQ(Matrix V, double *tau, int k, Matrix B, int transpose,
+                       Arena workspace);
+void formHouseholderQ(Matrix V, double *tau, int k, Matrix Q, Arena workspace);
+
+void householderQRBlocked(Matrix A, double *tau, int nb, Arena workspace);
+size_t householderQRBlockedWorkspaceSize(int n, int m, int nb);
+void formHouseholderQBlocked(Matrix V, double *tau, int k, Matrix Q, int nb,
+                             Arena workspace);
+size_t formHouseholderQBlockedWorkspaceSize(int n, int q, int k, int nb);
+
+void hessenbergReduction(Matrix A, double *tau, Arena workspace);
+size_t hessenbergReductionWorkspaceSize(int n);
+void formHessenbergQ(Matrix V, double *tau, Matrix Q, Arena workspace);
+
+void tridiagonalReduction(Matrix A, double *d, double *e, double *tau, Arena workspace);
+size_t tridiagonalReductionWorkspaceSize(int n);
+
+void _hhReflectionsQR(Matrix A, Matrix QR[2], Arena arena, int debug);
+size_t hhReflectionsQRWorkspaceSize(int n, int m);
 void hhReflectionsQR(Matrix A, Matrix QR[2],
                      int debug);
 
+void _hhReflectionsQRBlocked(Matrix A, Matrix QR[2], int nb, Arena arena, int debug);
+size_t hhReflectionsQRBlockedWorkspaceSize(int n, int m, int nb);
+void hhReflectionsQRBlocked(Matrix A, Matrix QR[2], int nb, int debug);
+
 void LUDecomposition(Matrix A, Matrix LU[2], int debug);
+void _PLUDecomposition(Matrix A, Matrix PLU[3], Arena workspace, int debug);
+size_t PLUDecompositionWorkspaceSize(int n, int m);
 void PLUDecomposition(Matrix A, Matrix PLU[3], int debug);
+void PLUDecompositionInPlace(Matrix A, int *ipiv, int nb);
+void applyPivots(Matrix B, const int *ipiv, int k, int inverse);
+void pivotPermutation(const int *ipiv, int k, int *perm, int n);
+void _PLUDecompositionBlocked(Matrix A, Matrix PLU[3], int nb, Arena workspace,
+                              int debug);
+size_t PLUDecompositionBlockedWorkspaceSize(int n);
+void PLUDecompositionBlocked(Matrix A, Matrix PLU[3], int nb, int debug);
+
+int _inverseMatrix(Matrix A, Arena workspace);
+size_t inverseMatrixWorkspaceSize(int n);
+int inverseMatrix(Matrix A);
+
+int choleskyDecompositionInPlace(Matrix A, int nb);
+int choleskySolve(Matrix L, Matrix B);
 
 void gaussianElimination(Matrix A, Matrix B, Matrix REF[2], int debug);
+void gaussianEliminationInPlace(Matrix A, Matrix B, int debug);
+void _gaussJordanElimination(Matrix A, Matrix B, Matrix RREF[2], Arena workspace,
+                             int debug);
+size_t gaussJordanEliminationWorkspaceSize(int n, int m);
 void gaussJordanElimination(Matrix A, Matrix B, Matrix RREF[2], int debug);
 
-void backSubstitution(Matrix A, Matrix solution, Matrix b);
+int triangularSolve(Matrix T, Matrix B, int upper, int transpose, int unit);
+int zeroPivot(Matrix T);
+int backSubstitution(Matrix A, Matrix solution, Matrix b);
+int forwardSubstitution(Matrix L, Matrix solution, Matrix b, int unit);
 
 #endif
@@ -0,0 +1,15 @@
+/*
+  @file gemm.h
+  @author Gerardo Veltri
+  Cache-blocked general matrix multiply on row-major arrays
+*/
+#ifndef GEMM_HEADER
+#define GEMM_HEADER
+
+void gemm(int transA, int transB, int n, int m, int k,
+          double alpha, const double *A, int lda,
+          const double *B, int ldb,
+          double beta, double *C, int ldc);
+void gemmFreeBuffers(void);
+
+#endif
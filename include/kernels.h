@@ -0,0 +1,25 @@
+/*
+  @file kernels.h
+  @author Gerardo Veltri
+  Vector primitives with SIMD implementations selected at startup
+*/
+#ifndef KERNELS_HEADER
+#define KERNELS_HEADER
+
+/* instruction set levels, ordered */
+#define SIMD_GENERIC 0
+#define SIMD_SSE2 1
+#define SIMD_AVX2 2
+#define SIMD_AVX512 3
+
+int simdLevel(void);
+const char *simdName(void);
+
+double vectorDot(int n, const double *x, int incx, const double *y, int incy);
+void vectorAxpy(int n, double alpha, const double *x, int incx, double *y, int incy);
+void vectorScale(int n, double alpha, double *x, int incx);
+double vectorSum(int n, const double *x, int incx, int _abs);
+double vectorMax(int n, const double *x, int incx, int _abs);
+void vectorAbs(int n, double *x, int incx);
+
+#endif
@@ -0,0 +1,75 @@
+/*
+  @file krylov.h
+  @author Gerardo Veltri
+  Krylov subspace methods on operators known only through products
+*/
+#ifndef KRYLOV_HEADER
+#define KRYLOV_HEADER
+
+/* y <- A x for an n x n operator A, x and y hold n contiguous doubles */
+typedef void (*MatVec)(void *A, const double *x, double *y);
+
+/* z <- M^-1 r for a preconditioner M of an n x n operator, r and z hold n contiguous doubles */
+typedef void (*Preconditioner)(void *M, const double *r, double *z);
+
+/* basis vectors kept beyond the eigenpairs wanted when none is given */
+#define KRYLOV_EXTRA 20
+
+/* restarts allowed before the Krylov eigensolvers give up */
+#define KRYLOV_MAX_RESTARTS 300
+
+/* relative residual the linear solvers aim for when none is given */
+#define KRYLOV_TOLERANCE 1e-10
+
+/* GMRES basis vectors between restarts when none is given */
+#define GMRES_RESTART 30
+
+/* status of the linear solvers */
+#define SOLVE_CONVERGED 0
+#define SOLVE_MAX_ITERATIONS 1 /* tol not reached within the iteration limit */
+#define SOLVE_BREAKDOWN 2 /* a recurrence divided by zero */
+
+void denseMatVec(void *A, const double *x, double *y);
+
+int _lanczosEigen(MatVec A, void *op, int n, int k, char which, int m, double tol,
+                  double *w, Matrix Z, Arena workspace);
+size_t lanczosEigenWorkspaceSize(int n, int k, int m);
+int lanczosEigen(MatVec A, void *op, int n, int k, char which, int m, double tol,
+                 double *w, Matrix Z);
+
+int _arnoldiEigen(MatVec A, void *op, int n, int k, char which, int m, double tol,
+                  double *wr, double *wi, Matrix V, Arena workspace);
+size_t arnoldiEigenWorkspaceSize(int n, int k, int m);
+int arnoldiEigen(MatVec A, void *op, int n, int k, char which, int m, double tol,
+                 double *wr, double *wi, Matrix V);
+
+void formJacobi(Matrix A, Matrix D);
+void applyJacobi(void *D, const double *r, double *z);
+int incompleteLU(Matrix A);
+void applyIncompleteLU(void *LU, const double *r, double *z);
+
+int _conjugateGradient(MatVec A, void *op, int n, const double *b, double *x,
+                       Preconditioner M, void *pre, double tol, int maxit,
+                       double *history, int *iterations, Arena workspace);
+size_t conjugateGradientWorkspaceSize(int n);
+int conjugateGradient(MatVec A, void *op, int n, const double *b, double *x,
+                      Preconditioner M, void *pre, double tol, int maxit,
+                      double *history, int *iterations);
+
+int _GMRES(MatVec A, void *op, int n, const double *b, double *x,
+           Preconditioner M, void *pre, int m, double tol, int maxit,
+           double *history, int *iterations, Arena workspace);
+size_t GMRESWorkspaceSize(int n, int m);
+int GMRES(MatVec A, void *op, int n, const double *b, double *x,
+          Preconditioner M, void *pre, int m, double tol, int maxit,
+          double *history, int *iterations);
+
+int _BiCGSTAB(MatVec A, void *op, int n, const double *b, double *x,
+              Preconditioner M, void *pre, double tol, int maxit,
+              double *history, int *iterations, Arena workspace);
+size_t BiCGSTABWorkspaceSize(int n);
+int BiCGSTAB(MatVec A, void *op, int n, const double *b, double *x,
+             Preconditioner M, void *pre, double tol, int maxit,
+             double *history, int *iterations);
+
+#endif
@@ -8,11 +8,13 @@
 
 double maccess(Matrix matrix, int i, int j);
 void mset(Matrix matrix, int i, int j, double value);
+double *mptr(Matrix matrix, int i, int j);
 
 
 void fillMatrix(double values[], Matrix matrix);
 void setMatrixValues(double value, char type, Matrix matrix);
 void copyMatrix(Matrix source, Matrix target);
+void copyColumn(Matrix source, int idx_s, Matrix target, int idx_t);
 void copyRow(Matrix source, int idx_s, Matrix target, int idx_t);
 void switchRow(Matrix matrix, int row1, int row2);
 void transposeMatrix(Matrix source, Matrix target);
@@ -53,5 +55,7 @@ void outerMatrix(Matrix source, int idx_s, Matrix target);
 void simpleMultiplyMatrices(Matrix source1, Matrix source2, Matrix target);
 void multiplyMatrices(Matrix source1, int transpose1, Matrix source2, int transpose2,
 		      Matrix target, double tscalar);
+void scaledMultiplyMatrices(Matrix source1, int transpose1, Matrix source2, int transpose2,
+                            double scalar, Matrix target, double tscalar);
 
 #endif
@@ -6,15 +6,31 @@
 #ifndef MEM_HEADER
 #define MEM_HEADER
 
+#include <stddef.h>
+
+/* storage of a matrix, decides how freeMatrix releases it */
+#define MATRIX_SPLIT 0 /* header and values allocated separately */
+#define MATRIX_BLOCK 1 /* header and values share one aligned block */
+#define MATRIX_VIEW 2 /* values belong to another matrix */
+#define MATRIX_ARENA 3 /* header and values live in an Arena */
+
+/* alignment of values and of every row of a block matrix */
+#define MATRIX_ALIGN 64
+
 typedef struct _Matrix_ {
 
     int n; /* rows */
     int m; /* columns */
+    int ld; /* leading dimension, distance between rows, ld >= m */
+    int storage;
 
     double *values;
 
 } *Matrix;
 
+/* storage for the header of a view, see viewMatrix */
+typedef struct _Matrix_ MatrixView;
+
 typedef struct _MatrixStack_ {
 
     int n;
@@ -28,9 +44,39 @@ typedef struct _MatrixStack_ {
 } *MatrixStack;
 
 
+/*
+  bump-pointer workspace, matrices of any shape are carved out of one
+  preallocated region and given back in bulk with arenaRelease
+*/
+typedef struct _Arena_ {
+
+    char *base;
+    size_t size;
+    size_t used;
+    size_t peak; /* high-water mark of used */
+    int owned; /* base was allocated together with the header */
+
+} *Arena;
+
+
 Matrix allocMatrix(int n, int m);
+Matrix allocMatrixAligned(int n, int m, int huge_pages);
+int alignedStride(int m);
 void freeMatrix(Matrix matrix);
 
+Matrix viewMatrix(Matrix parent, int i, int j, int n, int m, MatrixView *view);
+
+Arena allocArena(size_t size);
+Arena initArena(void *buffer, size_t size);
+size_t arenaBufferSize(size_t size);
+void freeArena(Arena arena);
+size_t arenaMark(Arena arena);
+void arenaRelease(Arena arena, size_t mark);
+void *arenaAlloc(Arena arena, size_t size);
+size_t arenaAllocSize(size_t size);
+Matrix arenaMatrix(Arena arena, int n, int m);
+size_t arenaMatrixSize(int n, int m);
+
 MatrixStack allocMatrixStack(int n, int m, int depth);
 Matrix popMatrixStack(MatrixStack stack);
 void pushMatrixStack(MatrixStack stack, Matrix matrix);
@@ -0,0 +1,19 @@
+/*
+  @file pool.h
+  @author Gerardo Veltri
+  Persistent thread pool shared by the parallel kernels
+*/
+#ifndef POOL_HEADER
+#define POOL_HEADER
+
+/* body of a parallel loop, called once for every index i of the loop */
+typedef void (*PoolTask)(void *arg, int i);
+
+int poolThreads(void);
+void setPoolThreads(int threads);
+void setPoolAffinity(const int *cpus, int count);
+void freePool(void);
+
+void poolFor(int count, PoolTask work, void *arg);
+
+#endif
@@ -0,0 +1,26 @@
+/*
+  @file solver.h
+  @author Gerardo Veltri
+  Factor once, solve many: factorizations kept for repeated solves
+*/
+#ifndef SOLVER_HEADER
+#define SOLVER_HEADER
+
+/* kinds of factorization held by a handle */
+#define FACTOR_LU 0 /* PA = LU, square A */
+#define FACTOR_QR 1 /* A = QR, A n x m with n >= m, least squares */
+#define FACTOR_CHOLESKY 2 /* A = LLT, symmetric positive definite A */
+
+/* opaque, see solver.c */
+typedef struct _Factorization_ *Factorization;
+
+Factorization factorize(Matrix A, int kind);
+void freeFactorization(Factorization F);
+int factorizationStatus(Factorization F);
+
+int _factorizationSolve(Factorization F, Matrix B, int transpose, Arena workspace);
+size_t factorizationSolveWorkspaceSize(Factorization F, int k);
+int factorizationSolve(Factorization F, Matrix B);
+int factorizationSolveTransposed(Factorization F, Matrix B);
+
+#endif
@@ -0,0 +1,27 @@
+/*
+  @file svd.h
+  @author Gerardo Veltri
+  Singular value decomposition
+*/
+#ifndef SVD_HEADER
+#define SVD_HEADER
+
+/* sweeps over all column pairs allowed before the Jacobi SVD gives up */
+#define JACOBI_MAX_SWEEPS 30
+
+/* extra sketch columns of the randomized SVD when none is given */
+#define RSVD_OVERSAMPLING 10
+
+/* power iterations of the randomized SVD when none is given */
+#define RSVD_POWER_ITERATIONS 2
+
+int _singularValueDecomposition(Matrix A, double *s, Matrix U, Matrix V, Arena workspace);
+size_t singularValueDecompositionWorkspaceSize(int n, int m);
+int singularValueDecomposition(Matrix A, double *s, Matrix U, Matrix V);
+
+int _randomizedSVD(Matrix A, int k, int p, int q, double *s, Matrix U, Matrix V,
+                   Arena workspace);
+size_t randomizedSVDWorkspaceSize(int n, int m, int k, int p);
+int randomizedSVD(Matrix A, int k, int p, int q, double *s, Matrix U, Matrix V);
+
+#endif
@@ -0,0 +1,19 @@
+/*
+  @file tiled.h
+  @author Gerardo Veltri
+  Tiled factorizations scheduled as a graph of tasks
+*/
+#ifndef TILED_HEADER
+#define TILED_HEADER
+
+/* default tile size of the tiled factorizations */
+#define TILE_SIZE 128
+
+int tiledCholesky(Matrix A, int nb);
+void tiledLU(Matrix A, int *ipiv, int nb);
+
+int tiledQRTauSize(int n, int m, int nb);
+void tiledQR(Matrix A, double *tau, int nb);
+void tiledApplyQ(Matrix V, double *tau, int nb, Matrix B, int transpose);
+
+#endif
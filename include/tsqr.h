@@ -0,0 +1,32 @@
+/*
+  @file tsqr.h
+  @author Gerardo Veltri
+  Tall-skinny QR, row blocks factored in parallel and reduced in a tree
+*/
+#ifndef TSQR_HEADER
+#define TSQR_HEADER
+
+/* fewest rows in a TSQR row block, smaller inputs get fewer blocks */
+#define TSQR_BLOCK_ROWS 4096
+
+/*
+  row blocks of a TSQR when no thread count is given. Fixed rather than
+  taken from the pool, so the blocks and the workspace size do not
+  change with setPoolThreads, blocks beyond the threads queue on the pool
+*/
+#define TSQR_MAX_BLOCKS 64
+
+/* opaque, see tsqr.c */
+typedef struct _TSQR_ *TSQR;
+
+int tsqrBlocks(int n, int m, int threads);
+
+TSQR _tsqr(Matrix A, int threads, Arena workspace);
+size_t tsqrWorkspaceSize(int n, int m, int threads);
+size_t tsqrHandleSize(int n, int m, int threads);
+Matrix tsqrR(TSQR T);
+
+void _tsqrApplyQ(TSQR T, Matrix B, int transpose, Arena workspace);
+size_t tsqrApplyQWorkspaceSize(int n, int m, int k, int threads);
+
+#endif
@@ -0,0 +1,1171 @@
+/*
+  @file eigen.c
+  @author Gerardo Veltri
+  Eigenvalues and eigenvectors
+
+  A general real matrix is first reduced to upper Hessenberg form H by
+  hessenbergReduction, O(n^3) once. Francis double-shift QR steps then
+  drive H to real Schur form T: each step chases a 3 x 3 bulge down
+  the subdiagonal in O(n^2), the shifts being the eigenvalues of the
+  trailing 2 x 2 block so complex pairs are found in real arithmetic.
+  Subdiagonal entries that become negligible split the problem and
+  converged 1 x 1 and 2 x 2 blocks are deflated, so a couple of steps
+  per eigenvalue suffice and the whole solve stays O(n^3).
+
+  Eigenvectors, when asked for, are found by back substitution on T
+  and carried back through the accumulated Schur vectors. The
+  iteration follows the EISPACK routine hqr2.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <assert.h>
+#include <mem.h>
+#include <matrix.h>
+#include <kernels.h>
+#include <factorization.h>
+#include <eigen.h>
+
+#define min(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a < _b ? _a : _b; })
+
+#define max(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a > _b ? _a : _b; })
+
+/* elements of the Hessenberg matrix and of the Schur vectors, row-major */
+#define H(i, j) h[(size_t)(i)*ldh + (j)]
+#define Z(i, j) z[(size_t)(i)*ldz + (j)]
+
+/* (xr + i xi) / (yr + i yi) without overflow in the intermediate terms */
+static void complexDivide(double xr, double xi, double yr, double yi, double *qr, double *qi)
+{
+        double r, d;
+
+        if (fabs(yr) > fabs(yi))
+        {
+                r = yi / yr;
+                d = yr + r * yi;
+                *qr = (xr + r * xi) / d;
+                *qi = (xi - r * xr) / d;
+        }
+        else
+        {
+                r = yr / yi;
+                d = yi + r * yr;
+                *qr = (r * xr + xi) / d;
+                *qi = (r * xi - xr) / d;
+        }
+}
+
+/*
+  francisQR
+
+  real Schur form of the upper Hessenberg h by double-shift QR. The
+  eigenvalues go to wr, wi, a complex pair as two consecutive entries
+  with wi > 0 first. When z is given the transformations are
+  accumulated into it and the whole of h is kept up to date, so that
+  h ends up as T; otherwise only the unreduced block is iterated on.
+
+  @return 0, or i+1 when eigenvalue i did not converge within
+  EIG_MAX_ITERATIONS steps, those after i are valid
+*/
+static int francisQR(int nn, double *h, int ldh, double *z, int ldz, double *wr, double *wi)
+{
+        double eps = DBL_EPSILON;
+        double exshift = 0;
+        double p = 0, q = 0, r = 0, s = 0, w, x, y, u;
+        int vectors = z != NULL;
+
+        double norm = 0;
+        for (int i=0; i<nn; i++)
+                for (int j=max(i-1, 0); j<nn; j++)
+                        norm = norm + fabs(H(i, j));
+
+        int n = nn-1;
+        int iter = 0;
+
+        while (n >= 0)
+        {
+                /* look for a single small subdiagonal element */
+                int l = n;
+                while (l > 0)
+                {
+                        s = fabs(H(l-1, l-1)) + fabs(H(l, l));
+                        if (s == 0)
+                                s = norm;
+                        if (fabs(H(l, l-1)) <= eps * s)
+                                break;
+                        l--;
+                }
+
+                /* the rows and columns kept up to date */
+                int first = vectors ? 0 : l;
+                int last = vectors ? nn : n+1;
+
+                if (l == n)
+                {
+                        /* one root */
+                        H(n, n) = H(n, n) + exshift;
+                        wr[n] = H(n, n);
+                        wi[n] = 0;
+                        n--;
+                        iter = 0;
+                }
+                else if (l == n-1)
+                {
+                        /* two roots */
+                        w = H(n, n-1) * H(n-1, n);
+                        p = (H(n-1, n-1) - H(n, n)) / 2;
+                        q = p * p + w;
+                        u = sqrt(fabs(q));
+                        H(n, n) = H(n, n) + exshift;
+                        H(n-1, n-1) = H(n-1, n-1) + exshift;
+                        x = H(n, n);
+
+                        if (q >= 0)
+                        {
+                                /* real pair, rotate the block to upper triangular */
+                                u = p >= 0 ? p + u : p - u;
+                                wr[n-1] = x + u;
+                                wr[n] = wr[n-1];
+                                if (u != 0)
+                                        wr[n] = x - w / u;
+                                wi[n-1] = 0;
+                                wi[n] = 0;
+
+                                if (vectors)
+                                {
+                                        x = H(n, n-1);
+                                        s = fabs(x) + fabs(u);
+                                        p = x / s;
+                                        q = u / s;
+                                        r = sqrt(p * p + q * q);
+                                        p = p / r;
+                                        q = q / r;
+
+                                        for (int j=n-1; j<last; j++)
+                                        {
+                                                u = H(n-1, j);
+                                                H(n-1, j) = q * u + p * H(n, j);
+                                                H(n, j) = q * H(n, j) - p * u;
+                                        }
+                                        for (int i=first; i<=n; i++)
+                                        {
+                                                u = H(i, n-1);
+                                                H(i, n-1) = q * u + p * H(i, n);
+                                                H(i, n) = q * H(i, n) - p * u;
+                                        }
+                                        for (int i=0; i<nn; i++)
+                                        {
+                                                u = Z(i, n-1);
+                                                Z(i, n-1) = q * u + p * Z(i, n);
+                                                Z(i, n) = q * Z(i, n) - p * u;
+                                        }
+                                }
+                        }
+                        else
+                        {
+                                /* complex pair */
+                                wr[n-1] = x + p;
+                                wr[n] = x + p;
+                                wi[n-1] = u;
+                                wi[n] = -u;
+                        }
+                        n = n-2;
+                        iter = 0;
+                }
+                else
+                {
+                        if (iter == EIG_MAX_ITERATIONS)
+                                return n+1;
+
+                        /* shifts from the trailing 2 x 2 block */
+                        x = H(n, n);
+                        y = H(n-1, n-1);
+                        w = H(n, n-1) * H(n-1, n);
+
+                        /* exceptional shifts break cycles of the standard ones */
+                        if (iter == 10)
+                        {
+                                exshift += x;
+                                for (int i=0; i<=n; i++)
+                                        H(i, i) -= x;
+                                s = fabs(H(n, n-1)) + fabs(H(n-1, n-2));
+                                x = y = 0.75 * s;
+                                w = -0.4375 * s * s;
+                        }
+
+                        if (iter == 30)
+                        {
+                                s = (y - x) / 2;
+                                s = s * s + w;
+                                if (s > 0)
+                                {
+                                        s = sqrt(s);
+                                        if (y < x)
+                                                s = -s;
+                                        s = x - w / ((y - x) / 2 + s);
+                                        for (int i=0; i<=n; i++)
+                                                H(i, i) -= s;
+                                        exshift += s;
+                                        x = y = w = 0.964;
+                                }
+                        }
+
+                        iter++;
+
+                        /* look for two consecutive small subdiagonal elements */
+                        int m = n-2;
+                        while (m >= l)
+                        {
+                                u = H(m, m);
+                                r = x - u;
+                                s = y - u;
+                                p = (r * s - w) / H(m+1, m) + H(m, m+1);
+                                q = H(m+1, m+1) - u - r - s;
+                                r = H(m+2, m+1);
+                                s = fabs(p) + fabs(q) + fabs(r);
+                                p = p / s;
+                                q = q / s;
+                                r = r / s;
+                                if (m == l)
+                                        break;
+                                if (fabs(H(m, m-1)) * (fabs(q) + fabs(r))
+                                    < eps * (fabs(p) * (fabs(H(m-1, m-1)) + fabs(u) + fabs(H(m+1, m+1)))))
+                                        break;
+                                m--;
+                        }
+
+                        for (int i=m+2; i<=n; i++)
+                        {
+                                H(i, i-2) = 0;
+                                if (i > m+2)
+                                        H(i, i-3) = 0;
+                        }
+
+                        /* double QR step on rows l..n and columns m..n, chasing the bulge */
+                        for (int k=m; k<=n-1; k++)
+                        {
+                                int notlast = k != n-1;
+                                if (k != m)
+                                {
+                                        p = H(k, k-1);
+                                        q = H(k+1, k-1);
+                                        r = notlast ? H(k+2, k-1) : 0;
+                                        x = fabs(p) + fabs(q) + fabs(r);
+                                        if (x == 0)
+                                                continue;
+                                        p = p / x;
+                                        q = q / x;
+                                        r = r / x;
+                                }
+
+                                s = sqrt(p * p + q * q + r * r);
+                                if (p < 0)
+                                        s = -s;
+                                if (s == 0)
+                                        continue;
+
+                                if (k != m)
+                                        H(k, k-1) = -s * x;
+                                else if (l != m)
+                                        H(k, k-1) = -H(k, k-1);
+                                p = p + s;
+                                x = p / s;
+                                y = q / s;
+                                u = r / s;
+                                q = q / p;
+                                r = r / p;
+
+                                /* row modification */
+                                for (int j=k; j<last; j++)
+                                {
+                                        p = H(k, j) + q * H(k+1, j);
+                                        if (notlast)
+                                        {
+                                                p = p + r * H(k+2, j);
+                                                H(k+2, j) = H(k+2, j) - p * u;
+                                        }
+                                        H(k, j) = H(k, j) - p * x;
+                                        H(k+1, j) = H(k+1, j) - p * y;
+                                }
+
+                                /* column modification */
+                                for (int i=first; i<=min(n, k+3); i++)
+                                {
+                                        p = x * H(i, k) + y * H(i, k+1);
+                                        if (notlast)
+                                        {
+                                                p = p + u * H(i, k+2);
+                                                H(i, k+2) = H(i, k+2) - p * r;
+                                        }
+                                        H(i, k) = H(i, k) - p;
+                                        H(i, k+1) = H(i, k+1) - p * q;
+                                }
+
+                                if (!vectors)
+                                        continue;
+
+                                for (int i=0; i<nn; i++)
+                                {
+                                        p = x * Z(i, k) + y * Z(i, k+1);
+                                        if (notlast)
+                                        {
+                                                p = p + u * Z(i, k+2);
+                                                Z(i, k+2) = Z(i, k+2) - p * r;
+                                        }
+                                        Z(i, k) = Z(i, k) - p;
+                                        Z(i, k+1) = Z(i, k+1) - p * q;
+                                }
+                        }
+                }
+        }
+
+        return 0;
+}
+
+/*
+  schurVectors
+
+  eigenvectors of the real Schur form T in h by back substitution,
+  written over T, then multiplied into the Schur vectors z. A complex
+  pair j, j+1 yields the real and imaginary parts of the eigenvector
+  of wr[j] + i wi[j] in columns j and j+1.
+*/
+static void schurVectors(int nn, double *h, int ldh, double *z, int ldz, double *wr, double *wi)
+{
+        double eps = DBL_EPSILON;
+        double p, q, r = 0, s = 0, t, w, x, y, u = 0;
+
+        double norm = 0;
+        for (int i=0; i<nn; i++)
+                for (int j=max(i-1, 0); j<nn; j++)
+                        norm = norm + fabs(H(i, j));
+
+        if (norm == 0)
+                return;
+
+        for (int n=nn-1; n>=0; n--)
+        {
+                p = wr[n];
+                q = wi[n];
+
+                if (q == 0)
+                {
+                        /* real vector */
+                        int l = n;
+                        H(n, n) = 1;
+                        for (int i=n-1; i>=0; i--)
+                        {
+                                w = H(i, i) - p;
+                                r = 0;
+                                for (int j=l; j<=n; j++)
+                                        r = r + H(i, j) * H(j, n);
+
+                                if (wi[i] < 0)
+                                {
+                                        u = w;
+                                        s = r;
+                                        continue;
+                                }
+
+                                l = i;
+                                if (wi[i] == 0)
+                                {
+                                        H(i, n) = w != 0 ? -r / w : -r / (eps * norm);
+                                }
+                                else
+                                {
+                                        /* 2 x 2 block on the diagonal */
+                                        x = H(i, i+1);
+                                        y = H(i+1, i);
+                                        q = (wr[i] - p) * (wr[i] - p) + wi[i] * wi[i];
+                                        t = (x * s - u * r) / q;
+                                        H(i, n) = t;
+                                        if (fabs(x) > fabs(u))
+                                                H(i+1, n) = (-r - w * t) / x;
+                                        else
+                                                H(i+1, n) = (-s - y * t) / u;
+                                }
+
+                                /* overflow control */
+                                t = fabs(H(i, n));
+                                if ((eps * t) * t > 1)
+                                        for (int j=i; j<=n; j++)
+                                                H(j, n) = H(j, n) / t;
+                        }
+                }
+                else if (q < 0)
+                {
+                        /* complex vector, last component imaginary so the system is triangular */
+                        int l = n-1;
+
+                        if (fabs(H(n, n-1)) > fabs(H(n-1, n)))
+                        {
+                                H(n-1, n-1) = q / H(n, n-1);
+                                H(n-1, n) = -(H(n, n) - p) / H(n, n-1);
+                        }
+                        else
+                        {
+                                complexDivide(0, -H(n-1, n), H(n-1, n-1) - p, q,
+                                              &H(n-1, n-1), &H(n-1, n));
+                        }
+                        H(n, n-1) = 0;
+                        H(n, n) = 1;
+
+                        for (int i=n-2; i>=0; i--)
+                        {
+                                double ra = 0, sa = 0, vr, vi;
+                                for (int j=l; j<=n; j++)
+                                {
+                                        ra = ra + H(i, j) * H(j, n-1);
+                                        sa = sa + H(i, j) * H(j, n);
+                                }
+                                w = H(i, i) - p;
+
+                                if (wi[i] < 0)
+                                {
+                                        u = w;
+                                        r = ra;
+                                        s = sa;
+                                        continue;
+                                }
+
+                                l = i;
+                                if (wi[i] == 0)
+                                {
+                                        complexDivide(-ra, -sa, w, q, &H(i, n-1), &H(i, n));
+                                }
+                                else
+                                {
+                                        x = H(i, i+1);
+                                        y = H(i+1, i);
+                                        vr = (wr[i] - p) * (wr[i] - p) + wi[i] * wi[i] - q * q;
+                                        vi = (wr[i] - p) * 2 * q;
+                                        if ((vr == 0) & (vi == 0))
+                                                vr = eps * norm * (fabs(w) + fabs(q) + fabs(x)
+                                                                   + fabs(y) + fabs(u));
+                                        complexDivide(x * r - u * ra + q * sa, x * s - u * sa - q * ra,
+                                                      vr, vi, &H(i, n-1), &H(i, n));
+                                        if (fabs(x) > fabs(u) + fabs(q))
+                                        {
+                                                H(i+1, n-1) = (-ra - w * H(i, n-1) + q * H(i, n)) / x;
+                                                H(i+1, n) = (-sa - w * H(i, n) - q * H(i, n-1)) / x;
+                                        }
+                                        else
+                                        {
+                                                complexDivide(-r - y * H(i, n-1), -s - y * H(i, n), u, q,
+                                                              &H(i+1, n-1), &H(i+1, n));
+                                        }
+                                }
+
+                                /* overflow control */
+                                t = max(fabs(H(i, n-1)), fabs(H(i, n)));
+                                if ((eps * t) * t > 1)
+                                {
+                                        for (int j=i; j<=n; j++)
+                                        {
+                                                H(j, n-1) = H(j, n-1) / t;
+                                                H(j, n) = H(j, n) / t;
+                                        }
+                                }
+                        }
+                }
+        }
+
+        /* back to the eigenvectors of A, Z <- Z X with X upper triangular in h */
+        for (int j=nn-1; j>=0; j--)
+        {
+                for (int i=0; i<nn; i++)
+                {
+                        u = 0;
+                        for (int k=0; k<=j; k++)
+                                u = u + Z(i, k) * H(k, j);
+                        Z(i, j) = u;
+                }
+        }
+}
+
+/* scale every eigenvector, or complex pair of columns, to unit length */
+static void normalizeVectors(Matrix V, double *wi)
+{
+        for (int j=0; j<V->m; j++)
+        {
+                double length = norm('C', V, j);
+                int pair = (wi[j] > 0) & (j+1 < V->m);
+
+                if (pair)
+                        length = hypot(length, norm('C', V, j+1));
+                if (length == 0)
+                        continue;
+
+                scaleColumn(V, j, 1 / length);
+                if (pair)
+                {
+                        scaleColumn(V, j+1, 1 / length);
+                        j++;
+                }
+        }
+}
+
+/*
+  Eigenvalue decomposition
+
+  Av = λv for a general real square A: Hessenberg reduction followed
+  by Francis double-shift QR iterations with deflation. A is
+  overwritten. Eigenvalue j is wr[j] + i wi[j]. Complex eigenvalues
+  come in conjugate pairs on consecutive entries, the one with
+  positive imaginary part first.
+
+  When V is given it receives the eigenvectors, scaled to unit length,
+  in the layout of LAPACK's dgeev: column j for a real eigenvalue,
+  columns j and j+1 the real and imaginary parts of the eigenvector of
+  wr[j] + i wi[j] for a complex pair (its conjugate belongs to the
+  conjugate eigenvalue), so that A V = V D with D block diagonal.
+
+  @param A square matrix, destroyed
+  @param wr n real parts
+  @param wi n imaginary parts
+  @param V n x n eigenvectors, or NULL for eigenvalues only
+  @param workspace arena for scratch, see eigenvalueQRWorkspaceSize
+  @return 0, or i+1 when eigenvalue i did not converge, eigenvalues
+  i+1 .. n-1 are valid and V is not written
+*/
+int _eigenvalueQR(Matrix A, double *wr, double *wi, Matrix V, Arena workspace)
+{
+        assert(A->n == A->m);
+        assert((V == NULL) || ((V->n == A->n) & (V->m == A->n)));
+
+        int n = A->n;
+        size_t mark = arenaMark(workspace);
+        double *tau = arenaAlloc(workspace, n*sizeof(double));
+
+        hessenbergReduction(A, tau, workspace);
+        if (V != NULL)
+                formHessenbergQ(A, tau, V, workspace);
+
+        /* the reflectors are no longer needed, leave a clean H */
+        for (int i=2; i<n; i++)
+                for (int j=0; j<i-1; j++)
+                        mset(A, i, j, 0);
+
+        double *z = V != NULL ? V->values : NULL;
+        int ldz = V != NULL ? V->ld : 0;
+
+        int info = francisQR(n, A->values, A->ld, z, ldz, wr, wi);
+        if ((info == 0) & (V != NULL))
+        {
+                schurVectors(n, A->values, A->ld, z, ldz, wr, wi);
+                normalizeVectors(V, wi);
+        }
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _eigenvalueQR for an n x n input */
+size_t eigenvalueQRWorkspaceSize(int n)
+{
+        return arenaAllocSize(n*sizeof(double)) + hessenbergReductionWorkspaceSize(n);
+}
+
+/*
+  Eigenvalue decomposition
+
+  allocates its own workspace, see _eigenvalueQR
+
+  @param A square matrix, destroyed
+  @param wr n real parts
+  @param wi n imaginary parts
+  @param V n x n eigenvectors, or NULL for eigenvalues only
+  @return 0, or i+1 when eigenvalue i did not converge
+*/
+int eigenvalueQR(Matrix A, double *wr, double *wi, Matrix V)
+{
+        Arena workspace = allocArena(eigenvalueQRWorkspaceSize(A->n));
+
+        int info = _eigenvalueQR(A, wr, wi, V, workspace);
+
+        freeArena(workspace);
+        return info;
+}
+
+/*
+  tridiagonalQL
+
+  eigenvalues of the symmetric tridiagonal with diagonal d and
+  subdiagonal e, e[i] coupling i and i+1, by implicit QL steps with
+  Wilkinson shifts, the EISPACK routine tql2. When z is given the
+  rotations are accumulated into its columns. d is left unsorted and
+  e, which needs n entries, is destroyed.
+
+  @return 0, or i+1 when eigenvalue i did not converge
+*/
+static int tridiagonalQL(int n, double *d, double *e, double *z, int ldz)
+{
+        double eps = DBL_EPSILON;
+        double f = 0;
+        double tst1 = 0;
+
+        e[n-1] = 0;
+        for (int l=0; l<n; l++)
+        {
+                /* look for a small subdiagonal element */
+                tst1 = max(tst1, fabs(d[l]) + fabs(e[l]));
+                int m = l;
+                while (fabs(e[m]) > eps * tst1)
+                        m++;
+
+                int iter = 0;
+                while (m > l)
+                {
+                        if (iter++ == EIG_MAX_ITERATIONS)
+                                return l+1;
+
+                        /* shift from the leading 2 x 2 block */
+                        double g = d[l];
+                        double p = (d[l+1] - g) / (2 * e[l]);
+                        double r = copysign(hypot(p, 1), p);
+                        d[l] = e[l] / (p + r);
+                        d[l+1] = e[l] * (p + r);
+                        double dl1 = d[l+1];
+                        double h = g - d[l];
+                        for (int i=l+2; i<n; i++)
+                                d[i] -= h;
+                        f = f + h;
+
+                        /* implicit QL transformation, rotations from the bottom up */
+                        p = d[m];
+                        double c = 1, c2 = 1, c3 = 1;
+                        double el1 = e[l+1];
+                        double s = 0, s2 = 0;
+                        for (int i=m-1; i>=l; i--)
+                        {
+                                c3 = c2;
+                                c2 = c;
+                                s2 = s;
+                                g = c * e[i];
+                                h = c * p;
+                                r = hypot(p, e[i]);
+                                e[i+1] = s * r;
+                                s = e[i] / r;
+                                c = p / r;
+                                p = c * d[i] - s * g;
+                                d[i+1] = h + s * (c * g + s * d[i]);
+
+                                if (z == NULL)
+                                        continue;
+
+                                for (int k=0; k<n; k++)
+                                {
+                                        h = Z(k, i+1);
+                                        Z(k, i+1) = s * Z(k, i) + c * h;
+                                        Z(k, i) = c * Z(k, i) - s * h;
+                                }
+                        }
+                        p = -s * s2 * c3 * el1 * e[l] / dl1;
+                        e[l] = s * p;
+                        d[l] = c * p;
+
+                        if (fabs(e[l]) <= eps * tst1)
+                                break;
+                }
+                d[l] = d[l] + f;
+                e[l] = 0;
+        }
+
+        return 0;
+}
+
+/* an eigenvalue and the column it came from, for sorting */
+typedef struct {
+
+        double value;
+        int index;
+
+} Entry;
+
+static int compareEntries(const void *_a, const void *_b)
+{
+        const Entry *a = _a;
+        const Entry *b = _b;
+
+        return (a->value > b->value) - (a->value < b->value);
+}
+
+/* order[j] is the index of the j-th smallest of the n values of d */
+static void sortOrder(int n, const double *d, int *order, Arena workspace)
+{
+        size_t mark = arenaMark(workspace);
+        Entry *entries = arenaAlloc(workspace, n*sizeof(Entry));
+
+        for (int j=0; j<n; j++)
+        {
+                entries[j].value = d[j];
+                entries[j].index = j;
+        }
+        qsort(entries, n, sizeof(Entry), compareEntries);
+        for (int j=0; j<n; j++)
+                order[j] = entries[j].index;
+
+        arenaRelease(workspace, mark);
+}
+
+/* S[i][c] <- Q[i][order[c]] for every row, the columns of Q gathered */
+static void gatherColumns(Matrix Q, const int *order, Matrix S)
+{
+        for (int i=0; i<Q->n; i++)
+        {
+                double *source = mptr(Q, i, 0);
+                double *target = mptr(S, i, 0);
+                for (int c=0; c<S->m; c++)
+                        target[c] = source[order[c]];
+        }
+}
+
+/*
+  secularRoot
+
+  root i of the secular equation 1/rho + sum_j z_j^2 / (d_j - λ) = 0
+  for increasing d and rho > 0, which lies between d_i and d_i+1, or
+  past d_(k-1) for the last one. The root is sought as an offset from
+  the nearer of the two poles so it keeps its relative accuracy, by a
+  model with the two poles fitted to the value and slope of each side
+  of the sum, safeguarded by bisection. The differences d_j - λ, which
+  make up the eigenvector, go to delta without cancellation.
+
+  @return λ
+*/
+static double secularRoot(int k, const double *d, const double *z, double rho, int i,
+                          double *delta)
+{
+        int origin = i;
+        double lo = 0;
+        double hi = rho;
+
+        /* which pole is nearer follows from the sign in the middle */
+        if (i < k-1)
+        {
+                double mid = (d[i+1] - d[i]) / 2;
+                double g = 1 / rho;
+                for (int j=0; j<k; j++)
+                        g = g + z[j] * z[j] / ((d[j] - d[i]) - mid);
+
+                if (g >= 0)
+                {
+                        hi = mid;
+                }
+                else
+                {
+                        origin = i+1;
+                        lo = -mid;
+                        hi = 0;
+                }
+        }
+
+        double tau = (lo + hi) / 2;
+        for (int iter=0; iter<EIG_MAX_ITERATIONS; iter++)
+        {
+                /* psi sums the poles up to i, phi those past it */
+                double psi = 0, dpsi = 0, phi = 0, dphi = 0;
+                for (int j=0; j<k; j++)
+                {
+                        double t = z[j] / ((d[j] - d[origin]) - tau);
+                        if (j <= i)
+                        {
+                                psi = psi + z[j] * t;
+                                dpsi = dpsi + t * t;
+                        }
+                        else
+                        {
+                                phi = phi + z[j] * t;
+                                dphi = dphi + t * t;
+                        }
+                }
+
+                double g = 1 / rho + psi + phi;
+                if (fabs(g) <= 8 * DBL_EPSILON * k * (1 / rho + fabs(psi) + fabs(phi)))
+                        break;
+                if (g < 0)
+                        lo = tau;
+                else
+                        hi = tau;
+
+                /* psi ~ a + b / (p - s) and phi ~ c + e / (q - s) in the step s */
+                double p = (d[i] - d[origin]) - tau;
+                double b = dpsi * p * p;
+                double C = 1 / rho + psi - dpsi * p;
+                double step;
+
+                if (i == k-1)
+                {
+                        step = p + b / C;
+                }
+                else
+                {
+                        double q = (d[i+1] - d[origin]) - tau;
+                        double e = dphi * q * q;
+                        C = C + phi - dphi * q;
+
+                        /* C (p-s)(q-s) + b (q-s) + e (p-s) = 0, the root between p and q */
+                        double B = -(C * (p + q) + b + e);
+                        double A = C * p * q + b * q + e * p;
+                        if (C == 0)
+                        {
+                                step = -A / B;
+                        }
+                        else
+                        {
+                                double t = -(B + copysign(sqrt(fmax(B * B - 4 * C * A, 0)), B)) / 2;
+                                step = t / C;
+                                if (!((step > p) & (step < q)) & (t != 0))
+                                        step = A / t;
+                        }
+                }
+
+                double next = tau + step;
+                if (!((next > lo) & (next < hi)))
+                        next = (lo + hi) / 2;
+                if (next == tau)
+                        break;
+                tau = next;
+        }
+
+        for (int j=0; j<k; j++)
+                delta[j] = (d[j] - d[origin]) - tau;
+
+        return d[origin] + tau;
+}
+
+/*
+  mergeRankOne
+
+  eigenpairs of diag(T1, T2) + rho v vT from those of T1 and T2, Q
+  holding diag(Q1, Q2) with T1 of order h. In that basis the problem
+  is D + rho z zT with z = QT v. Components of z that are negligible,
+  or pairs of nearly equal d made so by a rotation, deflate: their
+  eigenpairs are already known. The k that remain solve the secular
+  equation. The weights are recomputed from the computed roots (Gu and
+  Eisenstat) so the eigenvectors d_j - λ come out orthogonal, and the
+  new vectors are one matrix multiply of the old ones with them. On
+  return d holds the eigenvalues, unsorted, and Q their vectors.
+*/
+static void mergeRankOne(Matrix Q, double *d, int h, double rho, Arena workspace)
+{
+        int n = Q->n;
+        size_t mark = arenaMark(workspace);
+
+        Matrix S = arenaMatrix(workspace, n, n);
+        double *z = arenaAlloc(workspace, 5*n*sizeof(double));
+        double *zs = z + n;
+        double *ds = zs + n;
+        double *zhat = ds + n;
+        double *lambda = zhat + n;
+        int *order = arenaAlloc(workspace, 2*n*sizeof(int));
+        int *deflated = order + n;
+
+        /* v = e_(h-1) + sign(rho) e_h, so z is a row of Q1 and one of Q2 */
+        for (int j=0; j<h; j++)
+                z[j] = maccess(Q, h-1, j);
+        for (int j=h; j<n; j++)
+                z[j] = copysign(1, rho) * maccess(Q, h, j);
+
+        double znorm = sqrt(vectorDot(n, z, 1, z, 1));
+        rho = fabs(rho) * znorm * znorm;
+        vectorScale(n, 1 / znorm, z, 1);
+
+        sortOrder(n, d, order, workspace);
+        gatherColumns(Q, order, S);
+        for (int j=0; j<n; j++)
+        {
+                ds[j] = d[order[j]];
+                zs[j] = z[order[j]];
+        }
+
+        /* deflation */
+        double tol = 8 * DBL_EPSILON * max(max(fabs(ds[0]), fabs(ds[n-1])), rho);
+        int prev = -1;
+        for (int j=0; j<n; j++)
+        {
+                deflated[j] = rho * fabs(zs[j]) <= tol;
+                if (deflated[j])
+                        continue;
+
+                if (prev >= 0)
+                {
+                        /* rotate z_prev into z_j when d_prev and d_j nearly agree */
+                        double r = hypot(zs[j], zs[prev]);
+                        double c = zs[j] / r;
+                        double s = -zs[prev] / r;
+                        double t = ds[j] - ds[prev];
+
+                        if (fabs(t * c * s) <= tol)
+                        {
+                                zs[j] = r;
+                                zs[prev] = 0;
+                                for (int i=0; i<n; i++)
+                                {
+                                        double x = maccess(S, i, prev);
+                                        double y = maccess(S, i, j);
+                                        mset(S, i, prev, c * x + s * y);
+                                        mset(S, i, j, c * y - s * x);
+                                }
+                                t = ds[prev] * c * c + ds[j] * s * s;
+                                ds[j] = ds[prev] * s * s + ds[j] * c * c;
+                                ds[prev] = t;
+                                deflated[prev] = 1;
+                        }
+                }
+                prev = j;
+        }
+
+        /* the k columns still coupled first, then the deflated ones */
+        int k = 0;
+        for (int j=0; j<n; j++)
+                if (!deflated[j])
+                        order[k++] = j;
+        for (int j=0, c=k; j<n; j++)
+                if (deflated[j])
+                {
+                        d[c] = ds[j];
+                        order[c++] = j;
+                }
+        for (int c=0; c<k; c++)
+        {
+                ds[c] = ds[order[c]];
+                zs[c] = zs[order[c]];
+        }
+
+        MatrixView _Sk, _Qk;
+        gatherColumns(S, order, Q);
+
+        if (k > 0)
+        {
+                /* row i of W holds d_j - λ_i, then the eigenvector of λ_i */
+                Matrix W = arenaMatrix(workspace, k, k);
+                for (int i=0; i<k; i++)
+                        lambda[i] = secularRoot(k, ds, zs, rho, i, mptr(W, i, 0));
+
+                for (int j=0; j<k; j++)
+                {
+                        double v = -maccess(W, k-1, j) / rho;
+                        for (int i=0; i<j; i++)
+                                v = v * maccess(W, i, j) / (ds[j] - ds[i]);
+                        for (int i=j; i<k-1; i++)
+                                v = v * -maccess(W, i, j) / (ds[i+1] - ds[j]);
+                        zhat[j] = copysign(sqrt(fabs(v)), zs[j]);
+                }
+
+                for (int i=0; i<k; i++)
+                {
+                        double *row = mptr(W, i, 0);
+                        for (int j=0; j<k; j++)
+                                row[j] = zhat[j] / row[j];
+                        vectorScale(k, 1 / sqrt(vectorDot(k, row, 1, row, 1)), row, 1);
+                        d[i] = lambda[i];
+                }
+
+                Matrix Sk = viewMatrix(S, 0, 0, n, k, &_Sk);
+                Matrix Qk = viewMatrix(Q, 0, 0, n, k, &_Qk);
+                copyMatrix(Qk, Sk);
+                multiplyMatrices(Sk, 0, W, 1, Qk, 0);
+        }
+
+        arenaRelease(workspace, mark);
+}
+
+/* workspace bytes needed by mergeRankOne for a problem of order n */
+static size_t mergeRankOneWorkspaceSize(int n)
+{
+        return 2*arenaMatrixSize(n, n) + arenaAllocSize(5*n*sizeof(double))
+                + arenaAllocSize(2*n*sizeof(int)) + arenaAllocSize(n*sizeof(Entry));
+}
+
+/*
+  divideConquer
+
+  Cuppen's divide and conquer on the tridiagonal (d, e) of order Q->n,
+  e with n entries. The subdiagonal entry in the middle is taken out
+  as a rank-1 term, the two halves are solved recursively and their
+  eigenpairs merged by mergeRankOne. Blocks of DC_LEAF_SIZE or fewer
+  go to tridiagonalQL.
+
+  @return 0, or i+1 when eigenvalue i of a leaf did not converge
+*/
+static int divideConquer(Matrix Q, double *d, double *e, Arena workspace)
+{
+        int n = Q->n;
+
+        if (n <= DC_LEAF_SIZE)
+        {
+                setMatrixValues(1, 'I', Q);
+                return tridiagonalQL(n, d, e, Q->values, Q->ld);
+        }
+
+        /* T = diag(T1, T2) + |rho| v vT */
+        int h = n/2;
+        double rho = e[h-1];
+        d[h-1] = d[h-1] - fabs(rho);
+        d[h] = d[h] - fabs(rho);
+
+        MatrixView _Q1, _Q2, _off;
+        setMatrixValues(0, 'V', viewMatrix(Q, 0, h, h, n-h, &_off));
+        setMatrixValues(0, 'V', viewMatrix(Q, h, 0, n-h, h, &_off));
+
+        int info = divideConquer(viewMatrix(Q, 0, 0, h, h, &_Q1), d, e, workspace);
+        if (info != 0)
+                return info;
+        info = divideConquer(viewMatrix(Q, h, h, n-h, n-h, &_Q2), d+h, e+h, workspace);
+        if (info != 0)
+                return h + info;
+
+        mergeRankOne(Q, d, h, rho, workspace);
+        return 0;
+}
+
+/*
+  Symmetric tridiagonal eigenvalues
+
+  eigenvalues of the symmetric tridiagonal T in ascending order, and
+  its eigenvectors when Q is given. With vectors the problem is split
+  by divide and conquer, whose merges are matrix multiplies; without,
+  implicit QL needs only O(n^2) operations.
+
+  @param n order of T
+  @param d n diagonal entries, overwritten by the eigenvalues
+  @param e n-1 subdiagonal entries, preserved
+  @param Q n x n eigenvectors, column j for d[j], or NULL
+  @param workspace arena for scratch, see tridiagonalEigenWorkspaceSize
+  @return 0, or i+1 when an eigenvalue did not converge
+*/
+int _tridiagonalEigen(int n, double *d, double *e, Matrix Q, Arena workspace)
+{
+        assert((Q == NULL) || ((Q->n == n) & (Q->m == n)));
+
+        if (n == 0)
+                return 0;
+
+        size_t mark = arenaMark(workspace);
+        double *_e = arenaAlloc(workspace, n*sizeof(double));
+        memcpy(_e, e, (n-1)*sizeof(double));
+        _e[n-1] = 0;
+
+        int info = Q != NULL ? divideConquer(Q, d, _e, workspace)
+                : tridiagonalQL(n, d, _e, NULL, 0);
+
+        if (info == 0)
+        {
+                int *order = arenaAlloc(workspace, n*sizeof(int));
+                sortOrder(n, d, order, workspace);
+
+                memcpy(_e, d, n*sizeof(double));
+                for (int j=0; j<n; j++)
+                        d[j] = _e[order[j]];
+
+                if (Q != NULL)
+                {
+                        Matrix S = arenaMatrix(workspace, n, n);
+                        gatherColumns(Q, order, S);
+                        copyMatrix(S, Q);
+                }
+        }
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _tridiagonalEigen for order n, with vectors */
+size_t tridiagonalEigenWorkspaceSize(int n)
+{
+        return arenaAllocSize(n*sizeof(double)) + arenaAllocSize(n*sizeof(int))
+                + mergeRankOneWorkspaceSize(n);
+}
+
+/*
+  Symmetric eigenvalue decomposition
+
+  A = Z Λ ZT for symmetric A, of which only the lower triangle is
+  read. A is reduced to tridiagonal form by tridiagonalReduction, the
+  tridiagonal problem is solved by _tridiagonalEigen and the requested
+  eigenvectors are carried back through the reflectors. Eigenvalues
+  are numbered in ascending order and il .. iu selects a range of
+  them, 0 .. n-1 for all. Only the selected vectors are transformed,
+  so a narrow range saves the back transformation.
+
+  @param A symmetric n x n matrix, destroyed
+  @param il index of the smallest eigenvalue wanted
+  @param iu index of the largest eigenvalue wanted
+  @param w iu-il+1 eigenvalues, ascending
+  @param Z n x (iu-il+1) orthonormal eigenvectors, or NULL
+  @param workspace arena for scratch, see symmetricEigenWorkspaceSize
+  @return 0, or i+1 when an eigenvalue did not converge
+*/
+int _symmetricEigen(Matrix A, int il, int iu, double *w, Matrix Z, Arena workspace)
+{
+        assert(A->n == A->m);
+        assert((0 <= il) & (il <= iu) & (iu < A->n));
+        assert((Z == NULL) || ((Z->n == A->n) & (Z->m == iu-il+1)));
+
+        int n = A->n;
+        size_t mark = arenaMark(workspace);
+        double *d = arenaAlloc(workspace, 3*n*sizeof(double));
+        double *e = d + n;
+        double *tau = e + n;
+        Matrix T = Z != NULL ? arenaMatrix(workspace, n, n) : NULL;
+
+        tridiagonalReduction(A, d, e, tau, workspace);
+        int info = _tridiagonalEigen(n, d, e, T, workspace);
+
+        if (info == 0)
+        {
+                memcpy(w, d + il, (iu-il+1)*sizeof(double));
+
+                if (Z != NULL)
+                {
+                        MatrixView _T, _V, _Z;
+                        copyMatrix(viewMatrix(T, 0, il, n, iu-il+1, &_T), Z);
+                        if (n > 2)
+                                applyHouseholderQ(viewMatrix(A, 1, 0, n-1, n-1, &_V), tau, n-2,
+                                                  viewMatrix(Z, 1, 0, n-1, Z->m, &_Z), 0, workspace);
+                }
+        }
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _symmetricEigen for an n x n input */
+size_t symmetricEigenWorkspaceSize(int n)
+{
+        size_t size = max(tridiagonalReductionWorkspaceSize(n), tridiagonalEigenWorkspaceSize(n));
+
+        return arenaAllocSize(3*n*sizeof(double)) + arenaMatrixSize(n, n)
+                + max(size, arenaAllocSize(n*sizeof(double)));
+}
+
+/*
+  Symmetric eigenvalue decomposition
+
+  allocates its own workspace, see _symmetricEigen
+
+  @param A symmetric n x n matrix, destroyed
+  @param il index of the smallest eigenvalue wanted
+  @param iu index of the largest eigenvalue wanted
+  @param w iu-il+1 eigenvalues, ascending
+  @param Z n x (iu-il+1) eigenvectors, or NULL
+  @return 0, or i+1 when an eigenvalue did not converge
+*/
+int symmetricEigen(Matrix A, int il, int iu, double *w, Matrix Z)
+{
+        Arena workspace = allocArena(symmetricEigenWorkspaceSize(A->n));
+
+        int info = _symmetricEigen(A, il, iu, w, Z, workspace);
+
+        freeArena(workspace);
+        return info;
+}
@@ -9,6 +9,7 @@
 #include <mem.h>
 #include <matrix.h>
 #include <factorization.h>
+#include <tsqr.h>
 
 /*
   Ordinary Least Squares
@@ -25,36 +26,79 @@
   Rt * Qt * Q * R * x = Rt * Qt * b
   Rt * R * x = Rt * Qt * b
   R * x = Qt * b
+
+  A is factored with TSQR: row blocks are factored with the compact
+  blocked Householder QR on separate threads and their R factors are
+  reduced pairwise, so R is tsqrR and Qt * b is applied through the
+  stored reflectors, Q is never formed. Inputs too short to split are
+  one block and factored on the calling thread.
+
+  scratch is drawn from arena and given back before returning,
+  see ordinaryLeastSquaresWorkspaceSize
  
   @param A matrix of observations
   @param x coefficients of approximation
   @param b vector of values to be approximated
+  @param arena workspace for scratch matrices
+  @return 0, or i+1 when R[i][i] is zero, A is rank deficient and x
+  is not unique
 */
-void ordinaryLeastSquares(Matrix A, Matrix x, Matrix b)
+int _ordinaryLeastSquares(Matrix A, Matrix x, Matrix b, Arena arena)
 {
 	assert(A->n == b->n);
 	assert(A->m == x->n);
+	assert(A->n >= A->m);
+
+	size_t mark = arenaMark(arena);
+	MatrixView _Qtb;
+
+	Matrix F = arenaMatrix(arena, A->n, A->m);
+	Matrix Qtb = arenaMatrix(arena, A->n, b->m);
+
+	copyMatrix(A, F);
+	copyMatrix(b, Qtb);
 
-	Matrix Qtb = allocMatrix(A->n, b->m);
+	TSQR T = _tsqr(F, 0, arena);
+	_tsqrApplyQ(T, Qtb, 1, arena);
+
+	int info = backSubstitution(tsqrR(T), x, viewMatrix(Qtb, 0, 0, A->m, b->m, &_Qtb));
+
+	arenaRelease(arena, mark);
+	return info;
+}
+
+/*
+  workspace bytes needed by _ordinaryLeastSquares for A n x m, b n x k,
+  the scratch of _tsqr is given back before QT b is applied on top of
+  the handle
+*/
+size_t ordinaryLeastSquaresWorkspaceSize(int n, int m, int k)
+{
+	size_t factor = tsqrWorkspaceSize(n, m, 0);
+	size_t apply = tsqrHandleSize(n, m, 0) + tsqrApplyQWorkspaceSize(n, m, k, 0);
 
-	Matrix QR[] = {
-		allocMatrix(A->n, A->n),
-		allocMatrix(A->n, A->m),
-	};
+	return arenaMatrixSize(n, m) + arenaMatrixSize(n, k) + (factor > apply ? factor : apply);
+}
 
-	gramSchmidtQR(A, QR, 0);
+/*
+  Ordinary Least Squares
 
-	multiplyMatrices(QR[0], 1, b, 0, Qtb, 0);
+  allocates its own arena, use _ordinaryLeastSquares with a long-lived
+  arena when solving repeatedly
 
-	drawMatrix(QR[1]);
-	drawMatrix(x);
-	drawMatrix(Qtb);
+  @param A matrix of observations
+  @param x coefficients of approximation
+  @param b vector of values to be approximated
+  @return 0, or i+1 when A is rank deficient, see _ordinaryLeastSquares
+*/
+int ordinaryLeastSquares(Matrix A, Matrix x, Matrix b)
+{
+	Arena arena = allocArena(ordinaryLeastSquaresWorkspaceSize(A->n, A->m, b->m));
 
-	backSubstitution(QR[1], x, Qtb);
+	int info = _ordinaryLeastSquares(A, x, b, arena);
 
-	freeMatrix(QR[0]);
-	freeMatrix(QR[1]);
-	freeMatrix(Qtb);
+	freeArena(arena);
+	return info;
 }
 
 /*
@@ -63,19 +107,55 @@ void ordinaryLeastSquares(Matrix A, Matrix x, Matrix b)
   Appends a column of ones to observations A
   and then executes ordinary least squares
 
+  The widened copy is drawn from arena
+
   @param A matrix of observations
   @param x coefficients of approximation
   @param b vector of values to be approximated
+  @param arena workspace for scratch matrices
+  @return 0, or i+1 when the widened A is rank deficient
 */
-void linearRegression(Matrix A, Matrix x, Matrix b)
+int _linearRegression(Matrix A, Matrix x, Matrix b, Arena arena)
 {
-	Matrix _A = allocMatrix(A->n, A->m+1);
-	copyMatrix(A, _A);
+	size_t mark = arenaMark(arena);
+	MatrixView _left;
+
+	Matrix _A = arenaMatrix(arena, A->n, A->m+1);
+	copyMatrix(A, viewMatrix(_A, 0, 0, A->n, A->m, &_left));
+
 	for (int i=0; i<_A->n; i++)
 	{
           mset(_A, i, _A->m-1, 1);
 	}
 
-	ordinaryLeastSquares(_A, x, b);
-	freeMatrix(_A);
+	int info = _ordinaryLeastSquares(_A, x, b, arena);
+
+	arenaRelease(arena, mark);
+	return info;
+}
+
+/* workspace bytes needed by _linearRegression for A n x m, b n x k */
+size_t linearRegressionWorkspaceSize(int n, int m, int k)
+{
+	return arenaMatrixSize(n, m+1) + ordinaryLeastSquaresWorkspaceSize(n, m+1, k);
+}
+
+/*
+  Linear Regression
+
+  allocates its own arena, see _linearRegression
+
+  @param A matrix of observations
+  @param x coefficients of approximation
+  @param b vector of values to be approximated
+  @return 0, or i+1 when the widened A is rank deficient
+*/
+int linearRegression(Matrix A, Matrix x, Matrix b)
+{
+	Arena arena = allocArena(linearRegressionWorkspaceSize(A->n, A->m, b->m));
+
+	int info = _linearRegression(A, x, b, arena);
+
+	freeArena(arena);
+	return info;
 }
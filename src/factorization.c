@@ -10,41 +10,146 @@
 #include <string.h>
 #include <mem.h>
 #include <matrix.h>
+#include <kernels.h>
+#include <pool.h>
+#include <factorization.h>
 
 #define min(a,b)                                \
         ({ __typeof__ (a) _a = (a);             \
                 __typeof__ (b) _b = (b);        \
                 _a < _b ? _a : _b; })
 
+#define max(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a > _b ? _a : _b; })
+
+/* diagonal entries this small relative to the largest are taken as zero */
 #define MAXIMUM_ZERO_DOUBLE 0.00000000000001
 
 /*
-  QR Gram Schmidt Process on a Square Matrix
+  columnSlices
+
+  number of pieces an update of m independent columns is cut into for
+  the thread pool, one per thread but none narrower than SLICE_COLUMNS.
+  Slice c covers columns m*c/slices up to m*(c+1)/slices.
+*/
+static int columnSlices(int m)
+{
+        return max(1, min(poolThreads(), m / SLICE_COLUMNS));
+}
+
+static Matrix columnSlice(Matrix A, int slices, int c, MatrixView *view)
+{
+        int first = (int)(((long)A->m * c) / slices);
+        int last = (int)(((long)A->m * (c+1)) / slices);
+
+        return viewMatrix(A, 0, first, A->n, last-first, view);
+}
+
+/*
+  thinQR
+
+  a QR output pair is either full, Q n x n and R n x m, or thin,
+  Q n x k and R k x m with k = min(n, m). Returns 1 for the thin shape.
+  For n <= m the two coincide and the pair counts as full.
+*/
+static int thinQR(Matrix A, Matrix QR[2])
+{
+        int k = min(A->n, A->m);
+
+        assert(A->n == QR[0]->n);
+        assert(A->m == QR[1]->m);
+        assert(QR[0]->m == QR[1]->n);
+        assert((QR[0]->m == A->n) | (QR[0]->m == k));
+
+        return QR[0]->m < A->n;
+}
+
+/*
+  splitR
+
+  the factorization of A sits in F, which is the output with A's
+  shape: copy its upper triangle into R and clear everything below
+  the diagonal of R
+*/
+static void splitR(Matrix F, Matrix R)
+{
+        for (int i=0; i<R->n; i++)
+        {
+                for (int j=0; j<R->m; j++)
+                {
+                        if (j < i)
+                                mset(R, i, j, 0);
+                        else if (F != R)
+                                mset(R, i, j, maccess(F, i, j));
+                }
+        }
+}
+
+/*
+  completeBasis
+
+  extend the orthonormal columns 0..k-1 of Q to a full basis with
+  standard basis vectors that keep enough length after projection,
+  lowering the bar if a sweep finds none
+*/
+static void completeBasis(Matrix Q, int k)
+{
+        int e = 0;
+        double threshold = 0.5;
+        for (int i=k; i<Q->m; i++)
+        {
+                do
+                {
+                        if (e == Q->n)
+                        {
+                                e = 0;
+                                threshold = threshold / 2;
+                        }
+
+                        for (int r=0; r<Q->n; r++)
+                                mset(Q, r, i, (r == e) ? 1 : 0);
+                        e++;
+
+                        for (int pass=0; pass<2; pass++)
+                                for (int j=0; j<i; j++)
+                                        project(Q, i, Q, j, -1.0, Q, i, 1.0);
+                } while (norm('C', Q, i) < threshold);
+
+                normalizeColumn(Q, i);
+        }
+}
+
+/*
+  QR Gram Schmidt Process
 
   Decomposes a matrix into an orthogonal Matrix, Q, and upper triangular
   matrix, R
   Less numerically stable than QR with householder reflections
 
+  Full (Q nxn, R nxm) and thin (Q nxk, R kxm, k = min(n,m)) outputs
+  are accepted. A full Q for a tall A is completed by orthogonalizing
+  standard basis vectors against the columns of A.
+
   @param A matrix to be decomposed
   @param QR array of matrices, [Q,R], to which results are written
   @param debug flag for printing matrices during iterations
 */
 void gramSchmidtQR(Matrix A, Matrix QR[2], int debug)
 {
-        printf("\n\n%d, %d", A->n, A->m);
-        printf("\n\n%d, %d", QR[0]->n, QR[0]->m);
-
-        assert(A->n == QR[0]->n);
-        assert(QR[0]->n == QR[0]->m);
-        assert(A->n == QR[1]->n);
-        assert(A->m == QR[1]->m);
+        thinQR(A, QR);
 
         Matrix Q = QR[0];
         Matrix R = QR[1];
-        copyMatrix(A, Q);
+        int k = min(A->n, A->m);
+
+        MatrixView _source, _target;
+        copyMatrix(viewMatrix(A, 0, 0, A->n, k, &_source),
+                   viewMatrix(Q, 0, 0, Q->n, k, &_target));
 
         /* get orthonormal basis */
-        for (int i=0; i<A->m; i++)
+        for (int i=0; i<k; i++)
         {
                 if (debug)
                 {
@@ -74,296 +179,1878 @@ void gramSchmidtQR(Matrix A, Matrix QR[2], int debug)
                 }
         }
 
+        completeBasis(Q, k);
+
         /* get R from orthogonal matrix Q transpose times A */
         multiplyMatrices(Q, 1, A, 0, R, 0);
 }
 
 /*
-  QR with Householder Reflections on an NxM Matrix
+  QR Gram Schmidt Process in place
 
-  Memory Allocation
-  -----------------
+  A = QR for A n x m with n >= m, A is overwritten by the thin Q.
+  Each column is orthogonalized against the finished ones in turn
+  (modified Gram Schmidt) and the coefficients are recorded in R as
+  they are found, so no copy of A is needed.
+
+  @param A matrix to be decomposed, overwritten by Q
+  @param R m x m upper triangular factor
+  @param debug flag for printing matrices during iterations
+*/
+void gramSchmidtQRInPlace(Matrix A, Matrix R, int debug)
+{
+        assert(A->n >= A->m);
+        assert((R->n == A->m) & (R->m == A->m));
+
+        setMatrixValues(0, 'V', R);
 
-  input three matrices A nxm, Q nxn, R nxm
-  four matrices for each step Qti
-  - identity, nxn
-  - outer product, nxn
-  - Q transpose, nxn
-  - Q chained transpose, nxn
-  two matrices size (n,1) for v and x
+        for (int i=0; i<A->m; i++)
+        {
+                for (int j=0; j<i; j++)
+                {
+                        double r = dotProduct('C', A, j, A, i);
+                        mset(R, j, i, r);
+                        vectorAxpy(A->n, -r, mptr(A, 0, j), A->ld, mptr(A, 0, i), A->ld);
+                }
+
+                double length = norm('C', A, i);
+                mset(R, i, i, length);
+                if (length != 0)
+                        scaleColumn(A, i, 1/length);
+
+                if (debug)
+                {
+                        printf("ITERATION %d\n", i);
+                        drawMatrix(A);
+                }
+        }
+}
+
+/*
+  blockGramSchmidt
+
+  orthonormalize the first k columns of Q in place with BCGS2, writing
+  their coefficients into the first k columns of R. Each block of nb
+  columns is projected out of the basis built so far twice,
+  W = QT X, X = X - Q W, as matrix products, then its own columns are
+  orthogonalized with classical Gram Schmidt, again run twice. Two
+  passes bring the loss of orthogonality down to the order of unit
+  roundoff, the level of Householder QR, while most of the work stays
+  in GEMM.
+
+  @param W scratch of at least k x min(nb, k)
+*/
+static void blockGramSchmidt(Matrix Q, Matrix R, int k, int nb, Matrix W, int debug)
+{
+        int n = Q->n;
+
+        for (int j=0; j<k; j+=nb)
+        {
+                int jb = min(nb, k-j);
+                MatrixView _X;
+                Matrix X = viewMatrix(Q, 0, j, n, jb, &_X);
+
+                /* project the block out of the basis so far, twice */
+                if (j > 0)
+                {
+                        MatrixView _Qj, _Rj, _Wj;
+                        Matrix Qj = viewMatrix(Q, 0, 0, n, j, &_Qj);
+                        Matrix Rj = viewMatrix(R, 0, j, j, jb, &_Rj);
+                        Matrix Wj = viewMatrix(W, 0, 0, j, jb, &_Wj);
+
+                        multiplyMatrices(Qj, 1, X, 0, Rj, 0);
+                        scaledMultiplyMatrices(Qj, 0, Rj, 0, -1.0, X, 1.0);
+
+                        multiplyMatrices(Qj, 1, X, 0, Wj, 0);
+                        scaledMultiplyMatrices(Qj, 0, Wj, 0, -1.0, X, 1.0);
+                        addMatrix(Rj, Wj);
+                }
+
+                /* orthogonalize within the block, twice per column */
+                for (int c=0; c<jb; c++)
+                {
+                        if (c > 0)
+                        {
+                                MatrixView _Qc, _x, _r, _w;
+                                Matrix Qc = viewMatrix(X, 0, 0, n, c, &_Qc);
+                                Matrix x = viewMatrix(X, 0, c, n, 1, &_x);
+                                Matrix r = viewMatrix(R, j, j+c, c, 1, &_r);
+                                Matrix w = viewMatrix(W, 0, 0, c, 1, &_w);
+
+                                multiplyMatrices(Qc, 1, x, 0, r, 0);
+                                scaledMultiplyMatrices(Qc, 0, r, 0, -1.0, x, 1.0);
+
+                                multiplyMatrices(Qc, 1, x, 0, w, 0);
+                                scaledMultiplyMatrices(Qc, 0, w, 0, -1.0, x, 1.0);
+                                addMatrix(r, w);
+                        }
+
+                        double length = norm('C', X, c);
+                        mset(R, j+c, j+c, length);
+                        if (length != 0)
+                                scaleColumn(X, c, 1/length);
+                }
+
+                if (debug)
+                {
+                        printf("BLOCK %d-%d\n", j, j+jb-1);
+                        drawMatrix(Q);
+                }
+        }
+}
+
+/*
+  Blocked Gram Schmidt with reorthogonalization (BCGS2)
+
+  Columns are orthogonalized nb at a time by blockGramSchmidt, R is
+  accumulated from the projection coefficients, it is not formed as
+  QT A afterwards.
+
+  Full and thin outputs as gramSchmidtQR.
 
   @param A matrix to be decomposed
   @param QR array of matrices, [Q,R], to which results are written
-  @param mem_stacks array of two memory stacks for recyling scratch matrices
+  @param nb block width, GS_BLOCK_SIZE when not positive
+  @param arena workspace, see blockGramSchmidtQRWorkspaceSize
   @param debug flag for printing matrices during iterations
+*/
+void _blockGramSchmidtQR(Matrix A, Matrix QR[2], int nb, Arena arena, int debug)
+{
+        if (nb <= 0)
+                nb = GS_BLOCK_SIZE;
+
+        thinQR(A, QR);
+
+        Matrix Q = QR[0];
+        Matrix R = QR[1];
+        int n = A->n;
+        int k = min(A->n, A->m);
+
+        size_t mark = arenaMark(arena);
+        Matrix W = arenaMatrix(arena, k, min(nb, k));
 
+        MatrixView _source, _target;
+        copyMatrix(viewMatrix(A, 0, 0, n, k, &_source),
+                   viewMatrix(Q, 0, 0, n, k, &_target));
+        setMatrixValues(0, 'V', R);
+
+        blockGramSchmidt(Q, R, k, nb, W, debug);
+
+        /* columns of a wide A past the square part only need projecting */
+        if (A->m > k)
+        {
+                MatrixView _Qk, _Ak, _Rk;
+                multiplyMatrices(viewMatrix(Q, 0, 0, n, k, &_Qk), 1,
+                                 viewMatrix(A, 0, k, n, A->m-k, &_Ak), 0,
+                                 viewMatrix(R, 0, k, k, A->m-k, &_Rk), 0);
+        }
+
+        completeBasis(Q, k);
+
+        arenaRelease(arena, mark);
+}
+
+/*
+  Blocked Gram Schmidt with reorthogonalization in place
+
+  A = QR for A n x m with n >= m, A is overwritten by the thin Q
+
+  @param A matrix to be decomposed, overwritten by Q
+  @param R m x m upper triangular factor
+  @param nb block width, GS_BLOCK_SIZE when not positive
+  @param arena workspace, see blockGramSchmidtQRWorkspaceSize
+  @param debug flag for printing matrices during iterations
 */
-void _hhReflectionsQR(Matrix A, Matrix QR[2],
-                      MatrixStack mem_stacks[2],
-                      int debug)
+void _blockGramSchmidtQRInPlace(Matrix A, Matrix R, int nb, Arena arena, int debug)
 {
+        if (nb <= 0)
+                nb = GS_BLOCK_SIZE;
 
-        assert(A->n == QR[0]->n);
-        assert(QR[0]->n == QR[0]->m);
-        assert(A->n == QR[1]->n);
-        assert(A->m == QR[1]->m);
+        assert(A->n >= A->m);
+        assert((R->n == A->m) & (R->m == A->m));
+
+        size_t mark = arenaMark(arena);
+        Matrix W = arenaMatrix(arena, A->m, min(nb, A->m));
+
+        setMatrixValues(0, 'V', R);
+        blockGramSchmidt(A, R, A->m, nb, W, debug);
 
-        Matrix Qn, Qt;
-        MatrixStack stackNxNd4 = mem_stacks[0];
-        MatrixStack stackNx1d2 = mem_stacks[1];
-        Matrix v  = popMatrixStack(stackNx1d2);
-        Matrix x  = popMatrixStack(stackNx1d2);
+        arenaRelease(arena, mark);
+}
+
+/* workspace bytes needed by _blockGramSchmidtQR for an n x m input */
+size_t blockGramSchmidtQRWorkspaceSize(int n, int m, int nb)
+{
+        if (nb <= 0)
+                nb = GS_BLOCK_SIZE;
 
-        Matrix Q = popMatrixStack(stackNxNd4);
-        setMatrixValues(1, 'I', Q);
+        int k = min(n, m);
+        return arenaMatrixSize(k, min(nb, k));
+}
 
-        Matrix I = popMatrixStack(stackNxNd4); /* make I type of Matrix with low mem usage */
-        setMatrixValues(1, 'I', I);
+/*
+  Blocked Gram Schmidt with reorthogonalization
 
-        copyMatrix(A, QR[1]);
+  allocates its own arena, see _blockGramSchmidtQR
 
-        /*
-          iterate through all columns if matrix is tall
-          iterate through all m-1 if matrix is wide or square
-        */
-        int iterations = min(A->n-1, A->m);
-        for (int i=0; i<iterations; i++)
+  @param A matrix to be decomposed
+  @param QR array of matrices, [Q,R], to which results are written
+  @param nb block width, GS_BLOCK_SIZE when not positive
+  @param debug flag for printing matrices during iterations
+*/
+void blockGramSchmidtQR(Matrix A, Matrix QR[2], int nb, int debug)
+{
+        Arena arena = allocArena(blockGramSchmidtQRWorkspaceSize(A->n, A->m, nb));
+
+        _blockGramSchmidtQR(A, QR, nb, arena, debug);
+
+        freeArena(arena);
+}
+
+/*
+  householderVector
+
+  generate the reflector H = I - tau v vT that maps column j of A,
+  from the diagonal down, onto beta e_1. beta overwrites A[j][j] and
+  v overwrites the column below it, v[0] = 1 is implicit.
+
+  @return tau, zero when the column is already reduced and H = I
+*/
+static double householderVector(Matrix A, int j)
+{
+        int len = A->n - j;
+        double *alpha = mptr(A, j, j);
+
+        if (len <= 1)
+                return 0;
+
+        double xnorm = sqrt(vectorDot(len-1, alpha + A->ld, A->ld, alpha + A->ld, A->ld));
+        if (xnorm == 0)
+                return 0;
+
+        /* opposite sign of alpha avoids cancellation in alpha - beta */
+        double beta = -copysign(hypot(*alpha, xnorm), *alpha);
+        double tau = (beta - *alpha) / beta;
+
+        vectorScale(len-1, 1 / (*alpha - beta), alpha + A->ld, A->ld);
+        *alpha = beta;
+
+        return tau;
+}
+
+/*
+  applyReflector
+
+  C <- (I - tau v vT) C as a rank-1 update, v is column j of V from
+  row j down with the implicit leading 1, C has one row per element
+  of v. Both passes walk rows of C, so all access is unit stride.
+
+  @param w scratch of C->m doubles
+*/
+static void applyReflector(Matrix V, int j, double tau, Matrix C, double *w)
+{
+        if ((tau == 0) | (C->m == 0))
+                return;
+
+        /* w <- CT v */
+        memcpy(w, mptr(C, 0, 0), C->m*sizeof(double));
+        for (int r=1; r<C->n; r++)
+                vectorAxpy(C->m, maccess(V, j+r, j), mptr(C, r, 0), 1, w, 1);
+
+        /* C <- C - tau v wT */
+        vectorAxpy(C->m, -tau, w, 1, mptr(C, 0, 0), 1);
+        for (int r=1; r<C->n; r++)
+                vectorAxpy(C->m, -tau * maccess(V, j+r, j), w, 1, mptr(C, r, 0), 1);
+}
+
+/*
+  Householder QR in compact form
+
+  Overwrites the NxM matrix A with R on and above the diagonal and the
+  Householder vectors below it, reflector j lives in column j with an
+  implicit 1 on the diagonal and tau[j] holds its scalar:
+
+  Q = H_0 H_1 ... H_(k-1), H_j = I - tau[j] v_j v_jT, k = min(n, m)
+
+  Each reflector is applied to the trailing columns as a rank-1 update,
+  O(nm) per step, and Q is never formed. Use applyHouseholderQ to
+  multiply by Q or QT and formHouseholderQ to build it explicitly.
+
+  @param A matrix to be decomposed, overwritten
+  @param tau array of min(n, m) reflector scalars
+  @param workspace arena for scratch, see householderQRWorkspaceSize
+*/
+void householderQR(Matrix A, double *tau, Arena workspace)
+{
+        size_t mark = arenaMark(workspace);
+        double *w = arenaAlloc(workspace, A->m*sizeof(double));
+        int k = min(A->n, A->m);
+
+        for (int j=0; j<k; j++)
         {
+                tau[j] = householderVector(A, j);
 
-                /* get householder vector */
-                for (int j=0; j<A->n; j++)
-                {
-                        if (j < i)
-                                mset(x, j, 0, 0);
-                        else
-                                mset(x, j, 0, maccess(QR[1], j, i));
-                }
-                setMatrixValues(0, 'V', v);
-                mset(v, i, 0, norm('C', x, 0));
+                MatrixView _trailing;
+                applyReflector(A, j, tau[j],
+                               viewMatrix(A, j, j+1, A->n-j, A->m-j-1, &_trailing), w);
+        }
+
+        arenaRelease(workspace, mark);
+}
+
+/* workspace bytes needed by householderQR for an n x m input */
+size_t householderQRWorkspaceSize(int n, int m)
+{
+        (void)n;
+        return arenaAllocSize(m*sizeof(double));
+}
+
+/*
+  applyHouseholderQ
+
+  B <- Q B or B <- QT B for Q stored in compact form by householderQR,
+  wide B is cut into column slices run on the thread pool
+
+  @param V output of householderQR, n x m
+  @param tau reflector scalars
+  @param k number of reflectors
+  @param B matrix with n rows, overwritten
+  @param transpose apply QT instead of Q
+  @param workspace arena for scratch, B->m doubles
+*/
+/* reflectors applied to one column slice of B */
+typedef struct {
+
+        Matrix V;
+        double *tau;
+        int k;
+        Matrix B;
+        int transpose;
+        int slices;
+        double *w;
+
+} ReflectorUpdate;
+
+static void applyReflectorsToSlice(void *_update, int c)
+{
+        ReflectorUpdate *update = _update;
+        MatrixView _slice, _rows;
+        Matrix slice = columnSlice(update->B, update->slices, c, &_slice);
+        /* the slice starts that many columns into B, and into w */
+        double *w = update->w + (slice->values - update->B->values);
+
+        if (update->transpose)
+        {
+                for (int j=0; j<update->k; j++)
+                        applyReflector(update->V, j, update->tau[j],
+                                       viewMatrix(slice, j, 0, slice->n-j, slice->m, &_rows), w);
+        }
+        else
+        {
+                for (int j=update->k-1; j>=0; j--)
+                        applyReflector(update->V, j, update->tau[j],
+                                       viewMatrix(slice, j, 0, slice->n-j, slice->m, &_rows), w);
+        }
+}
+
+void applyHouseholderQ(Matrix V, double *tau, int k, Matrix B, int transpose,
+                       Arena workspace)
+{
+        assert(V->n == B->n);
+        assert(k <= min(V->n, V->m));
+
+        size_t mark = arenaMark(workspace);
+
+        /* columns of B are independent, each slice sweeps all k reflectors */
+        ReflectorUpdate update = {
+                V, tau, k, B, transpose, columnSlices(B->m),
+                arenaAlloc(workspace, B->m*sizeof(double))
+        };
+        poolFor(update.slices, applyReflectorsToSlice, &update);
+
+        arenaRelease(workspace, mark);
+}
+
+/*
+  copyReflectors
+
+  bring the first k reflectors of V into the same columns of Q and
+  set the columns of Q past k to those of the identity, a no-op copy
+  when Q already holds the factorization
+*/
+static void copyReflectors(Matrix V, int k, Matrix Q)
+{
+        MatrixView _source, _target, _rest;
+
+        if (V->values != Q->values)
+                copyMatrix(viewMatrix(V, 0, 0, V->n, k, &_source),
+                           viewMatrix(Q, 0, 0, Q->n, k, &_target));
+
+        Matrix rest = viewMatrix(Q, 0, k, Q->n, Q->m-k, &_rest);
+        for (int i=0; i<rest->n; i++)
+        {
+                for (int j=0; j<rest->m; j++)
+                        mset(rest, i, j, (i == j+k) ? 1 : 0);
+        }
+}
+
+/*
+  generateQ
+
+  overwrite Q, holding k reflectors in its leading columns, with the
+  leading Q->m columns of H_0 ... H_(k-1). Reflectors are accumulated
+  backwards and column j is only rewritten once H_j has been applied
+  to everything right of it, so no second matrix is needed.
+
+  @param w scratch of Q->m doubles
+*/
+static void generateQ(Matrix Q, double *tau, int k, double *w)
+{
+        MatrixView _trailing;
+
+        for (int j=k-1; j>=0; j--)
+        {
+                applyReflector(Q, j, tau[j],
+                               viewMatrix(Q, j, j+1, Q->n-j, Q->m-j-1, &_trailing), w);
+
+                if (j+1 < Q->n)
+                        vectorScale(Q->n-j-1, -tau[j], mptr(Q, j+1, j), Q->ld);
+                mset(Q, j, j, 1 - tau[j]);
+                for (int i=0; i<j; i++)
+                        mset(Q, i, j, 0);
+        }
+}
+
+/*
+  formHouseholderQ
+
+  write the leading Q->m columns of Q = H_0 ... H_(k-1) to Q,
+  Q->m = n gives the full orthogonal matrix and Q->m = min(n, m) the
+  thin one. V and Q may be the same matrix, in which case Q is formed
+  in place over the reflectors.
+
+  @param V output of householderQR, n x m
+  @param tau reflector scalars
+  @param k number of reflectors, at most Q->m
+  @param Q n x q target
+  @param workspace arena for scratch, q doubles
+*/
+void formHouseholderQ(Matrix V, double *tau, int k, Matrix Q, Arena workspace)
+{
+        assert(V->n == Q->n);
+        assert(k <= Q->m);
+        assert(Q->m <= Q->n);
+
+        size_t mark = arenaMark(workspace);
+        double *w = arenaAlloc(workspace, Q->m*sizeof(double));
+
+        copyReflectors(V, k, Q);
+        generateQ(Q, tau, k, w);
+
+        arenaRelease(workspace, mark);
+}
+
+/*
+  applyReflectorRight
+
+  C <- C (I - tau v vT), v is column j of V from row j down with the
+  implicit leading 1, C has one column per element of v. v is copied
+  to w once so every row of C is a unit stride dot and axpy.
+
+  @param w scratch of C->m doubles
+*/
+static void applyReflectorRight(Matrix V, int j, double tau, Matrix C, double *w)
+{
+        if ((tau == 0) | (C->m == 0))
+                return;
+
+        w[0] = 1;
+        for (int r=1; r<C->m; r++)
+                w[r] = maccess(V, j+r, j);
+
+        for (int r=0; r<C->n; r++)
+        {
+                double *row = mptr(C, r, 0);
+                vectorAxpy(C->m, -tau * vectorDot(C->m, row, 1, w, 1), w, 1, row, 1);
+        }
+}
+
+/*
+  Hessenberg Reduction
+
+  A = Q H QT for square A, H upper Hessenberg (zero below the first
+  subdiagonal). Same compact form as householderQR, one row down:
+  H overwrites A on and above the subdiagonal and reflector j, which
+  acts on rows j+1 .. n-1, lives below the subdiagonal in column j
+  with an implicit 1 on the subdiagonal. Each reflector is applied
+  from the left to the trailing columns and from the right to all
+  rows, 10/3 n^3 flops in total.
+
+  @param A square matrix, overwritten by H and the reflectors
+  @param tau n-2 reflector scalars
+  @param workspace arena for scratch, see hessenbergReductionWorkspaceSize
+*/
+void hessenbergReduction(Matrix A, double *tau, Arena workspace)
+{
+        assert(A->n == A->m);
+
+        int n = A->n;
+        if (n <= 2)
+                return;
+
+        size_t mark = arenaMark(workspace);
+        double *w = arenaAlloc(workspace, n*sizeof(double));
+
+        /* one row down, reflector j starts on the diagonal of V */
+        MatrixView _V, _left, _right;
+        Matrix V = viewMatrix(A, 1, 0, n-1, n, &_V);
+
+        for (int j=0; j<n-2; j++)
+        {
+                tau[j] = householderVector(V, j);
+
+                applyReflector(V, j, tau[j],
+                               viewMatrix(A, j+1, j+1, n-j-1, n-j-1, &_left), w);
+                applyReflectorRight(V, j, tau[j],
+                                    viewMatrix(A, 0, j+1, n, n-j-1, &_right), w);
+        }
+
+        arenaRelease(workspace, mark);
+}
+
+/* workspace bytes needed by hessenbergReduction and formHessenbergQ */
+size_t hessenbergReductionWorkspaceSize(int n)
+{
+        return arenaAllocSize(n*sizeof(double));
+}
+
+/*
+  formHessenbergQ
+
+  write the n x n orthogonal Q of hessenbergReduction to Q, its first
+  row and column are those of the identity
+
+  @param V output of hessenbergReduction
+  @param tau its reflector scalars
+  @param Q n x n target, distinct from V
+  @param workspace arena for scratch, see hessenbergReductionWorkspaceSize
+*/
+void formHessenbergQ(Matrix V, double *tau, Matrix Q, Arena workspace)
+{
+        assert(V->n == V->m);
+        assert((Q->n == V->n) & (Q->m == V->n));
+
+        int n = V->n;
+
+        setMatrixValues(0, 'V', Q);
+        for (int i=0; i<min(n, 2); i++)
+                mset(Q, i, i, 1);
+
+        if (n <= 2)
+                return;
+
+        MatrixView _V, _Q;
+        formHouseholderQ(viewMatrix(V, 1, 0, n-1, n-1, &_V), tau, n-2,
+                         viewMatrix(Q, 1, 1, n-1, n-1, &_Q), workspace);
+}
+
+/*
+  Tridiagonal Reduction
+
+  A = Q T QT for symmetric A, T symmetric tridiagonal. Only the lower
+  triangle of A is read and updated. The reflectors are stored as in
+  hessenbergReduction, below the subdiagonal with tau[j] for reflector
+  j, so formHessenbergQ and applyHouseholderQ on the rows past the
+  first work on the output unchanged. Symmetry turns the two-sided
+  update into p = tau A v, w = p - (tau/2)(pT v) v and the rank-2
+  update A <- A - v wT - w vT on the lower triangle, 4/3 n^3 flops.
+
+  @param A symmetric n x n matrix, lower triangle overwritten
+  @param d n diagonal entries of T
+  @param e n-1 subdiagonal entries of T
+  @param tau n-2 reflector scalars
+  @param workspace arena for scratch, see tridiagonalReductionWorkspaceSize
+*/
+void tridiagonalReduction(Matrix A, double *d, double *e, double *tau, Arena workspace)
+{
+        assert(A->n == A->m);
+
+        int n = A->n;
+        size_t mark = arenaMark(workspace);
+        double *v = arenaAlloc(workspace, 2*n*sizeof(double));
+        double *w = v + n;
+
+        MatrixView _V;
+        Matrix V = viewMatrix(A, 1, 0, max(n-1, 0), n, &_V);
+
+        for (int j=0; j<n-2; j++)
+        {
+                tau[j] = householderVector(V, j);
+                d[j] = maccess(A, j, j);
+                e[j] = maccess(A, j+1, j);
+
+                if (tau[j] == 0)
+                        continue;
+
+                /* trailing block S = A[j+1:, j+1:], v with its leading 1 */
+                int len = n-j-1;
+                v[0] = 1;
+                for (int r=1; r<len; r++)
+                        v[r] = maccess(V, j+r, j);
+
+                /* w <- tau S v from the lower triangle, one row of it at a time */
+                memset(w, 0, len*sizeof(double));
+                for (int r=0; r<len; r++)
+                {
+                        double *row = mptr(A, j+1+r, j+1);
+                        w[r] += vectorDot(r+1, row, 1, v, 1);
+                        vectorAxpy(r, v[r], row, 1, w, 1);
+                }
+                vectorScale(len, tau[j], w, 1);
+                vectorAxpy(len, -tau[j] / 2 * vectorDot(len, w, 1, v, 1), v, 1, w, 1);
+
+                for (int r=0; r<len; r++)
+                {
+                        double *row = mptr(A, j+1+r, j+1);
+                        vectorAxpy(r+1, -v[r], w, 1, row, 1);
+                        vectorAxpy(r+1, -w[r], v, 1, row, 1);
+                }
+        }
+
+        if (n >= 2)
+        {
+                d[n-2] = maccess(A, n-2, n-2);
+                e[n-2] = maccess(A, n-1, n-2);
+        }
+        if (n >= 1)
+                d[n-1] = maccess(A, n-1, n-1);
+
+        arenaRelease(workspace, mark);
+}
+
+/* workspace bytes needed by tridiagonalReduction */
+size_t tridiagonalReductionWorkspaceSize(int n)
+{
+        return arenaAllocSize(2*n*sizeof(double));
+}
+
+/*
+  blockReflector
+
+  compact WY form of the jb reflectors stored in panel P, the leading
+  jb columns of a block of householderQR output:
+
+  H_0 H_1 ... H_(jb-1) = I - V T VT
+
+  V is written explicitly (unit diagonal, zeros above) so the products
+  with it are plain GEMM calls. T is jb x jb upper triangular, built
+  from S = VT V as T[0:i, i] = -tau_i T[0:i, 0:i] S[0:i, i].
+*/
+static void blockReflector(Matrix P, double *tau, Matrix V, Matrix T, Matrix S)
+{
+        int jb = P->m;
+
+        for (int r=0; r<P->n; r++)
+        {
+                for (int c=0; c<jb; c++)
+                {
+                        if (r < c)
+                                mset(V, r, c, 0);
+                        else if (r == c)
+                                mset(V, r, c, 1);
+                        else
+                                mset(V, r, c, maccess(P, r, c));
+                }
+        }
+
+        multiplyMatrices(V, 1, V, 0, S, 0);
+
+        setMatrixValues(0, 'V', T);
+        for (int i=0; i<jb; i++)
+        {
+                mset(T, i, i, tau[i]);
+                for (int r=0; r<i; r++)
+                {
+                        double value = 0;
+                        for (int c=r; c<i; c++)
+                                value = value + (maccess(T, r, c) * maccess(S, c, i));
+                        mset(T, r, i, -tau[i] * value);
+                }
+        }
+}
+
+/*
+  applyBlockReflector
+
+  C <- (I - V T VT) C, or with TT when transpose is set, as
+  W = VT C, W = T W (in place, T is triangular), C = C - V W
+
+  @param W scratch with T->n rows and C->m columns
+*/
+static void applyBlockReflector(Matrix V, Matrix T, Matrix C, int transpose, Matrix W)
+{
+        int jb = T->n;
+
+        multiplyMatrices(V, 1, C, 0, W, 0);
+
+        if (transpose)
+        {
+                /* row i of TT W only needs rows 0..i, sweep upwards */
+                for (int i=jb-1; i>=0; i--)
+                {
+                        scaleRow(W, i, maccess(T, i, i));
+                        for (int c=0; c<i; c++)
+                                addRowScalarMultiple(W, i, maccess(T, c, i), W, c);
+                }
+        }
+        else
+        {
+                /* row i of T W only needs rows i..jb-1, sweep downwards */
+                for (int i=0; i<jb; i++)
+                {
+                        scaleRow(W, i, maccess(T, i, i));
+                        for (int c=i+1; c<jb; c++)
+                                addRowScalarMultiple(W, i, maccess(T, i, c), W, c);
+                }
+        }
+
+        scaledMultiplyMatrices(V, 0, W, 0, -1.0, C, 1.0);
+}
+
+/*
+  Blocked Householder QR in compact form
+
+  Same output as householderQR: R on and above the diagonal,
+  reflectors below it and their scalars in tau. Panels of nb columns
+  are factored with the unblocked kernel, their reflectors are
+  aggregated into I - V T VT and applied to the trailing columns with
+  three matrix products, so all but O(n nb^2) of the flops run in GEMM.
+
+  @param A matrix to be decomposed, overwritten
+  @param tau array of min(n, m) reflector scalars
+  @param nb panel width, HH_BLOCK_SIZE when not positive
+  @param workspace arena for scratch, see householderQRBlockedWorkspaceSize
+*/
+void householderQRBlocked(Matrix A, double *tau, int nb, Arena workspace)
+{
+        if (nb <= 0)
+                nb = HH_BLOCK_SIZE;
+
+        size_t mark = arenaMark(workspace);
+        int k = min(A->n, A->m);
+        nb = min(nb, k);
+
+        Matrix V = arenaMatrix(workspace, A->n, nb);
+        Matrix T = arenaMatrix(workspace, nb, nb);
+        Matrix S = arenaMatrix(workspace, nb, nb);
+        Matrix W = arenaMatrix(workspace, nb, A->m);
+
+        for (int j=0; j<k; j+=nb)
+        {
+                int jb = min(nb, k-j);
+                int rows = A->n - j;
+                int trailing = A->m - j - jb;
+                MatrixView _panel, _V, _T, _S, _W, _C;
+
+                Matrix panel = viewMatrix(A, j, j, rows, jb, &_panel);
+                householderQR(panel, tau+j, workspace);
+
+                if (trailing == 0)
+                        continue;
+
+                Matrix _T_ = viewMatrix(T, 0, 0, jb, jb, &_T);
+                Matrix _V_ = viewMatrix(V, 0, 0, rows, jb, &_V);
+                blockReflector(panel, tau+j, _V_, _T_, viewMatrix(S, 0, 0, jb, jb, &_S));
+
+                applyBlockReflector(_V_, _T_, viewMatrix(A, j, j+jb, rows, trailing, &_C), 1,
+                                    viewMatrix(W, 0, 0, jb, trailing, &_W));
+        }
+
+        arenaRelease(workspace, mark);
+}
+
+/* workspace bytes needed by householderQRBlocked */
+size_t householderQRBlockedWorkspaceSize(int n, int m, int nb)
+{
+        if (nb <= 0)
+                nb = HH_BLOCK_SIZE;
+        nb = min(nb, min(n, m));
+
+        return arenaMatrixSize(n, nb) + (2 * arenaMatrixSize(nb, nb))
+                + arenaMatrixSize(nb, m) + householderQRWorkspaceSize(n, nb);
+}
+
+/*
+  formHouseholderQBlocked
+
+  formHouseholderQ with the reflectors applied a panel at a time as
+  I - V T VT, walking the panels backwards. Each panel first updates
+  the columns right of it and is then turned into columns of Q in
+  place, so V and Q may be the same matrix.
+
+  @param V output of householderQR or householderQRBlocked, n x m
+  @param tau reflector scalars
+  @param k number of reflectors, at most Q->m
+  @param Q n x q target
+  @param nb panel width, HH_BLOCK_SIZE when not positive
+  @param workspace arena for scratch, see formHouseholderQBlockedWorkspaceSize
+*/
+void formHouseholderQBlocked(Matrix V, double *tau, int k, Matrix Q, int nb,
+                             Arena workspace)
+{
+        assert(V->n == Q->n);
+        assert(k <= Q->m);
+        assert(Q->m <= Q->n);
+
+        if (nb <= 0)
+                nb = HH_BLOCK_SIZE;
+        nb = min(nb, k);
+
+        copyReflectors(V, k, Q);
+        if (k == 0)
+                return;
+
+        size_t mark = arenaMark(workspace);
+        Matrix _V = arenaMatrix(workspace, Q->n, nb);
+        Matrix T = arenaMatrix(workspace, nb, nb);
+        Matrix S = arenaMatrix(workspace, nb, nb);
+        Matrix W = arenaMatrix(workspace, nb, Q->m);
+
+        for (int j=((k-1)/nb)*nb; j>=0; j-=nb)
+        {
+                int jb = min(nb, k-j);
+                int rows = Q->n - j;
+                int trailing = Q->m - j - jb;
+                MatrixView _panel, _Vv, _T, _S, _W, _C, _above;
+
+                Matrix panel = viewMatrix(Q, j, j, rows, jb, &_panel);
+
+                if (trailing > 0)
+                {
+                        Matrix _T_ = viewMatrix(T, 0, 0, jb, jb, &_T);
+                        Matrix _V_ = viewMatrix(_V, 0, 0, rows, jb, &_Vv);
+                        blockReflector(panel, tau+j, _V_, _T_, viewMatrix(S, 0, 0, jb, jb, &_S));
+
+                        applyBlockReflector(_V_, _T_,
+                                            viewMatrix(Q, j, j+jb, rows, trailing, &_C), 0,
+                                            viewMatrix(W, 0, 0, jb, trailing, &_W));
+                }
+
+                generateQ(panel, tau+j, jb, mptr(W, 0, 0));
+                setMatrixValues(0, 'V', viewMatrix(Q, 0, j, j, jb, &_above));
+        }
+
+        arenaRelease(workspace, mark);
+}
+
+/* workspace bytes needed by formHouseholderQBlocked for n x q Q and k reflectors */
+size_t formHouseholderQBlockedWorkspaceSize(int n, int q, int k, int nb)
+{
+        if (nb <= 0)
+                nb = HH_BLOCK_SIZE;
+        nb = min(nb, k);
+        if (nb == 0)
+                return 0;
+
+        return arenaMatrixSize(n, nb) + (2 * arenaMatrixSize(nb, nb))
+                + arenaMatrixSize(nb, q);
+}
+
+/*
+  QR with Householder Reflections on an NxM Matrix
+
+  Memory Allocation
+  -----------------
+
+  full: Q nxn, R nxm
+  thin: Q nxk, R kxm, k = min(n,m), for tall A this is Q nxm and R mxm
+
+  the compact factorization is computed in whichever output has the
+  shape of A (R when full, Q when thin) and Q is then formed in place,
+  so the only scratch is tau, min(n,m) doubles, and one row of doubles
+
+  all scratch is drawn from arena and given back before returning,
+  see hhReflectionsQRWorkspaceSize
+
+  @param A matrix to be decomposed
+  @param QR array of matrices, [Q,R], to which results are written,
+  full or thin
+  @param arena workspace for scratch matrices
+  @param debug flag for printing matrices during iterations
+
+*/
+void _hhReflectionsQR(Matrix A, Matrix QR[2], Arena arena, int debug)
+{
+        int thin = thinQR(A, QR);
+        size_t mark = arenaMark(arena);
+
+        Matrix F = thin ? QR[0] : QR[1];
+        int k = min(A->n, A->m);
+        double *tau = arenaAlloc(arena, k*sizeof(double));
+
+        copyMatrix(A, F);
+        householderQR(F, tau, arena);
+
+        if (debug)
+        {
+                printf("R and householder vectors=\n");
+                drawMatrix(F);
+                for (int j=0; j<k; j++)
+                        printf("tau%d=%.10f\n", j, tau[j]);
+        }
+
+        if (thin)
+        {
+                splitR(F, QR[1]);
+                formHouseholderQ(F, tau, k, QR[0], arena);
+        }
+        else
+        {
+                formHouseholderQ(F, tau, k, QR[0], arena);
+                splitR(F, QR[1]);
+        }
+
+        arenaRelease(arena, mark);
+}
+
+/* workspace bytes needed by _hhReflectionsQR for an n x m input, full or thin */
+size_t hhReflectionsQRWorkspaceSize(int n, int m)
+{
+        size_t tau = arenaAllocSize(min(n, m)*sizeof(double));
+        size_t factor = householderQRWorkspaceSize(n, m);
+        size_t form = arenaAllocSize(n*sizeof(double));
+
+        return tau + (factor > form ? factor : form);
+}
+
+/*
+  QR with Householder Reflections on a Symmetric Matrix
+
+  Allocates and frees its own arena. When calling QR iteratively, use
+  _hhReflectionsQR with an arena that outlives the loop.
+  
+  @param A matrix to be decomposed
+  @param QR array of matrices, [Q,R], to which results are written
+  @param debug flag for printing matrices during iterations
+
+*/
+void hhReflectionsQR(Matrix A, Matrix QR[2], int debug)
+{
+        Arena arena = allocArena(hhReflectionsQRWorkspaceSize(A->n, A->m));
+
+        _hhReflectionsQR(A, QR, arena, debug);
+
+        freeArena(arena);
+}
+
+/*
+  Blocked QR with Householder Reflections on an NxM Matrix
+
+  Same inputs and outputs as _hhReflectionsQR, full or thin, factored
+  and accumulated in panels of nb columns with the compact WY form so
+  the bulk of the work runs in the matrix multiply kernel
+
+  @param A matrix to be decomposed
+  @param QR array of matrices, [Q,R], to which results are written
+  @param nb panel width, HH_BLOCK_SIZE when not positive
+  @param arena workspace, see hhReflectionsQRBlockedWorkspaceSize
+  @param debug flag for printing matrices during iterations
+*/
+void _hhReflectionsQRBlocked(Matrix A, Matrix QR[2], int nb, Arena arena, int debug)
+{
+        int thin = thinQR(A, QR);
+        size_t mark = arenaMark(arena);
+
+        Matrix F = thin ? QR[0] : QR[1];
+        int k = min(A->n, A->m);
+        double *tau = arenaAlloc(arena, k*sizeof(double));
+
+        copyMatrix(A, F);
+        householderQRBlocked(F, tau, nb, arena);
+
+        if (debug)
+        {
+                printf("R and householder vectors=\n");
+                drawMatrix(F);
+                for (int j=0; j<k; j++)
+                        printf("tau%d=%.10f\n", j, tau[j]);
+        }
+
+        if (thin)
+        {
+                splitR(F, QR[1]);
+                formHouseholderQBlocked(F, tau, k, QR[0], nb, arena);
+        }
+        else
+        {
+                formHouseholderQBlocked(F, tau, k, QR[0], nb, arena);
+                splitR(F, QR[1]);
+        }
+
+        arenaRelease(arena, mark);
+}
+
+/*
+  workspace bytes needed by _hhReflectionsQRBlocked for an n x m input,
+  sized for the full Q which also covers the thin one
+*/
+size_t hhReflectionsQRBlockedWorkspaceSize(int n, int m, int nb)
+{
+        int k = min(n, m);
+        size_t tau = arenaAllocSize(k*sizeof(double));
+        size_t factor = householderQRBlockedWorkspaceSize(n, m, nb);
+        size_t form = formHouseholderQBlockedWorkspaceSize(n, n, k, nb);
+
+        return tau + (factor > form ? factor : form);
+}
+
+/*
+  Blocked QR with Householder Reflections
+
+  allocates its own arena, see _hhReflectionsQRBlocked
+
+  @param A matrix to be decomposed
+  @param QR array of matrices, [Q,R], to which results are written
+  @param nb panel width, HH_BLOCK_SIZE when not positive
+  @param debug flag for printing matrices during iterations
+*/
+void hhReflectionsQRBlocked(Matrix A, Matrix QR[2], int nb, int debug)
+{
+        Arena arena = allocArena(hhReflectionsQRBlockedWorkspaceSize(A->n, A->m, nb));
+
+        _hhReflectionsQRBlocked(A, QR, nb, arena, debug);
+
+        freeArena(arena);
+}
+
+/*
+  LU Decomposition
+
+  Reduce A to row echelon form (eliminate lower triangle)
+
+  @param A left side matrix to be reduced
+  @param LU array of matrices to write lower and upper matrices to
+  @param debug flag for printing matrices during iterations
+
+*/
+void LUDecomposition(Matrix A, Matrix LU[2], int debug)
+{
+        assert(A->n == A->m);
+
+        Matrix _L = LU[0];
+        setMatrixValues(1, 'I', _L);
+
+        Matrix _U = LU[1];
+        copyMatrix(A, _U);
+
+
+        double scalar, neg_scalar;
+        int iterations = min(A->n-1, A->m);
+
+        /* eliminate lower triangle */
+        for (int i=0; i<iterations; i++)
+        {
+                if (debug)
+                {
+                        printf("ITERATION %d BEGIN\n", i);
+                }
+
+                for (int j=i+1; j<A->n; j++)
+                {
+                        scalar = maccess(_U, j, i) / maccess(_U, i, i);
+                        neg_scalar = scalar * -1;
+                        if (maccess(_U, j, i) != 0)
+                        {
+                                addRowScalarMultiple(_U, j, neg_scalar, _U, i);
+                                mset(_L, j, i, scalar);
+                        }
+                }
+
+                if (debug)
+                {
+                        printf("_U=\n");
+                        drawMatrix(_U);
+                        printf("_L=\n");
+                        drawMatrix(_L);
+                        printf("ITERATION %d END\n", i);
+                }
+        }
+}
+
+/*
+  LU Decomposition with Pivoting
+
+  PA = LU
+
+  Reduce A to row echelon form (eliminate lower triangle)
+  Pivoting for improved precision
+
+  Works entirely in the output matrices, the workspace is accepted so
+  every factorization can be driven the same way from a preallocated
+  arena, see PLUDecompositionWorkspaceSize
+
+  @param A left side matrix to be reduced
+  @param PLU array of matrices to write pivot, lower and upper matrices to
+  @param workspace arena for scratch memory, never used and may be NULL
+  @param debug flag for printing matrices during iterations
+
+*/
+void _PLUDecomposition(Matrix A, Matrix PLU[3], Arena workspace, int debug)
+{
+        (void)workspace;
+
+        assert(A->n == A->m);
+
+        Matrix _P = PLU[0];
+        setMatrixValues(1, 'I', _P);
+
+        Matrix _L = PLU[1];
+        setMatrixValues(1, 'I', _L);
+        Matrix _U = PLU[2];
+        copyMatrix(A, _U);
+
+        double max_pivot_value, scalar, neg_scalar;
+        int max_pivot_index;
+        int iterations = min(A->n-1, A->m);
+
+        /* eliminate lower triangle */
+        for (int i=0; i<iterations; i++)
+        {
+                if (debug)
+                {
+                        printf("ITERATION %d BEGIN\n", i);
+                }
+
+                /* pivoting */
+                max_pivot_value = fabs(maccess(_U, i, i));
+                max_pivot_index = i;
+                for (int j=i+1; j<_U->n; j++)
+                {
+                        if (fabs(maccess(_U, j, i)) > max_pivot_value)
+                        {
+                                max_pivot_value = fabs(maccess(_U, j, i));
+                                max_pivot_index = j;
+                        }
+                }
+
+                if (max_pivot_index != i)
+                {
+                        switchRow(_U, i, max_pivot_index);
+                        switchRow(_P, i, max_pivot_index);
+
+                        for (int j=0; j<i; j++)
+                        {
+                                max_pivot_value = maccess(_L, max_pivot_index, j);
+                                mset(_L, max_pivot_index, j, maccess(_L, i, j));
+                                mset(_L, i, j, max_pivot_value);
+                        }
+
+                }
+
+                if (debug)
+                {
+                        printf("row %d (%.5f) -> row %d\n", max_pivot_index, max_pivot_value, i);
+                        drawMatrix(_U);
+                }
+
+                for (int j=i+1; j<A->n; j++)
+                {
+
+                        scalar = maccess(_U, j, i) / maccess(_U, i, i);
+                        neg_scalar = scalar * -1;
+                        if (maccess(_U, j, i) != 0)
+                        {
+                                addRowScalarMultiple(_U, j, neg_scalar, _U, i);
+                                mset(_L, j, i, scalar);
+                        }
+                }
+
+                if (debug)
+                {
+                        printf("_U=\n");
+                        drawMatrix(_U);
+                        printf("_L=\n");
+                        drawMatrix(_L);
+                        printf("ITERATION %d END\n", i);
+                }
+        }
+}
+
+/* workspace bytes needed by _PLUDecomposition for an n x m input */
+size_t PLUDecompositionWorkspaceSize(int n, int m)
+{
+        (void)n;
+        (void)m;
+        return 0;
+}
+
+/*
+  LU Decomposition with Pivoting
+
+  _PLUDecomposition without a workspace, it needs none
+
+  @param A left side matrix to be reduced
+  @param PLU array of matrices to write pivot, lower and upper matrices to
+  @param debug flag for printing matrices during iterations
+*/
+void PLUDecomposition(Matrix A, Matrix PLU[3], int debug)
+{
+        _PLUDecomposition(A, PLU, NULL, debug);
+}
+
+/*
+  permuteRows
+
+  apply the row interchanges ipiv[k1..k2-1] to A in order,
+  row i is swapped with row ipiv[i]
+*/
+static void permuteRows(Matrix A, int k1, int k2, const int *ipiv)
+{
+        for (int i=k1; i<k2; i++)
+        {
+                if (ipiv[i] != i)
+                        switchRow(A, i, ipiv[i]);
+        }
+}
+
+/*
+  applyPivots
+
+  B <- P B for the pivots of PLUDecompositionInPlace, or B <- PT B
+  when inverse is set, swapping rows in place
+
+  @param B matrix with at least as many rows as the largest pivot
+  @param ipiv pivots, row i is interchanged with row ipiv[i]
+  @param k number of pivots
+  @param inverse undo the interchanges, last to first
+*/
+void applyPivots(Matrix B, const int *ipiv, int k, int inverse)
+{
+        if (!inverse)
+        {
+                permuteRows(B, 0, k, ipiv);
+                return;
+        }
+
+        for (int i=k-1; i>=0; i--)
+        {
+                if (ipiv[i] != i)
+                        switchRow(B, i, ipiv[i]);
+        }
+}
+
+/*
+  pivotPermutation
+
+  convert the interchanges ipiv into a permutation vector,
+  row i of PA is row perm[i] of A
+
+  @param ipiv pivots from PLUDecompositionInPlace
+  @param k number of pivots
+  @param perm n entries written
+  @param n rows of A
+*/
+void pivotPermutation(const int *ipiv, int k, int *perm, int n)
+{
+        for (int i=0; i<n; i++)
+                perm[i] = i;
+
+        for (int i=0; i<k; i++)
+        {
+                int swap = perm[i];
+                perm[i] = perm[ipiv[i]];
+                perm[ipiv[i]] = swap;
+        }
+}
+
+/*
+  solveUnitLowerRows
+
+  B <- L^-1 B for L unit lower triangular, sweeping down the rows of
+  B so every update is a unit stride axpy
+*/
+static void solveUnitLowerRows(Matrix L, Matrix B)
+{
+        for (int i=1; i<B->n; i++)
+        {
+                for (int r=0; r<i; r++)
+                {
+                        double l = maccess(L, i, r);
+                        if (l != 0)
+                                addRowScalarMultiple(B, i, -l, B, r);
+                }
+        }
+}
+
+/*
+  luPanel
+
+  factor a tall n x w panel with partial pivoting, recursively: the
+  left half is factored, its interchanges and L are applied to the
+  right half with a triangular solve and a GEMM, then the lower right
+  block is factored the same way. Narrow panels fall back to rank-1
+  updates, which only touch the few columns of the panel and so stay
+  in cache. Interchanges only move rows within the panel.
+
+  @param P panel, overwritten with L below and U on the diagonal
+  @param ipiv w row indices relative to the panel
+*/
+static void luPanel(Matrix P, int *ipiv)
+{
+        int n = P->n;
+        int w = min(P->n, P->m);
+
+        if (w <= LU_PANEL_BASE)
+        {
+                for (int c=0; c<w; c++)
+                {
+                        int p = c;
+                        double pivot = fabs(maccess(P, c, c));
+                        for (int r=c+1; r<n; r++)
+                        {
+                                if (fabs(maccess(P, r, c)) > pivot)
+                                {
+                                        pivot = fabs(maccess(P, r, c));
+                                        p = r;
+                                }
+                        }
+
+                        ipiv[c] = p;
+                        if (p != c)
+                                switchRow(P, c, p);
+
+                        /* a zero column is left as is, U is singular */
+                        if (maccess(P, c, c) == 0)
+                                continue;
+
+                        double inverse = 1 / maccess(P, c, c);
+                        for (int r=c+1; r<n; r++)
+                        {
+                                double l = maccess(P, r, c) * inverse;
+                                mset(P, r, c, l);
+                                if (l != 0)
+                                        vectorAxpy(P->m-c-1, -l, mptr(P, c, c+1), 1,
+                                                   mptr(P, r, c+1), 1);
+                        }
+                }
+                return;
+        }
+
+        int w1 = w / 2;
+        MatrixView _left, _right, _L11, _A12, _L21, _A22;
+        Matrix left = viewMatrix(P, 0, 0, n, w1, &_left);
+        Matrix right = viewMatrix(P, 0, w1, n, P->m-w1, &_right);
+
+        luPanel(left, ipiv);
+        permuteRows(right, 0, w1, ipiv);
+
+        Matrix L11 = viewMatrix(P, 0, 0, w1, w1, &_L11);
+        Matrix A12 = viewMatrix(P, 0, w1, w1, P->m-w1, &_A12);
+        Matrix L21 = viewMatrix(P, w1, 0, n-w1, w1, &_L21);
+        Matrix A22 = viewMatrix(P, w1, w1, n-w1, P->m-w1, &_A22);
+
+        solveUnitLowerRows(L11, A12);
+        scaledMultiplyMatrices(L21, 0, A12, 0, -1.0, A22, 1.0);
+
+        luPanel(A22, ipiv+w1);
+        permuteRows(L21, 0, w-w1, ipiv+w1);
+        for (int i=w1; i<w; i++)
+                ipiv[i] += w1;
+}
+
+/* the columns right of an LU panel, updated one slice per task */
+typedef struct {
+
+        Matrix A;
+        const int *ipiv;
+        int j; /* first column of the panel */
+        int jb; /* panel width */
+        Matrix after; /* all rows of A, columns j+jb onwards */
+        int slices;
+
+} TrailingUpdate;
+
+/*
+  trailingUpdate
+
+  interchanges, U12 = L11^-1 A12 and A22 = A22 - L21 U12 for slice c
+  of the columns after the panel, each column only depends on itself
+  and the panel
+*/
+static void trailingUpdate(void *_update, int c)
+{
+        TrailingUpdate *update = _update;
+        int j = update->j;
+        int jb = update->jb;
+        int n = update->A->n;
+        MatrixView _slice, _L11, _A12, _L21, _A22;
+
+        Matrix slice = columnSlice(update->after, update->slices, c, &_slice);
+        permuteRows(slice, j, j+jb, update->ipiv);
+
+        Matrix L11 = viewMatrix(update->A, j, j, jb, jb, &_L11);
+        Matrix A12 = viewMatrix(slice, j, 0, jb, slice->m, &_A12);
+        Matrix L21 = viewMatrix(update->A, j+jb, j, n-j-jb, jb, &_L21);
+        Matrix A22 = viewMatrix(slice, j+jb, 0, n-j-jb, slice->m, &_A22);
+
+        solveUnitLowerRows(L11, A12);
+        scaledMultiplyMatrices(L21, 0, A12, 0, -1.0, A22, 1.0);
+}
+
+/*
+  LU Decomposition with Pivoting in place
+
+  right-looking blocked LU with partial pivoting, PA = LU with L unit
+  lower (diagonal implicit) below the diagonal of A and U on and above
+  it, P is returned as the integer pivots ipiv. Each panel of nb columns is factored by luPanel,
+  its interchanges are applied across the rest of A, the block row of
+  U is found with a triangular solve and the trailing matrix is
+  updated with one GEMM, which carries all but O(n^2 nb) of the flops.
+  The columns after the panel are cut into slices that are updated
+  on the thread pool.
+
+  @param A n x m matrix, overwritten by L\U
+  @param ipiv min(n, m) pivots, row i was interchanged with row ipiv[i]
+  @param nb panel width, LU_BLOCK_SIZE when not positive
+*/
+void PLUDecompositionInPlace(Matrix A, int *ipiv, int nb)
+{
+        if (nb <= 0)
+                nb = LU_BLOCK_SIZE;
+
+        int n = A->n;
+        int m = A->m;
+        int k = min(n, m);
+
+        for (int j=0; j<k; j+=nb)
+        {
+                int jb = min(nb, k-j);
+                MatrixView _panel, _before, _after;
+
+                luPanel(viewMatrix(A, j, j, n-j, jb, &_panel), ipiv+j);
+                for (int i=j; i<j+jb; i++)
+                        ipiv[i] += j;
+
+                permuteRows(viewMatrix(A, 0, 0, n, j, &_before), j, j+jb, ipiv);
+
+                if (j+jb < m)
+                {
+                        TrailingUpdate update;
+                        update.A = A;
+                        update.ipiv = ipiv;
+                        update.j = j;
+                        update.jb = jb;
+                        update.after = viewMatrix(A, 0, j+jb, n, m-j-jb, &_after);
+                        update.slices = columnSlices(m-j-jb);
+
+                        poolFor(update.slices, trailingUpdate, &update);
+                }
+        }
+}
+
+/*
+  Blocked LU Decomposition with Pivoting
+
+  PA = LU
+
+  Same outputs as PLUDecomposition, computed in place in U with
+  the pivots held as integers in the arena until P is written out
+
+  @param A left side matrix to be reduced
+  @param PLU array of matrices to write pivot, lower and upper matrices to
+  @param nb panel width, LU_BLOCK_SIZE when not positive
+  @param workspace arena for scratch, see PLUDecompositionBlockedWorkspaceSize
+  @param debug flag for printing matrices after the factorization
+*/
+void _PLUDecompositionBlocked(Matrix A, Matrix PLU[3], int nb, Arena workspace,
+                              int debug)
+{
+        assert(A->n == A->m);
+
+        Matrix _P = PLU[0];
+        Matrix _L = PLU[1];
+        Matrix _U = PLU[2];
+        int n = A->n;
+
+        size_t mark = arenaMark(workspace);
+        int *ipiv = arenaAlloc(workspace, n*sizeof(int));
+
+        copyMatrix(A, _U);
+        PLUDecompositionInPlace(_U, ipiv, nb);
+
+        setMatrixValues(1, 'I', _P);
+        permuteRows(_P, 0, n, ipiv);
+
+        for (int i=0; i<n; i++)
+        {
+                for (int j=0; j<n; j++)
+                {
+                        if (j < i)
+                        {
+                                mset(_L, i, j, maccess(_U, i, j));
+                                mset(_U, i, j, 0);
+                        }
+                        else
+                        {
+                                mset(_L, i, j, (i == j) ? 1 : 0);
+                        }
+                }
+        }
+
+        if (debug)
+        {
+                for (int i=0; i<n; i++)
+                        printf("ipiv%d=%d\n", i, ipiv[i]);
+                printf("_U=\n");
+                drawMatrix(_U);
+                printf("_L=\n");
+                drawMatrix(_L);
+        }
+
+        arenaRelease(workspace, mark);
+}
+
+/* workspace bytes needed by _PLUDecompositionBlocked for an n x n input */
+size_t PLUDecompositionBlockedWorkspaceSize(int n)
+{
+        return arenaAllocSize(n*sizeof(int));
+}
+
+/*
+  Blocked LU Decomposition with Pivoting
+
+  allocates its own workspace, see _PLUDecompositionBlocked
+
+  @param A left side matrix to be reduced
+  @param PLU array of matrices to write pivot, lower and upper matrices to
+  @param nb panel width, LU_BLOCK_SIZE when not positive
+  @param debug flag for printing matrices after the factorization
+*/
+void PLUDecompositionBlocked(Matrix A, Matrix PLU[3], int nb, int debug)
+{
+        Arena workspace = allocArena(PLUDecompositionBlockedWorkspaceSize(A->n));
+
+        _PLUDecompositionBlocked(A, PLU, nb, workspace, debug);
+
+        freeArena(workspace);
+}
+
+/*
+  choleskyRows
+
+  finish rows j..j+jb-1 of a lower Cholesky factor whose columns
+  before j are final: each entry takes a dot product with an earlier
+  row of L over their common prefix, so the block is updated and
+  factored in one pass and only ever reads and writes the lower
+  triangle
+
+  @return 0, or i+1 when the leading minor of order i+1 is not
+  positive definite
+*/
+static int choleskyRows(Matrix A, int j, int jb)
+{
+        for (int i=j; i<j+jb; i++)
+        {
+                double *row = mptr(A, i, 0);
+
+                for (int c=j; c<i; c++)
+                {
+                        double *_row = mptr(A, c, 0);
+                        row[c] = (row[c] - vectorDot(c, row, 1, _row, 1)) / _row[c];
+                }
+
+                double diagonal = row[i] - vectorDot(i, row, 1, row, 1);
+                if (diagonal <= 0)
+                        return i+1;
+
+                row[i] = sqrt(diagonal);
+        }
+
+        return 0;
+}
+
+/*
+  Cholesky Decomposition in place
+
+  A = L LT for symmetric positive definite A. L overwrites the lower
+  triangle of A, the strict upper triangle is never read or written,
+  so only one triangle of A has to be filled in.
+
+  Blocked by nb columns: the diagonal block is finished by choleskyRows,
+  the block column below it is updated with one GEMM against the
+  finished columns and then solved against the diagonal block with
+  unit stride dot products along its rows.
+
+  @param A symmetric positive definite matrix, lower triangle overwritten by L
+  @param nb block width, CHOL_BLOCK_SIZE when not positive
+  @return 0, or i+1 when the leading minor of order i+1 is not
+  positive definite, A is then only partly factored
+*/
+int choleskyDecompositionInPlace(Matrix A, int nb)
+{
+        assert(A->n == A->m);
 
-                if (debug)
-                {
-                        printf("norm=%.10f\n", maccess(v, i, 0));
-                        printf("aii=%.10f\n", maccess(v, i, 0));
-                }
+        if (nb <= 0)
+                nb = CHOL_BLOCK_SIZE;
 
-                /* reverse sign for better precision */
-                if (maccess(x, i, 0) > 0)
-                        mset(v, i, 0, maccess(v, i, 0) * -1);
+        int n = A->n;
 
-                subtractColumn(x, 0, v, 0);
+        for (int j=0; j<n; j+=nb)
+        {
+                int jb = min(nb, n-j);
 
-                if (debug)
-                {
-                        printf("ITERATION %d\n", i);
-                        printf("householder vector=\n");
-                        drawMatrix(x);
-                }
+                int info = choleskyRows(A, j, jb);
+                if (info != 0)
+                        return info;
 
-                Qn = popMatrixStack(stackNxNd4);
-                outerMatrix(x, 0, Qn);
-                double dot_product_hh = dotProductV(x,x);
-                if (dot_product_hh != 0)
-                        scaleMatrix(Qn, -2 / dot_product_hh);
-                addMatrix(Qn, I);
-                if (debug)
-                {
-                        printf("I - ((2/vTv)vvT)=\n");
-                        drawMatrix(Qn);
-                }
+                if (j+jb == n)
+                        break;
 
-                Qt = popMatrixStack(stackNxNd4);
-                simpleMultiplyMatrices(Qn, Q, Qt);
-                pushMatrixStack(stackNxNd4, Q);
-                pushMatrixStack(stackNxNd4, Qn);
-                Q = Qt;
+                MatrixView _A20, _A10, _A21;
+                Matrix A21 = viewMatrix(A, j+jb, j, n-j-jb, jb, &_A21);
 
-                if (debug)
-                {
-                        printf("Q%d(Q..)=\n", i);
-                        drawMatrix(Q);
+                if (j > 0)
+                        scaledMultiplyMatrices(viewMatrix(A, j+jb, 0, n-j-jb, j, &_A20), 0,
+                                               viewMatrix(A, j, 0, jb, j, &_A10), 1,
+                                               -1.0, A21, 1.0);
 
-                        simpleMultiplyMatrices(Q, A, QR[1]);
-                        printf("R=\n");
-                        drawMatrix(QR[1]);
-                        printf("ITERATION %d END\n", i);
+                /* A21 <- A21 L11^-T, row by row */
+                for (int r=0; r<A21->n; r++)
+                {
+                        double *row = mptr(A21, r, 0);
+                        for (int c=0; c<jb; c++)
+                        {
+                                double *_row = mptr(A, j+c, j);
+                                row[c] = (row[c] - vectorDot(c, row, 1, _row, 1)) / _row[c];
+                        }
                 }
-
         }
 
-        simpleMultiplyMatrices(Q, A, QR[1]);
-        transposeMatrix(Q, QR[0]);
+        return 0;
 }
 
 /*
-  QR with Householder Reflections on a Symmetric Matrix
+  Cholesky Solve
 
-  Allocates and frees memory stacks. It's better to use this version
-  if you're not iteratively calling QR.
-  
-  @param A matrix to be decomposed
-  @param QR array of matrices, [Q,R], to which results are written
-  @param debug flag for printing matrices during iterations
+  B <- A^-1 B with A = L LT from choleskyDecompositionInPlace, as
+  L Y = B and LT X = Y. Only the lower triangle of L is read.
 
+  @param L factored matrix
+  @param B right-hand sides, one per column, overwritten by the solutions
+  @return 0, or i+1 when L[i][i] is zero
 */
-void hhReflectionsQR(Matrix A, Matrix QR[2], int debug)
+int choleskySolve(Matrix L, Matrix B)
 {
-        MatrixStack mem_stacks[] = {
-                allocMatrixStack(A->n, A->n, 4),
-                allocMatrixStack(A->n, 1, 2)
-        };
+        int info = triangularSolve(L, B, 0, 0, 0);
+        if (info != 0)
+                return info;
 
-        _hhReflectionsQR(A, QR, mem_stacks, debug);
-
-        /* pointer dereference error */
-        /* freeMatrixStackAll(mem_stacks[0]); */
-        freeMatrixStackAll(mem_stacks[1]);
+        return triangularSolve(L, B, 0, 1, 0);
 }
 
 /*
-  LU Decomposition
-
-  Reduce A to row echelon form (eliminate lower triangle)
-
-  @param A left side matrix to be reduced
-  @param LU array of matrices to write lower and upper matrices to
-  @param debug flag for printing matrices during iterations
+  upperMultiply
 
+  X <- T X in place for T upper triangular, its strict lower triangle
+  is ignored. Blocks of rows are finished top down: the diagonal block
+  with row axpys, which only read rows below the one being written,
+  then the rest of T's block row with one GEMM against rows of X that
+  are still unchanged.
 */
-void LUDecomposition(Matrix A, Matrix LU[2], int debug)
+static void upperMultiply(Matrix T, Matrix X, int nb)
 {
-        assert(A->n == A->m);
+        int n = T->n;
 
-        Matrix _L = LU[0];
-        setMatrixValues(1, 'I', _L);
+        for (int i=0; i<n; i+=nb)
+        {
+                int ib = min(nb, n-i);
 
-        Matrix _U = LU[1];
-        copyMatrix(A, _U);
+                for (int r=i; r<i+ib; r++)
+                {
+                        scaleRow(X, r, maccess(T, r, r));
+                        for (int c=r+1; c<i+ib; c++)
+                                addRowScalarMultiple(X, r, maccess(T, r, c), X, c);
+                }
 
+                if (i+ib < n)
+                {
+                        MatrixView _T12, _X2, _X1;
+                        scaledMultiplyMatrices(viewMatrix(T, i, i+ib, ib, n-i-ib, &_T12), 0,
+                                               viewMatrix(X, i+ib, 0, n-i-ib, X->m, &_X2), 0,
+                                               1.0, viewMatrix(X, i, 0, ib, X->m, &_X1), 1.0);
+                }
+        }
+}
 
-        double scalar, neg_scalar;
-        int iterations = min(A->n-1, A->m);
+/*
+  invertUpper
 
-        /* eliminate lower triangle */
-        for (int i=0; i<iterations; i++)
+  U <- U^-1 in place for the upper triangle of A, the strict lower
+  triangle is left alone. Block column j is
+  -inv(U00) U01 inv(U11), formed with upperMultiply and a solve along
+  rows, before its diagonal block is inverted column by column.
+*/
+static void invertUpper(Matrix A, int nb)
+{
+        int n = A->n;
+
+        for (int j=0; j<n; j+=nb)
         {
-                if (debug)
-                {
-                        printf("ITERATION %d BEGIN\n", i);
-                }
+                int jb = min(nb, n-j);
+                MatrixView _U00, _X, _D;
+                Matrix D = viewMatrix(A, j, j, jb, jb, &_D);
 
-                for (int j=i+1; j<A->n; j++)
+                if (j > 0)
                 {
-                        scalar = maccess(_U, j, i) / maccess(_U, i, i);
-                        neg_scalar = scalar * -1;
-                        if (maccess(_U, j, i) != 0)
+                        Matrix X = viewMatrix(A, 0, j, j, jb, &_X);
+                        upperMultiply(viewMatrix(A, 0, 0, j, j, &_U00), X, nb);
+
+                        /* X <- -X U11^-1, row by row */
+                        for (int r=0; r<j; r++)
                         {
-                                addRowScalarMultiple(_U, j, neg_scalar, _U, i);
-                                mset(_L, j, i, scalar);
+                                double *x = mptr(X, r, 0);
+                                for (int c=0; c<jb; c++)
+                                {
+                                        x[c] = x[c] / maccess(D, c, c);
+                                        vectorAxpy(jb-c-1, -x[c], mptr(D, c, c+1), 1, x+c+1, 1);
+                                }
+                                vectorScale(jb, -1.0, x, 1);
                         }
                 }
 
-                if (debug)
+                /* invert the diagonal block, column c from the columns before it */
+                for (int c=0; c<jb; c++)
                 {
-                        printf("_U=\n");
-                        drawMatrix(_U);
-                        printf("_L=\n");
-                        drawMatrix(_L);
-                        printf("ITERATION %d END\n", i);
+                        double diagonal = 1 / maccess(D, c, c);
+                        mset(D, c, c, diagonal);
+
+                        for (int i=0; i<c; i++)
+                                mset(D, i, c, vectorDot(c-i, mptr(D, i, i), 1, mptr(D, i, c), D->ld));
+
+                        vectorScale(c, -diagonal, mptr(D, 0, c), D->ld);
                 }
         }
 }
 
 /*
-  LU Decomposition with Pivoting
-
-  PA = LU
-
-  Reduce A to row echelon form (eliminate lower triangle)
-  Pivoting for improved precision
-
-  @param A left side matrix to be reduced
-  @param PLU array of matrices to write pivot, lower and upper matrices to
-  @param debug flag for printing matrices during iterations
-
+  Matrix Inverse
+
+  A <- A^-1 in place, GETRI style: A is factored into L\U by
+  PLUDecompositionInPlace, U is inverted in place, then A^-1 L = U^-1
+  is solved for A^-1 a block column at a time from the right, the
+  columns of L in play being moved to the workspace. Each block is one
+  GEMM against the finished columns plus a small unit triangular
+  solve along rows. Finally the pivots are undone on the columns.
+
+  No second n x n matrix is needed: besides A the workspace holds n
+  pivots and an n x LU_BLOCK_SIZE panel.
+
+  @param A square matrix, overwritten by its inverse
+  @param workspace arena for scratch, see inverseMatrixWorkspaceSize
+  @return 0, or i+1 when U[i][i] is zero relative to the largest pivot
+  and A is singular, A then holds its LU factorization
 */
-void PLUDecomposition(Matrix A, Matrix PLU[3], int debug)
+int _inverseMatrix(Matrix A, Arena workspace)
 {
         assert(A->n == A->m);
 
-        Matrix _P = PLU[0];
-        setMatrixValues(1, 'I', _P);
+        int n = A->n;
+        int nb = min(LU_BLOCK_SIZE, n);
 
-        Matrix _L = PLU[1];
-        setMatrixValues(1, 'I', _L);
-        Matrix _U = PLU[2];
-        copyMatrix(A, _U);
+        size_t mark = arenaMark(workspace);
+        int *ipiv = arenaAlloc(workspace, n*sizeof(int));
+        Matrix W = arenaMatrix(workspace, n, nb);
 
-        double max_pivot_value, scalar, neg_scalar;
-        int max_pivot_index;
-        int iterations = min(A->n-1, A->m);
+        PLUDecompositionInPlace(A, ipiv, nb);
 
-        /* eliminate lower triangle */
-        for (int i=0; i<iterations; i++)
+        int info = zeroPivot(A);
+        if (info != 0)
         {
-                if (debug)
-                {
-                        printf("ITERATION %d BEGIN\n", i);
-                }
+                arenaRelease(workspace, mark);
+                return info;
+        }
 
-                /* pivoting */
-                max_pivot_value = maccess(_U, i, i);
-                max_pivot_index = i;
-                for (int j=i+1; j<_U->n; j++)
-                {
-                        if (fabs(maccess(_U, j, i)) > max_pivot_value)
-                        {
-                                max_pivot_value = fabs(maccess(_U, j, i));
-                                max_pivot_index = j;
-                        }
-                }
+        invertUpper(A, nb);
 
-                if (max_pivot_index != i)
-                {
-                        switchRow(_U, i, max_pivot_index);
-                        switchRow(_P, i, max_pivot_index);
+        for (int j=((n-1)/nb)*nb; j>=0; j-=nb)
+        {
+                int jb = min(nb, n-j);
+                MatrixView _X, _A2, _W2, _Lb;
+                Matrix X = viewMatrix(A, 0, j, n, jb, &_X);
 
-                        for (int j=0; j<i; j++)
+                /* move the block columns of L out, leaving U^-1 above them */
+                for (int i=j; i<n; i++)
+                {
+                        for (int c=0; c<jb; c++)
                         {
-                                max_pivot_value = maccess(_L, max_pivot_index, j);
-                                mset(_L, max_pivot_index, j, maccess(_L, i, j));
-                                mset(_L, i, j, max_pivot_value);
+                                if (i > j+c)
+                                {
+                                        mset(W, i, c, maccess(A, i, j+c));
+                                        mset(A, i, j+c, 0);
+                                }
+                                else
+                                {
+                                        mset(W, i, c, 0);
+                                }
                         }
-
                 }
 
-                if (debug)
+                if (j+jb < n)
+                        scaledMultiplyMatrices(viewMatrix(A, 0, j+jb, n, n-j-jb, &_A2), 0,
+                                               viewMatrix(W, j+jb, 0, n-j-jb, jb, &_W2), 0,
+                                               -1.0, X, 1.0);
+
+                /* X <- X Lb^-1 with Lb unit lower, row by row from the right */
+                Matrix Lb = viewMatrix(W, j, 0, jb, jb, &_Lb);
+                for (int r=0; r<n; r++)
                 {
-                        printf("row %d (%.5f) -> row %d\n", max_pivot_index, max_pivot_value, i);
-                        drawMatrix(_U);
+                        double *x = mptr(X, r, 0);
+                        for (int c=jb-1; c>0; c--)
+                                vectorAxpy(c, -x[c], mptr(Lb, c, 0), 1, x, 1);
                 }
+        }
 
-                for (int j=i+1; j<A->n; j++)
+        /* A^-1 = U^-1 L^-1 P, undo the interchanges on the columns */
+        for (int j=n-2; j>=0; j--)
+        {
+                if (ipiv[j] != j)
                 {
-
-                        scalar = maccess(_U, j, i) / maccess(_U, i, i);
-                        neg_scalar = scalar * -1;
-                        if (maccess(_U, j, i) != 0)
+                        for (int i=0; i<n; i++)
                         {
-                                addRowScalarMultiple(_U, j, neg_scalar, _U, i);
-                                mset(_L, j, i, scalar);
+                                double *row = mptr(A, i, 0);
+                                double swap = row[j];
+                                row[j] = row[ipiv[j]];
+                                row[ipiv[j]] = swap;
                         }
                 }
-
-                if (debug)
-                {
-                        printf("_U=\n");
-                        drawMatrix(_U);
-                        printf("_L=\n");
-                        drawMatrix(_L);
-                        printf("ITERATION %d END\n", i);
-                }
         }
+
+        arenaRelease(workspace, mark);
+        return 0;
+}
+
+/* workspace bytes needed by _inverseMatrix for an n x n input */
+size_t inverseMatrixWorkspaceSize(int n)
+{
+        return arenaAllocSize(n*sizeof(int)) + arenaMatrixSize(n, min(LU_BLOCK_SIZE, n));
+}
+
+/*
+  Matrix Inverse
+
+  allocates its own workspace, see _inverseMatrix
+
+  @param A square matrix, overwritten by its inverse
+  @return 0, or i+1 when A is singular
+*/
+int inverseMatrix(Matrix A)
+{
+        Arena workspace = allocArena(inverseMatrixWorkspaceSize(A->n));
+
+        int info = _inverseMatrix(A, workspace);
+
+        freeArena(workspace);
+        return info;
 }
 
 /*
@@ -379,13 +2066,29 @@ void PLUDecomposition(Matrix A, Matrix PLU[3], int debug)
 
 */
 void gaussianElimination(Matrix A, Matrix B, Matrix REF[2], int debug)
+{
+        copyMatrix(A, REF[0]);
+        copyMatrix(B, REF[1]);
+
+        gaussianEliminationInPlace(REF[0], REF[1], debug);
+}
+
+/*
+  Gaussian Elimination in place
+
+  as gaussianElimination, A and B are overwritten by their row
+  echelon forms
+
+  @param A left side matrix to be reduced, overwritten
+  @param B right side matrix or column vector, overwritten
+  @param debug flag for printing matrices during iterations
+*/
+void gaussianEliminationInPlace(Matrix A, Matrix B, int debug)
 {
         assert(A->n == B->n);
 
-        Matrix _A = REF[0];
-        copyMatrix(A, _A);
-        Matrix _B = REF[1];
-        copyMatrix(B, _B);
+        Matrix _A = A;
+        Matrix _B = B;
 
         double max_pivot_value, scalar;
         int max_pivot_index;
@@ -400,7 +2103,7 @@ void gaussianElimination(Matrix A, Matrix B, Matrix REF[2], int debug)
                 }
 
                 // pivot
-                max_pivot_value = maccess(_A, i, i);
+                max_pivot_value = fabs(maccess(_A, i, i));
                 max_pivot_index = i;
                 for (int j=i+1; j<_A->n; j++)
                 {
@@ -411,7 +2114,7 @@ void gaussianElimination(Matrix A, Matrix B, Matrix REF[2], int debug)
                         }
                 }
 
-                if (max_pivot_index != 0)
+                if (max_pivot_index != i)
                 {
                         switchRow(_A, i, max_pivot_index);
                         switchRow(_B, i, max_pivot_index);
@@ -450,14 +2153,20 @@ void gaussianElimination(Matrix A, Matrix B, Matrix REF[2], int debug)
   Given A and B, generate the reduced row echelon form (RREF)
   Pivoting for improved precision
 
+  Eliminates in the output matrices, the workspace is accepted for a
+  uniform interface, see gaussJordanEliminationWorkspaceSize
+
   @param A left side matrix to be reduced
   @param B left side of block
   @param RREF array of matrices to write reduced row form of A and B, [A^,B^]
+  @param workspace arena for scratch memory, never used and may be NULL
   @param debug flag for printing matrices during iterations
 
 */
-void gaussJordanElimination(Matrix A, Matrix B, Matrix RREF[2], int debug)
+void _gaussJordanElimination(Matrix A, Matrix B, Matrix RREF[2], Arena workspace,
+                             int debug)
 {
+        (void)workspace;
 
         gaussianElimination(A, B, RREF, debug);
 
@@ -493,40 +2202,242 @@ void gaussJordanElimination(Matrix A, Matrix B, Matrix RREF[2], int debug)
 
 }
 
+/* workspace bytes needed by _gaussJordanElimination, A n x n and B n x m */
+size_t gaussJordanEliminationWorkspaceSize(int n, int m)
+{
+        (void)n;
+        (void)m;
+        return 0;
+}
+
 /*
-  Back Substitution
+  Gauss Jordan Elimination
+
+  _gaussJordanElimination without a workspace, it needs none
 
-  solves Ax = b for x where A and b are given
+  @param A left side matrix to be reduced
+  @param B left side of block
+  @param RREF array of matrices to write reduced row form of A and B, [A^,B^]
+  @param debug flag for printing matrices during iterations
+*/
+void gaussJordanElimination(Matrix A, Matrix B, Matrix RREF[2], int debug)
+{
+        _gaussJordanElimination(A, B, RREF, NULL, debug);
+}
 
-  @param A an upper triangular matrix
-  @param b a column vector of values
-  @param solution a column vector, x of Ax=b
+/*
+  triangularSolveUnblocked
+
+  B <- op(T)^-1 B on a diagonal block, see triangularSolve. T is only
+  read by rows: without transpose each row of B takes off the rows
+  already solved, with it each solved row is pushed into the rows
+  still to go. A single right-hand side is done with dots and axpys
+  down the column of B, several with unit stride axpys along rows of B.
 */
-void backSubstitution(Matrix A, Matrix solution, Matrix b)
+static void triangularSolveUnblocked(Matrix T, Matrix B, int upper, int transpose,
+                                     int unit)
 {
-        assert(1 == solution->m);
-        assert(1 == b->m);
-        assert(A->n == b->n);
-        assert(A->m == solution->n);
+        int n = B->n;
+        int forward = upper == transpose;
+
+        for (int _i=0; _i<n; _i++)
+        {
+                int i = forward ? _i : n-1-_i;
+                int start, end;
+
+                if (!transpose)
+                {
+                        start = forward ? 0 : i+1;
+                        end = forward ? i : n;
 
-        double value, diagonal;
-        for (int i=A->m-1; i>=0; i--)
+                        if (B->m == 1)
+                                *mptr(B, i, 0) -= vectorDot(end-start, mptr(T, i, start), 1,
+                                                            mptr(B, start, 0), B->ld);
+                        else
+                                for (int r=start; r<end; r++)
+                                        addRowScalarMultiple(B, i, -maccess(T, i, r), B, r);
+                }
+
+                if (!unit)
+                        scaleRow(B, i, 1/maccess(T, i, i));
+
+                if (transpose)
+                {
+                        start = forward ? i+1 : 0;
+                        end = forward ? n : i;
+
+                        if (B->m == 1)
+                                vectorAxpy(end-start, -maccess(B, i, 0), mptr(T, i, start), 1,
+                                           mptr(B, start, 0), B->ld);
+                        else
+                                for (int r=start; r<end; r++)
+                                        addRowScalarMultiple(B, r, -maccess(T, i, r), B, i);
+                }
+        }
+}
+
+/*
+  Triangular Solve
+
+  B <- op(T)^-1 B for every column of B, op(T) = T or TT, with T the
+  upper or lower triangle of a square matrix; the other triangle is
+  never read, so packed factors such as L\U can be passed directly.
+
+  Rows of B are solved in blocks of TRSM_BLOCK_SIZE. Each block first
+  takes off its coupling to all the blocks already solved with one
+  GEMM, then the small diagonal block is solved directly, so all but
+  O(n nb k) of the n^2 k flops are matrix multiplies. A single column
+  is solved directly throughout.
+
+  @param T triangular matrix, n x n
+  @param B n x k right-hand sides, overwritten by the solutions
+  @param upper use the upper triangle of T, else the lower
+  @param transpose solve with TT
+  @param unit take the diagonal of T as ones without reading it
+  @return 0, or i+1 when T[i][i] is zero, B is untouched in that case
+*/
+int triangularSolve(Matrix T, Matrix B, int upper, int transpose, int unit)
+{
+        int n = T->n;
+
+        assert(T->n == T->m);
+        assert(B->n == n);
+
+        if (!unit)
         {
-                value = maccess(b, i, 0);
-                for (int j=i+1; j<A->m; j++)
+                for (int i=0; i<n; i++)
                 {
-                        value = value - ( maccess(A, i, j) * maccess(solution, j, 0));
+                        if (maccess(T, i, i) == 0)
+                                return i+1;
                 }
+        }
+
+        /* a single column gains nothing from GEMM, dots and axpys are faster */
+        if (B->m == 1)
+        {
+                triangularSolveUnblocked(T, B, upper, transpose, unit);
+                return 0;
+        }
+
+        /* with op(T) lower the rows are solved top down, else bottom up */
+        int forward = upper == transpose;
+        int blocks = (n + TRSM_BLOCK_SIZE - 1) / TRSM_BLOCK_SIZE;
+
+        for (int _b=0; _b<blocks; _b++)
+        {
+                int b = forward ? _b : blocks-1-_b;
+                int i = b*TRSM_BLOCK_SIZE;
+                int ib = min(TRSM_BLOCK_SIZE, n-i);
+
+                /* solved rows are [0, i) going down, [i+ib, n) going up */
+                int start = forward ? 0 : i+ib;
+                int done = forward ? i : n-i-ib;
 
-                diagonal = maccess(A, i, i);
-                if ((fabs(diagonal) < MAXIMUM_ZERO_DOUBLE) & (fabs(value) > MAXIMUM_ZERO_DOUBLE))
+                MatrixView _Bi, _Bdone, _Tc, _Tii;
+                Matrix Bi = viewMatrix(B, i, 0, ib, B->m, &_Bi);
+
+                if (done > 0)
                 {
-                        fprintf(stderr,
-                                "contradiction A[%d][%d] = %.16f and b[%d] = %.16f\n",
-                                i,i,diagonal,i,value);
-                        exit(EXIT_FAILURE);
+                        Matrix Bdone = viewMatrix(B, start, 0, done, B->m, &_Bdone);
+                        Matrix Tc;
+
+                        /* op(T)[i.., start..] is T[i.., start..] or T[start.., i..]T */
+                        if (transpose)
+                                Tc = viewMatrix(T, start, i, done, ib, &_Tc);
+                        else
+                                Tc = viewMatrix(T, i, start, ib, done, &_Tc);
+
+                        scaledMultiplyMatrices(Tc, transpose, Bdone, 0, -1.0, Bi, 1.0);
                 }
 
-                mset(solution, i, 0, value / diagonal);
+                triangularSolveUnblocked(viewMatrix(T, i, i, ib, ib, &_Tii), Bi,
+                                         upper, transpose, unit);
+        }
+
+        return 0;
+}
+
+/*
+  zeroPivot
+
+  the first diagonal entry of the square triangular T that is zero
+  to MAXIMUM_ZERO_DOUBLE relative to the largest one, where rounding
+  leaves a singular factor. Only the diagonal is read, so T may be
+  the packed factors of an LU or QR.
+
+  @return 0, or i+1 for T[i][i]
+*/
+int zeroPivot(Matrix T)
+{
+        double largest = 0;
+        for (int i=0; i<T->n; i++)
+                largest = max(largest, fabs(maccess(T, i, i)));
+
+        for (int i=0; i<T->n; i++)
+        {
+                if (fabs(maccess(T, i, i)) <= MAXIMUM_ZERO_DOUBLE * largest)
+                        return i+1;
+        }
+
+        return 0;
+}
+
+/*
+  Back Substitution
+
+  solves Ax = b for x where A and b are given, b may hold several
+  right-hand sides, one per column
+
+  @param A an upper triangular matrix, rows past its columns are ignored
+  @param solution x of Ax=b, may be b itself
+  @param b right-hand sides
+  @return 0, or i+1 when A[i][i] is zero relative to the largest diagonal
+  entry and there is no unique solution
+*/
+int backSubstitution(Matrix A, Matrix solution, Matrix b)
+{
+        assert(A->n == b->n);
+        assert(A->m == solution->n);
+        assert(b->m == solution->m);
+        assert(A->n >= A->m);
+
+        MatrixView _U, _b;
+        Matrix U = viewMatrix(A, 0, 0, A->m, A->m, &_U);
+
+        int info = zeroPivot(U);
+        if (info != 0)
+                return info;
+
+        copyMatrix(viewMatrix(b, 0, 0, A->m, b->m, &_b), solution);
+        return triangularSolve(U, solution, 1, 0, 0);
+}
+
+/*
+  Forward Substitution
+
+  solves Lx = b for x where L and b are given, b may hold several
+  right-hand sides, one per column
+
+  @param L a square lower triangular matrix
+  @param solution x of Lx=b, may be b itself
+  @param b right-hand sides
+  @param unit take the diagonal of L as ones, as in the L of an LU
+  @return 0, or i+1 when L[i][i] is zero relative to the largest diagonal
+  entry and there is no unique solution
+*/
+int forwardSubstitution(Matrix L, Matrix solution, Matrix b, int unit)
+{
+        assert(L->n == L->m);
+        assert(L->n == b->n);
+        assert((solution->n == b->n) & (solution->m == b->m));
+
+        if (!unit)
+        {
+                int info = zeroPivot(L);
+                if (info != 0)
+                        return info;
         }
+
+        copyMatrix(b, solution);
+        return triangularSolve(L, solution, 0, 0, unit);
 }
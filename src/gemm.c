@@ -0,0 +1,435 @@
+/*
+  @file gemm.c
+  @author Gerardo Veltri
+  Cache-blocked general matrix multiply
+
+  C <- alpha * op(A) * op(B) + beta * C
+
+  The loop nest follows the usual packed GEMM layout: a KC x NC block of
+  op(B) is packed once per (jc, pc) step and stays resident in L3, an
+  MC x KC block of op(A) is packed into L2 and the microkernel streams
+  MR x KC and KC x NR micro-panels out of L1 while accumulating an
+  MR x NR tile of C in registers.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <gemm.h>
+#include <kernels.h>
+#include <pool.h>
+
+#define min(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a < _b ? _a : _b; })
+
+/* register tile */
+#define GEMM_MR 4
+#define GEMM_NR 8
+
+/* cache blocks, MC and NC must be multiples of MR and NR */
+#define GEMM_MC 128
+#define GEMM_KC 256
+#define GEMM_NC 4096
+
+#define GEMM_ALIGN 64
+
+/* fewest multiply-adds worth spreading over the thread pool */
+#define GEMM_PARALLEL (1 << 21)
+
+typedef double v2d __attribute__ ((vector_size (16)));
+typedef double v4d __attribute__ ((vector_size (32)));
+
+typedef void (*MicroKernel)(int kc, const double *a, const double *b,
+                            double ab[GEMM_MR][GEMM_NR]);
+
+/*
+  packA
+
+  copy an mc x kc block of op(A) into micro-panels of MR rows,
+  each stored column by column, padding the last panel with zeros
+*/
+static void packA(int transA, int mc, int kc, const double *A, int lda,
+                  double *packed)
+{
+        for (int ir=0; ir<mc; ir+=GEMM_MR)
+        {
+                int mr = min(GEMM_MR, mc-ir);
+                for (int p=0; p<kc; p++)
+                {
+                        for (int i=0; i<mr; i++)
+                        {
+                                if (transA)
+                                        packed[i] = A[(p*lda) + ir + i];
+                                else
+                                        packed[i] = A[((ir+i)*lda) + p];
+                        }
+                        for (int i=mr; i<GEMM_MR; i++)
+                                packed[i] = 0;
+                        packed += GEMM_MR;
+                }
+        }
+}
+
+/*
+  packB
+
+  copy a kc x nc block of op(B) into micro-panels of NR columns,
+  each stored row by row, padding the last panel with zeros
+*/
+static void packB(int transB, int kc, int nc, const double *B, int ldb,
+                  double *packed)
+{
+        for (int jr=0; jr<nc; jr+=GEMM_NR)
+        {
+                int nr = min(GEMM_NR, nc-jr);
+                for (int p=0; p<kc; p++)
+                {
+                        if (!transB & (nr == GEMM_NR))
+                        {
+                                memcpy(packed, B + (p*ldb) + jr, GEMM_NR*sizeof(double));
+                        }
+                        else
+                        {
+                                for (int j=0; j<nr; j++)
+                                {
+                                        if (transB)
+                                                packed[j] = B[((jr+j)*ldb) + p];
+                                        else
+                                                packed[j] = B[(p*ldb) + jr + j];
+                                }
+                                for (int j=nr; j<GEMM_NR; j++)
+                                        packed[j] = 0;
+                        }
+                        packed += GEMM_NR;
+                }
+        }
+}
+
+/*
+  microKernelGeneric
+
+  ab <- a * b for one MR x kc micro-panel of A and one kc x NR
+  micro-panel of B, accumulated in registers
+
+  written against 16 byte vectors so the baseline x86-64 target keeps
+  every accumulator in an xmm register, the tile is swept as two
+  MR x NR/2 halves since all NR columns at once would spill
+*/
+static void microKernelGeneric(int kc, const double *a, const double *b,
+                               double ab[GEMM_MR][GEMM_NR])
+{
+        for (int h=0; h<GEMM_NR; h+=4)
+        {
+                const double *_a = a;
+                const double *_b = b + h;
+
+                v2d c00 = {0}, c01 = {0};
+                v2d c10 = {0}, c11 = {0};
+                v2d c20 = {0}, c21 = {0};
+                v2d c30 = {0}, c31 = {0};
+
+                for (int p=0; p<kc; p++)
+                {
+                        v2d b0 = *(const v2d *)_b;
+                        v2d b1 = *(const v2d *)(_b+2);
+
+                        c00 += _a[0] * b0; c01 += _a[0] * b1;
+                        c10 += _a[1] * b0; c11 += _a[1] * b1;
+                        c20 += _a[2] * b0; c21 += _a[2] * b1;
+                        c30 += _a[3] * b0; c31 += _a[3] * b1;
+
+                        _a += GEMM_MR;
+                        _b += GEMM_NR;
+                }
+
+                memcpy(&ab[0][h], &c00, sizeof(v2d)); memcpy(&ab[0][h+2], &c01, sizeof(v2d));
+                memcpy(&ab[1][h], &c10, sizeof(v2d)); memcpy(&ab[1][h+2], &c11, sizeof(v2d));
+                memcpy(&ab[2][h], &c20, sizeof(v2d)); memcpy(&ab[2][h+2], &c21, sizeof(v2d));
+                memcpy(&ab[3][h], &c30, sizeof(v2d)); memcpy(&ab[3][h+2], &c31, sizeof(v2d));
+        }
+}
+
+/*
+  microKernelAVX2
+
+  the same tile with 32 byte vectors and FMA, all eight accumulators
+  fit in ymm registers. Also used on AVX-512 hardware: a 4 x 8 tile
+  would only fill four zmm accumulators, too few to hide FMA latency.
+*/
+__attribute__ ((target ("avx2,fma")))
+static void microKernelAVX2(int kc, const double *a, const double *b,
+                            double ab[GEMM_MR][GEMM_NR])
+{
+        v4d c00 = {0}, c01 = {0};
+        v4d c10 = {0}, c11 = {0};
+        v4d c20 = {0}, c21 = {0};
+        v4d c30 = {0}, c31 = {0};
+
+        for (int p=0; p<kc; p++)
+        {
+                v4d b0 = *(const v4d *)b;
+                v4d b1 = *(const v4d *)(b+4);
+
+                c00 += a[0] * b0; c01 += a[0] * b1;
+                c10 += a[1] * b0; c11 += a[1] * b1;
+                c20 += a[2] * b0; c21 += a[2] * b1;
+                c30 += a[3] * b0; c31 += a[3] * b1;
+
+                a += GEMM_MR;
+                b += GEMM_NR;
+        }
+
+        memcpy(&ab[0][0], &c00, sizeof(v4d)); memcpy(&ab[0][4], &c01, sizeof(v4d));
+        memcpy(&ab[1][0], &c10, sizeof(v4d)); memcpy(&ab[1][4], &c11, sizeof(v4d));
+        memcpy(&ab[2][0], &c20, sizeof(v4d)); memcpy(&ab[2][4], &c21, sizeof(v4d));
+        memcpy(&ab[3][0], &c30, sizeof(v4d)); memcpy(&ab[3][4], &c31, sizeof(v4d));
+}
+
+/*
+  writeTile
+
+  C <- alpha * ab + beta * C for the mr x nr corner of a register tile
+  beta == 0 overwrites C without reading it
+*/
+static void writeTile(int mr, int nr, double ab[GEMM_MR][GEMM_NR],
+                      double alpha, double beta, double *C, int ldc)
+{
+        for (int i=0; i<mr; i++)
+        {
+                double *c = C + (i*ldc);
+                if (beta == 0)
+                        for (int j=0; j<nr; j++)
+                                c[j] = alpha * ab[i][j];
+                else
+                        for (int j=0; j<nr; j++)
+                                c[j] = (alpha * ab[i][j]) + (beta * c[j]);
+        }
+}
+
+static void scaleTarget(int n, int m, double beta, double *C, int ldc)
+{
+        for (int i=0; i<n; i++)
+        {
+                for (int j=0; j<m; j++)
+                {
+                        if (beta == 0)
+                                C[(i*ldc) + j] = 0;
+                        else
+                                C[(i*ldc) + j] *= beta;
+                }
+        }
+}
+
+/*
+  packing buffers, one pair per thread
+
+  kept between calls and only grown, so after the first multiply of a
+  given size gemm makes no allocations. Each buffer is bounded by the
+  cache blocks: MC x KC and KC x NC doubles.
+*/
+static __thread double *packBufferA = NULL;
+static __thread double *packBufferB = NULL;
+static __thread size_t packSizeA = 0;
+static __thread size_t packSizeB = 0;
+
+static double *packBuffer(double **buffer, size_t *capacity, size_t count)
+{
+        if (count > *capacity)
+        {
+                size_t size = count*sizeof(double);
+                size = (size + GEMM_ALIGN - 1) & ~((size_t)GEMM_ALIGN - 1);
+
+                free(*buffer);
+                *buffer = aligned_alloc(GEMM_ALIGN, size);
+                assert(*buffer != NULL);
+                *capacity = count;
+        }
+        return *buffer;
+}
+
+/*
+  gemmFreeBuffers
+
+  release the calling thread's packing buffers, for threads that are
+  about to exit; a later gemm on the same thread allocates them again
+*/
+void gemmFreeBuffers(void)
+{
+        free(packBufferA);
+        free(packBufferB);
+        packBufferA = NULL;
+        packBufferB = NULL;
+        packSizeA = 0;
+        packSizeB = 0;
+}
+
+/* one (jc, pc) step of the loop nest, shared by the threads running it */
+typedef struct {
+
+        int transA;
+        int n; /* rows of C */
+        int kc;
+        int mcMax; /* rows of A packed at once, sizes the packing buffer */
+        int kcMax;
+        const double *A; /* op(A) at column pc */
+        int lda;
+        const double *packedB;
+        int nc;
+        int width; /* columns of the step per task, a multiple of NR */
+        int slices;
+        double alpha;
+        double beta;
+        double *C; /* C at column jc */
+        int ldc;
+        MicroKernel microKernel;
+
+} GemmStep;
+
+/*
+  macroKernel
+
+  the rows ic .. ic+MC and one slice of columns of a step: op(A) is
+  packed into this thread's buffer and swept against the shared
+  packed op(B), task i covers row block i / slices, slice i % slices
+*/
+static void macroKernel(void *_step, int task)
+{
+        GemmStep *step = _step;
+        int ic = (task / step->slices) * GEMM_MC;
+        int j0 = (task % step->slices) * step->width;
+        int mc = min(GEMM_MC, step->n - ic);
+        int nc = min(step->width, step->nc - j0);
+        int kc = step->kc;
+
+        double *packedA = packBuffer(&packBufferA, &packSizeA,
+                                     (size_t)step->mcMax * step->kcMax);
+        double ab[GEMM_MR][GEMM_NR];
+
+        if (step->transA)
+                packA(step->transA, mc, kc, step->A + ic, step->lda, packedA);
+        else
+                packA(step->transA, mc, kc, step->A + (ic*step->lda), step->lda, packedA);
+
+        for (int jr=0; jr<nc; jr+=GEMM_NR)
+        {
+                int nr = min(GEMM_NR, nc-jr);
+                const double *b = step->packedB + ((j0+jr)*kc);
+
+                for (int ir=0; ir<mc; ir+=GEMM_MR)
+                {
+                        int mr = min(GEMM_MR, mc-ir);
+                        const double *a = packedA + (ir*kc);
+
+                        step->microKernel(kc, a, b, ab);
+                        writeTile(mr, nr, ab, step->alpha, step->beta,
+                                  step->C + ((ic+ir)*step->ldc) + j0 + jr, step->ldc);
+                }
+        }
+}
+
+/*
+  gemm
+
+  C <- alpha * op(A) * op(B) + beta * C
+
+  C is n x m, op(A) is n x k and op(B) is k x m, all row-major with
+  leading dimensions lda, ldb and ldc. op(X) is X transposed when the
+  corresponding flag is set. When beta is zero C is not read, so it
+  may hold uninitialized values.
+
+  Products of at least GEMM_PARALLEL multiply-adds are spread over
+  the thread pool: each packed block of op(B) is shared and the row
+  blocks of C, split into column slices when there are fewer row
+  blocks than threads, go to separate tasks.
+
+  @param transA use the transpose of A
+  @param transB use the transpose of B
+  @param n rows of C
+  @param m columns of C
+  @param k inner dimension
+  @param alpha scalar applied to the product
+  @param A left operand
+  @param lda row stride of A
+  @param B right operand
+  @param ldb row stride of B
+  @param beta scalar applied to C before accumulating
+  @param C target
+  @param ldc row stride of C
+*/
+void gemm(int transA, int transB, int n, int m, int k,
+          double alpha, const double *A, int lda,
+          const double *B, int ldb,
+          double beta, double *C, int ldc)
+{
+        if ((n == 0) | (m == 0))
+                return;
+
+        if ((k == 0) | (alpha == 0))
+        {
+                if (beta != 1)
+                        scaleTarget(n, m, beta, C, ldc);
+                return;
+        }
+
+        int kc_max = min(GEMM_KC, k);
+        int mc_max = min(GEMM_MC, ((n + GEMM_MR - 1) / GEMM_MR) * GEMM_MR);
+        int nc_max = min(GEMM_NC, ((m + GEMM_NR - 1) / GEMM_NR) * GEMM_NR);
+
+        double *packedB = packBuffer(&packBufferB, &packSizeB, (size_t)kc_max * nc_max);
+
+        int threads = 1;
+        if ((double)n * m * k >= GEMM_PARALLEL)
+                threads = poolThreads();
+
+        GemmStep step;
+        step.transA = transA;
+        step.n = n;
+        step.mcMax = mc_max;
+        step.kcMax = kc_max;
+        step.lda = lda;
+        step.packedB = packedB;
+        step.alpha = alpha;
+        step.ldc = ldc;
+        step.microKernel = microKernelGeneric;
+        if (simdLevel() >= SIMD_AVX2)
+                step.microKernel = microKernelAVX2;
+
+        int blocks = (n + GEMM_MC - 1) / GEMM_MC;
+
+        for (int jc=0; jc<m; jc+=GEMM_NC)
+        {
+                int nc = min(GEMM_NC, m-jc);
+
+                /* too few row blocks to go around, cut the columns as well */
+                int slices = min((threads + blocks - 1) / blocks, (nc + GEMM_NR - 1) / GEMM_NR);
+                int width = (nc + slices - 1) / slices;
+                width = ((width + GEMM_NR - 1) / GEMM_NR) * GEMM_NR;
+
+                step.nc = nc;
+                step.width = width;
+                step.slices = (nc + width - 1) / width;
+                step.C = C + jc;
+
+                for (int pc=0; pc<k; pc+=GEMM_KC)
+                {
+                        int kc = min(GEMM_KC, k-pc);
+
+                        /* only the first block of k sees the caller's beta */
+                        step.beta = (pc == 0) ? beta : 1.0;
+                        step.kc = kc;
+                        step.A = transA ? A + (pc*lda) : A + pc;
+
+                        if (transB)
+                                packB(transB, kc, nc, B + (jc*ldb) + pc, ldb, packedB);
+                        else
+                                packB(transB, kc, nc, B + (pc*ldb) + jc, ldb, packedB);
+
+                        if (threads > 1)
+                                poolFor(blocks * step.slices, macroKernel, &step);
+                        else
+                                for (int i=0; i<blocks; i++)
+                                        macroKernel(&step, i);
+                }
+        }
+}
@@ -0,0 +1,758 @@
+/*
+  @file kernels.c
+  @author Gerardo Veltri
+  Vector primitives with SIMD implementations selected at startup
+
+  Each primitive has a portable version and, on x86, SSE2, AVX2 and
+  AVX-512 versions compiled with per-function target attributes so a
+  single binary carries all of them. The widest set supported by the
+  CPU is picked once from CPUID when the program loads, and can be
+  capped with the LINALG_SIMD environment variable
+  (generic, sse2, avx2 or avx512).
+
+  The SIMD versions only cover unit stride; strided calls (columns of
+  a row-major matrix) go to the portable version. Reductions keep four
+  independent accumulators so they are bound by throughput rather than
+  by the latency of a single add or FMA chain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <kernels.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+typedef struct _VectorKernels_ {
+
+        int level;
+        const char *name;
+
+        double (*dot)(int n, const double *x, int incx, const double *y, int incy);
+        void (*axpy)(int n, double alpha, const double *x, int incx, double *y, int incy);
+        void (*scale)(int n, double alpha, double *x, int incx);
+        double (*sum)(int n, const double *x, int incx, int _abs);
+        double (*max)(int n, const double *x, int incx, int _abs);
+        void (*abs)(int n, double *x, int incx);
+
+} VectorKernels;
+
+/* portable versions, also used for strided calls */
+static double dotGeneric(int n, const double *x, int incx, const double *y, int incy)
+{
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int i = 0;
+
+        for (; i+4<=n; i+=4)
+        {
+                s0 += x[i*incx] * y[i*incy];
+                s1 += x[(i+1)*incx] * y[(i+1)*incy];
+                s2 += x[(i+2)*incx] * y[(i+2)*incy];
+                s3 += x[(i+3)*incx] * y[(i+3)*incy];
+        }
+        for (; i<n; i++)
+                s0 += x[i*incx] * y[i*incy];
+
+        return (s0 + s1) + (s2 + s3);
+}
+
+static void axpyGeneric(int n, double alpha, const double *x, int incx, double *y, int incy)
+{
+        for (int i=0; i<n; i++)
+                y[i*incy] += alpha * x[i*incx];
+}
+
+static void scaleGeneric(int n, double alpha, double *x, int incx)
+{
+        for (int i=0; i<n; i++)
+                x[i*incx] *= alpha;
+}
+
+static double sumGeneric(int n, const double *x, int incx, int _abs)
+{
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int i = 0;
+
+        if (_abs)
+        {
+                for (; i+4<=n; i+=4)
+                {
+                        s0 += fabs(x[i*incx]);
+                        s1 += fabs(x[(i+1)*incx]);
+                        s2 += fabs(x[(i+2)*incx]);
+                        s3 += fabs(x[(i+3)*incx]);
+                }
+                for (; i<n; i++)
+                        s0 += fabs(x[i*incx]);
+        }
+        else
+        {
+                for (; i+4<=n; i+=4)
+                {
+                        s0 += x[i*incx];
+                        s1 += x[(i+1)*incx];
+                        s2 += x[(i+2)*incx];
+                        s3 += x[(i+3)*incx];
+                }
+                for (; i<n; i++)
+                        s0 += x[i*incx];
+        }
+
+        return (s0 + s1) + (s2 + s3);
+}
+
+static double maxGeneric(int n, const double *x, int incx, int _abs)
+{
+        assert(n > 0);
+
+        double max = _abs ? fabs(x[0]) : x[0];
+        for (int i=1; i<n; i++)
+        {
+                double curr = _abs ? fabs(x[i*incx]) : x[i*incx];
+                if (max < curr)
+                        max = curr;
+        }
+        return max;
+}
+
+static void absGeneric(int n, double *x, int incx)
+{
+        for (int i=0; i<n; i++)
+                x[i*incx] = fabs(x[i*incx]);
+}
+
+static const VectorKernels genericKernels = {
+        SIMD_GENERIC, "generic",
+        dotGeneric, axpyGeneric, scaleGeneric,
+        sumGeneric, maxGeneric, absGeneric
+};
+
+#ifdef KERNELS_X86
+
+/* SSE2 */
+__attribute__ ((target ("sse2")))
+static inline double hsumSSE2(__m128d v)
+{
+        return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+__attribute__ ((target ("sse2")))
+static inline double hmaxSSE2(__m128d v)
+{
+        return _mm_cvtsd_f64(_mm_max_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+__attribute__ ((target ("sse2")))
+static double dotSSE2(int n, const double *x, int incx, const double *y, int incy)
+{
+        if ((incx != 1) | (incy != 1))
+                return dotGeneric(n, x, incx, y, incy);
+
+        __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+        __m128d s2 = _mm_setzero_pd(), s3 = _mm_setzero_pd();
+        int i = 0;
+
+        for (; i+8<=n; i+=8)
+        {
+                s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(x+i), _mm_loadu_pd(y+i)));
+                s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(x+i+2), _mm_loadu_pd(y+i+2)));
+                s2 = _mm_add_pd(s2, _mm_mul_pd(_mm_loadu_pd(x+i+4), _mm_loadu_pd(y+i+4)));
+                s3 = _mm_add_pd(s3, _mm_mul_pd(_mm_loadu_pd(x+i+6), _mm_loadu_pd(y+i+6)));
+        }
+
+        double s = hsumSSE2(_mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3)));
+        for (; i<n; i++)
+                s += x[i] * y[i];
+
+        return s;
+}
+
+__attribute__ ((target ("sse2")))
+static void axpySSE2(int n, double alpha, const double *x, int incx, double *y, int incy)
+{
+        if ((incx != 1) | (incy != 1))
+        {
+                axpyGeneric(n, alpha, x, incx, y, incy);
+                return;
+        }
+
+        __m128d a = _mm_set1_pd(alpha);
+        int i = 0;
+
+        for (; i+4<=n; i+=4)
+        {
+                _mm_storeu_pd(y+i, _mm_add_pd(_mm_loadu_pd(y+i),
+                                              _mm_mul_pd(a, _mm_loadu_pd(x+i))));
+                _mm_storeu_pd(y+i+2, _mm_add_pd(_mm_loadu_pd(y+i+2),
+                                                _mm_mul_pd(a, _mm_loadu_pd(x+i+2))));
+        }
+        for (; i<n; i++)
+                y[i] += alpha * x[i];
+}
+
+__attribute__ ((target ("sse2")))
+static void scaleSSE2(int n, double alpha, double *x, int incx)
+{
+        if (incx != 1)
+        {
+                scaleGeneric(n, alpha, x, incx);
+                return;
+        }
+
+        __m128d a = _mm_set1_pd(alpha);
+        int i = 0;
+
+        for (; i+4<=n; i+=4)
+        {
+                _mm_storeu_pd(x+i, _mm_mul_pd(a, _mm_loadu_pd(x+i)));
+                _mm_storeu_pd(x+i+2, _mm_mul_pd(a, _mm_loadu_pd(x+i+2)));
+        }
+        for (; i<n; i++)
+                x[i] *= alpha;
+}
+
+__attribute__ ((target ("sse2")))
+static double sumSSE2(int n, const double *x, int incx, int _abs)
+{
+        if (incx != 1)
+                return sumGeneric(n, x, incx, _abs);
+
+        __m128d mask = _abs ? _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL))
+                : _mm_castsi128_pd(_mm_set1_epi64x(-1));
+        __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+        __m128d s2 = _mm_setzero_pd(), s3 = _mm_setzero_pd();
+        int i = 0;
+
+        for (; i+8<=n; i+=8)
+        {
+                s0 = _mm_add_pd(s0, _mm_and_pd(mask, _mm_loadu_pd(x+i)));
+                s1 = _mm_add_pd(s1, _mm_and_pd(mask, _mm_loadu_pd(x+i+2)));
+                s2 = _mm_add_pd(s2, _mm_and_pd(mask, _mm_loadu_pd(x+i+4)));
+                s3 = _mm_add_pd(s3, _mm_and_pd(mask, _mm_loadu_pd(x+i+6)));
+        }
+
+        double s = hsumSSE2(_mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3)));
+        for (; i<n; i++)
+                s += _abs ? fabs(x[i]) : x[i];
+
+        return s;
+}
+
+__attribute__ ((target ("sse2")))
+static double maxSSE2(int n, const double *x, int incx, int _abs)
+{
+        if ((incx != 1) | (n < 4))
+                return maxGeneric(n, x, incx, _abs);
+
+        __m128d mask = _abs ? _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL))
+                : _mm_castsi128_pd(_mm_set1_epi64x(-1));
+        __m128d m0 = _mm_and_pd(mask, _mm_loadu_pd(x));
+        __m128d m1 = _mm_and_pd(mask, _mm_loadu_pd(x+2));
+        int i = 4;
+
+        for (; i+4<=n; i+=4)
+        {
+                m0 = _mm_max_pd(m0, _mm_and_pd(mask, _mm_loadu_pd(x+i)));
+                m1 = _mm_max_pd(m1, _mm_and_pd(mask, _mm_loadu_pd(x+i+2)));
+        }
+
+        double max = hmaxSSE2(_mm_max_pd(m0, m1));
+        for (; i<n; i++)
+        {
+                double curr = _abs ? fabs(x[i]) : x[i];
+                if (max < curr)
+                        max = curr;
+        }
+        return max;
+}
+
+__attribute__ ((target ("sse2")))
+static void absSSE2(int n, double *x, int incx)
+{
+        if (incx != 1)
+        {
+                absGeneric(n, x, incx);
+                return;
+        }
+
+        __m128d mask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+        int i = 0;
+
+        for (; i+2<=n; i+=2)
+                _mm_storeu_pd(x+i, _mm_and_pd(mask, _mm_loadu_pd(x+i)));
+        for (; i<n; i++)
+                x[i] = fabs(x[i]);
+}
+
+static const VectorKernels sse2Kernels = {
+        SIMD_SSE2, "sse2",
+        dotSSE2, axpySSE2, scaleSSE2,
+        sumSSE2, maxSSE2, absSSE2
+};
+
+/* AVX2 + FMA */
+__attribute__ ((target ("avx2,fma")))
+static inline double hsumAVX2(__m256d v)
+{
+        __m128d lo = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__ ((target ("avx2,fma")))
+static inline double hmaxAVX2(__m256d v)
+{
+        __m128d lo = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_max_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__ ((target ("avx2,fma")))
+static double dotAVX2(int n, const double *x, int incx, const double *y, int incy)
+{
+        if ((incx != 1) | (incy != 1))
+                return dotGeneric(n, x, incx, y, incy);
+
+        __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+        __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+        int i = 0;
+
+        for (; i+16<=n; i+=16)
+        {
+                s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i), s0);
+                s1 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i+4), _mm256_loadu_pd(y+i+4), s1);
+                s2 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i+8), _mm256_loadu_pd(y+i+8), s2);
+                s3 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i+12), _mm256_loadu_pd(y+i+12), s3);
+        }
+        for (; i+4<=n; i+=4)
+                s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i), s0);
+
+        double s = hsumAVX2(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+        for (; i<n; i++)
+                s += x[i] * y[i];
+
+        return s;
+}
+
+__attribute__ ((target ("avx2,fma")))
+static void axpyAVX2(int n, double alpha, const double *x, int incx, double *y, int incy)
+{
+        if ((incx != 1) | (incy != 1))
+        {
+                axpyGeneric(n, alpha, x, incx, y, incy);
+                return;
+        }
+
+        __m256d a = _mm256_set1_pd(alpha);
+        int i = 0;
+
+        for (; i+8<=n; i+=8)
+        {
+                _mm256_storeu_pd(y+i, _mm256_fmadd_pd(a, _mm256_loadu_pd(x+i),
+                                                      _mm256_loadu_pd(y+i)));
+                _mm256_storeu_pd(y+i+4, _mm256_fmadd_pd(a, _mm256_loadu_pd(x+i+4),
+                                                        _mm256_loadu_pd(y+i+4)));
+        }
+        for (; i<n; i++)
+                y[i] += alpha * x[i];
+}
+
+__attribute__ ((target ("avx2,fma")))
+static void scaleAVX2(int n, double alpha, double *x, int incx)
+{
+        if (incx != 1)
+        {
+                scaleGeneric(n, alpha, x, incx);
+                return;
+        }
+
+        __m256d a = _mm256_set1_pd(alpha);
+        int i = 0;
+
+        for (; i+8<=n; i+=8)
+        {
+                _mm256_storeu_pd(x+i, _mm256_mul_pd(a, _mm256_loadu_pd(x+i)));
+                _mm256_storeu_pd(x+i+4, _mm256_mul_pd(a, _mm256_loadu_pd(x+i+4)));
+        }
+        for (; i<n; i++)
+                x[i] *= alpha;
+}
+
+__attribute__ ((target ("avx2,fma")))
+static double sumAVX2(int n, const double *x, int incx, int _abs)
+{
+        if (incx != 1)
+                return sumGeneric(n, x, incx, _abs);
+
+        __m256d mask = _abs ? _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL))
+                : _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+        __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+        int i = 0;
+
+        for (; i+16<=n; i+=16)
+        {
+                s0 = _mm256_add_pd(s0, _mm256_and_pd(mask, _mm256_loadu_pd(x+i)));
+                s1 = _mm256_add_pd(s1, _mm256_and_pd(mask, _mm256_loadu_pd(x+i+4)));
+                s2 = _mm256_add_pd(s2, _mm256_and_pd(mask, _mm256_loadu_pd(x+i+8)));
+                s3 = _mm256_add_pd(s3, _mm256_and_pd(mask, _mm256_loadu_pd(x+i+12)));
+        }
+
+        double s = hsumAVX2(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+        for (; i<n; i++)
+                s += _abs ? fabs(x[i]) : x[i];
+
+        return s;
+}
+
+__attribute__ ((target ("avx2,fma")))
+static double maxAVX2(int n, const double *x, int incx, int _abs)
+{
+        if ((incx != 1) | (n < 8))
+                return maxGeneric(n, x, incx, _abs);
+
+        __m256d mask = _abs ? _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL))
+                : _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        __m256d m0 = _mm256_and_pd(mask, _mm256_loadu_pd(x));
+        __m256d m1 = _mm256_and_pd(mask, _mm256_loadu_pd(x+4));
+        int i = 8;
+
+        for (; i+8<=n; i+=8)
+        {
+                m0 = _mm256_max_pd(m0, _mm256_and_pd(mask, _mm256_loadu_pd(x+i)));
+                m1 = _mm256_max_pd(m1, _mm256_and_pd(mask, _mm256_loadu_pd(x+i+4)));
+        }
+
+        double max = hmaxAVX2(_mm256_max_pd(m0, m1));
+        for (; i<n; i++)
+        {
+                double curr = _abs ? fabs(x[i]) : x[i];
+                if (max < curr)
+                        max = curr;
+        }
+        return max;
+}
+
+__attribute__ ((target ("avx2,fma")))
+static void absAVX2(int n, double *x, int incx)
+{
+        if (incx != 1)
+        {
+                absGeneric(n, x, incx);
+                return;
+        }
+
+        __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+        int i = 0;
+
+        for (; i+4<=n; i+=4)
+                _mm256_storeu_pd(x+i, _mm256_and_pd(mask, _mm256_loadu_pd(x+i)));
+        for (; i<n; i++)
+                x[i] = fabs(x[i]);
+}
+
+static const VectorKernels avx2Kernels = {
+        SIMD_AVX2, "avx2",
+        dotAVX2, axpyAVX2, scaleAVX2,
+        sumAVX2, maxAVX2, absAVX2
+};
+
+/* AVX-512F, tails are handled with masked loads and stores */
+__attribute__ ((target ("avx512f")))
+static inline __mmask8 tailMask512(int remaining)
+{
+        return (__mmask8)((1u << remaining) - 1);
+}
+
+__attribute__ ((target ("avx512f")))
+static double dotAVX512(int n, const double *x, int incx, const double *y, int incy)
+{
+        if ((incx != 1) | (incy != 1))
+                return dotGeneric(n, x, incx, y, incy);
+
+        __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+        __m512d s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+        int i = 0;
+
+        for (; i+32<=n; i+=32)
+        {
+                s0 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i), s0);
+                s1 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i+8), _mm512_loadu_pd(y+i+8), s1);
+                s2 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i+16), _mm512_loadu_pd(y+i+16), s2);
+                s3 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i+24), _mm512_loadu_pd(y+i+24), s3);
+        }
+        for (; i+8<=n; i+=8)
+                s0 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i), s0);
+        if (i < n)
+        {
+                __mmask8 k = tailMask512(n-i);
+                s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(k, x+i),
+                                     _mm512_maskz_loadu_pd(k, y+i), s1);
+        }
+
+        return _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(s0, s1),
+                                                  _mm512_add_pd(s2, s3)));
+}
+
+__attribute__ ((target ("avx512f")))
+static void axpyAVX512(int n, double alpha, const double *x, int incx, double *y, int incy)
+{
+        if ((incx != 1) | (incy != 1))
+        {
+                axpyGeneric(n, alpha, x, incx, y, incy);
+                return;
+        }
+
+        __m512d a = _mm512_set1_pd(alpha);
+        int i = 0;
+
+        for (; i+8<=n; i+=8)
+                _mm512_storeu_pd(y+i, _mm512_fmadd_pd(a, _mm512_loadu_pd(x+i),
+                                                      _mm512_loadu_pd(y+i)));
+        if (i < n)
+        {
+                __mmask8 k = tailMask512(n-i);
+                _mm512_mask_storeu_pd(y+i, k,
+                                      _mm512_fmadd_pd(a, _mm512_maskz_loadu_pd(k, x+i),
+                                                      _mm512_maskz_loadu_pd(k, y+i)));
+        }
+}
+
+__attribute__ ((target ("avx512f")))
+static void scaleAVX512(int n, double alpha, double *x, int incx)
+{
+        if (incx != 1)
+        {
+                scaleGeneric(n, alpha, x, incx);
+                return;
+        }
+
+        __m512d a = _mm512_set1_pd(alpha);
+        int i = 0;
+
+        for (; i+8<=n; i+=8)
+                _mm512_storeu_pd(x+i, _mm512_mul_pd(a, _mm512_loadu_pd(x+i)));
+        if (i < n)
+        {
+                __mmask8 k = tailMask512(n-i);
+                _mm512_mask_storeu_pd(x+i, k, _mm512_mul_pd(a, _mm512_maskz_loadu_pd(k, x+i)));
+        }
+}
+
+__attribute__ ((target ("avx512f")))
+static double sumAVX512(int n, const double *x, int incx, int _abs)
+{
+        if (incx != 1)
+                return sumGeneric(n, x, incx, _abs);
+
+        __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+        __m512d s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+        int i = 0;
+
+        if (_abs)
+        {
+                for (; i+32<=n; i+=32)
+                {
+                        s0 = _mm512_add_pd(s0, _mm512_abs_pd(_mm512_loadu_pd(x+i)));
+                        s1 = _mm512_add_pd(s1, _mm512_abs_pd(_mm512_loadu_pd(x+i+8)));
+                        s2 = _mm512_add_pd(s2, _mm512_abs_pd(_mm512_loadu_pd(x+i+16)));
+                        s3 = _mm512_add_pd(s3, _mm512_abs_pd(_mm512_loadu_pd(x+i+24)));
+                }
+                for (; i<n; i+=8)
+                        s0 = _mm512_add_pd(s0, _mm512_abs_pd(
+                                                   _mm512_maskz_loadu_pd(tailMask512(n-i < 8 ? n-i : 8),
+                                                                         x+i)));
+        }
+        else
+        {
+                for (; i+32<=n; i+=32)
+                {
+                        s0 = _mm512_add_pd(s0, _mm512_loadu_pd(x+i));
+                        s1 = _mm512_add_pd(s1, _mm512_loadu_pd(x+i+8));
+                        s2 = _mm512_add_pd(s2, _mm512_loadu_pd(x+i+16));
+                        s3 = _mm512_add_pd(s3, _mm512_loadu_pd(x+i+24));
+                }
+                for (; i<n; i+=8)
+                        s0 = _mm512_add_pd(s0, _mm512_maskz_loadu_pd(tailMask512(n-i < 8 ? n-i : 8),
+                                                                     x+i));
+        }
+
+        return _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(s0, s1),
+                                                  _mm512_add_pd(s2, s3)));
+}
+
+__attribute__ ((target ("avx512f")))
+static double maxAVX512(int n, const double *x, int incx, int _abs)
+{
+        if ((incx != 1) | (n < 8))
+                return maxGeneric(n, x, incx, _abs);
+
+        __m512d m0 = _mm512_loadu_pd(x);
+        if (_abs)
+                m0 = _mm512_abs_pd(m0);
+        __m512d m1 = m0;
+        int i = 8;
+
+        for (; i+16<=n; i+=16)
+        {
+                __m512d v0 = _mm512_loadu_pd(x+i);
+                __m512d v1 = _mm512_loadu_pd(x+i+8);
+                if (_abs)
+                {
+                        v0 = _mm512_abs_pd(v0);
+                        v1 = _mm512_abs_pd(v1);
+                }
+                m0 = _mm512_max_pd(m0, v0);
+                m1 = _mm512_max_pd(m1, v1);
+        }
+
+        double max = _mm512_reduce_max_pd(_mm512_max_pd(m0, m1));
+        for (; i<n; i++)
+        {
+                double curr = _abs ? fabs(x[i]) : x[i];
+                if (max < curr)
+                        max = curr;
+        }
+        return max;
+}
+
+__attribute__ ((target ("avx512f")))
+static void absAVX512(int n, double *x, int incx)
+{
+        if (incx != 1)
+        {
+                absGeneric(n, x, incx);
+                return;
+        }
+
+        int i = 0;
+        for (; i+8<=n; i+=8)
+                _mm512_storeu_pd(x+i, _mm512_abs_pd(_mm512_loadu_pd(x+i)));
+        if (i < n)
+        {
+                __mmask8 k = tailMask512(n-i);
+                _mm512_mask_storeu_pd(x+i, k, _mm512_abs_pd(_mm512_maskz_loadu_pd(k, x+i)));
+        }
+}
+
+static const VectorKernels avx512Kernels = {
+        SIMD_AVX512, "avx512",
+        dotAVX512, axpyAVX512, scaleAVX512,
+        sumAVX512, maxAVX512, absAVX512
+};
+
+#endif
+
+/* until the constructor runs every call takes the portable path */
+static const VectorKernels *kernels = &genericKernels;
+
+/*
+  initKernels
+
+  runs once at load time, picks the widest instruction set reported
+  by CPUID, capped by LINALG_SIMD when it is set
+*/
+__attribute__ ((constructor))
+static void initKernels(void)
+{
+        int cap = SIMD_AVX512;
+        const char *env = getenv("LINALG_SIMD");
+
+        if (env != NULL)
+        {
+                if (strcmp(env, "generic") == 0)
+                        cap = SIMD_GENERIC;
+                else if (strcmp(env, "sse2") == 0)
+                        cap = SIMD_SSE2;
+                else if (strcmp(env, "avx2") == 0)
+                        cap = SIMD_AVX2;
+                else if (strcmp(env, "avx512") != 0)
+                        fprintf(stderr, "LINALG_SIMD=%s not recognized, ignoring\n", env);
+        }
+
+#ifdef KERNELS_X86
+        __builtin_cpu_init();
+
+        if ((cap >= SIMD_AVX512) && __builtin_cpu_supports("avx512f"))
+                kernels = &avx512Kernels;
+        else if ((cap >= SIMD_AVX2) && __builtin_cpu_supports("avx2")
+                 && __builtin_cpu_supports("fma"))
+                kernels = &avx2Kernels;
+        else if ((cap >= SIMD_SSE2) && __builtin_cpu_supports("sse2"))
+                kernels = &sse2Kernels;
+#else
+        (void)cap;
+#endif
+}
+
+int simdLevel(void)
+{
+        return kernels->level;
+}
+
+const char *simdName(void)
+{
+        return kernels->name;
+}
+
+/*
+  vectorDot
+
+  sum_i x[i*incx] * y[i*incy]
+*/
+double vectorDot(int n, const double *x, int incx, const double *y, int incy)
+{
+        return kernels->dot(n, x, incx, y, incy);
+}
+
+/*
+  vectorAxpy
+
+  y <- alpha * x + y
+*/
+void vectorAxpy(int n, double alpha, const double *x, int incx, double *y, int incy)
+{
+        kernels->axpy(n, alpha, x, incx, y, incy);
+}
+
+/*
+  vectorScale
+
+  x <- alpha * x
+*/
+void vectorScale(int n, double alpha, double *x, int incx)
+{
+        kernels->scale(n, alpha, x, incx);
+}
+
+/*
+  vectorSum
+
+  sum of the elements of x, or of their absolute values
+*/
+double vectorSum(int n, const double *x, int incx, int _abs)
+{
+        return kernels->sum(n, x, incx, _abs);
+}
+
+/*
+  vectorMax
+
+  largest element of x, or largest absolute value, n must be positive
+*/
+double vectorMax(int n, const double *x, int incx, int _abs)
+{
+        return kernels->max(n, x, incx, _abs);
+}
+
+/*
+  vectorAbs
+
+  x <- |x|
+*/
+void vectorAbs(int n, double *x, int incx)
+{
+        kernels->abs(n, x, incx);
+}
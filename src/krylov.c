@@ -0,0 +1,1264 @@
+/*
+  @file krylov.c
+  @author Gerardo Veltri
+  Krylov subspace methods on operators known only through products
+
+  The operator enters only as a MatVec callback computing y = A x, so
+  dense matrices (denseMatVec), sparse formats and matrix-free
+  operators are handled alike. Besides the products a method costs
+  O(n m) vector work per step for a basis of m vectors, so a few
+  eigenpairs of a large matrix never need O(n^3) work or a copy of A.
+
+  The eigensolvers build an m-step Arnoldi factorization
+
+  A V = V H + f e_mT, VT V = I, H m x m upper Hessenberg
+
+  whose Ritz values, the eigenvalues of H, approximate those of A
+  from the ends of the spectrum inward. For symmetric A, H is
+  tridiagonal and this is the Lanczos process. Once the basis is
+  full it is restarted implicitly (Sorensen): the unwanted Ritz
+  values are applied as shifts of QR steps on H, which leaves a
+  shorter factorization whose starting vector has those directions
+  filtered out, with no further products.
+
+  The linear solvers find x with A x = b from the same products:
+  conjugate gradient for symmetric positive definite A, restarted
+  GMRES and BiCGSTAB for general A. A preconditioner enters the same
+  way, as a callback computing z = M^-1 r, and is applied on the right
+  for the general solvers so the residual they track is always that
+  of the original system. Jacobi and ILU(0) are provided for dense
+  matrices.
+*/
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <assert.h>
+#include <mem.h>
+#include <matrix.h>
+#include <kernels.h>
+#include <pool.h>
+#include <factorization.h>
+#include <eigen.h>
+#include <krylov.h>
+
+#define min(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a < _b ? _a : _b; })
+
+#define max(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a > _b ? _a : _b; })
+
+/* rows of a dense product computed by one task of the thread pool */
+#define MATVEC_ROWS 256
+
+/* a dense product split into blocks of rows */
+typedef struct {
+
+        Matrix A;
+        const double *x;
+        double *y;
+
+} Product;
+
+static void multiplyRows(void *_product, int block)
+{
+        Product *product = _product;
+        Matrix A = product->A;
+
+        int first = block * MATVEC_ROWS;
+        int last = min(first + MATVEC_ROWS, A->n);
+        for (int i=first; i<last; i++)
+                product->y[i] = vectorDot(A->m, mptr(A, i, 0), 1, product->x, 1);
+}
+
+/*
+  denseMatVec
+
+  MatVec for a dense Matrix given as the operator, blocks of rows run
+  on the thread pool
+*/
+void denseMatVec(void *A, const double *x, double *y)
+{
+        Product product = { A, x, y };
+
+        poolFor((product.A->n + MATVEC_ROWS - 1) / MATVEC_ROWS, multiplyRows, &product);
+}
+
+/* an Arnoldi factorization A V = V H + f eT under construction */
+typedef struct {
+
+        MatVec A;
+        void *op;
+        int n;
+        int m;
+        int symmetric;
+
+        Matrix V; /* n x (m+1), column m holds the residual f */
+        Matrix H; /* m x m */
+        double *x; /* contiguous copies for the callback */
+        double *y;
+
+} Krylov;
+
+/* column j of V minus its projections on the columns before it, twice is enough */
+static void orthogonalize(Matrix V, int j)
+{
+        for (int pass=0; pass<2; pass++)
+                for (int i=0; i<j; i++)
+                        project(V, j, V, i, -1.0, V, j, 1.0);
+}
+
+/*
+  acceptVector
+
+  normalize column j of V, already orthogonal to the columns before
+  it, and record its length in H[j][j-1]. A length that vanished
+  against scale means the basis spans an invariant subspace, so the
+  column is replaced by a random vector orthogonal to it and H[j][j-1]
+  is zero. Column m, the residual, is left unnormalized.
+*/
+static void acceptVector(Krylov *K, int j, double scale)
+{
+        if (j == K->m)
+                return;
+
+        double beta = norm('C', K->V, j);
+        if (beta <= DBL_EPSILON * scale)
+        {
+                for (int i=0; i<K->n; i++)
+                        mset(K->V, i, j, (double)rand() / RAND_MAX - 0.5);
+                orthogonalize(K->V, j);
+                beta = 0;
+        }
+
+        if (j > 0)
+                mset(K->H, j, j-1, beta);
+        normalizeColumn(K->V, j);
+}
+
+/*
+  extend
+
+  Arnoldi steps j0 .. m-1, each one product with column j of V, its
+  coefficients in the basis written to column j of H and the rest,
+  orthogonalized, becoming column j+1
+*/
+static void extend(Krylov *K, int j0)
+{
+        Matrix V = K->V;
+        Matrix H = K->H;
+
+        for (int j=j0; j<K->m; j++)
+        {
+                for (int i=0; i<K->n; i++)
+                        K->x[i] = maccess(V, i, j);
+                K->A(K->op, K->x, K->y);
+                for (int i=0; i<K->n; i++)
+                        mset(V, i, j+1, K->y[i]);
+
+                for (int i=0; i<=j; i++)
+                        mset(H, i, j, dotProduct('C', V, i, V, j+1));
+                for (int i=j+1; i<K->m; i++)
+                        mset(H, i, j, 0);
+
+                /* Lanczos, the terms outside the tridiagonal are rounding */
+                if (K->symmetric)
+                {
+                        for (int i=0; i<j-1; i++)
+                                mset(H, i, j, 0);
+                        if (j > 0)
+                                mset(H, j-1, j, maccess(H, j, j-1));
+                }
+
+                double scale = norm('C', V, j+1);
+                orthogonalize(V, j+1);
+                acceptVector(K, j+1, scale);
+        }
+}
+
+/* a Ritz value with the column it came from, for sorting */
+typedef struct {
+
+        double key;
+        double imag;
+        int index;
+
+} Ritz;
+
+/* wanted first, a conjugate pair with the positive imaginary part leading */
+static int compareRitz(const void *_a, const void *_b)
+{
+        const Ritz *a = _a;
+        const Ritz *b = _b;
+
+        if (a->key != b->key)
+                return a->key < b->key ? 1 : -1;
+        return (a->imag < b->imag) - (a->imag > b->imag);
+}
+
+/*
+  ritzPairs
+
+  eigenvalues wr + i wi of H with their vectors in Y, and order[]
+  with the Ritz values wanted first: 'L' largest real part, 'S'
+  smallest real part, 'M' largest magnitude
+
+  @return 0, or nonzero when the small eigenproblem did not converge
+*/
+static int ritzPairs(Krylov *K, char which, double *wr, double *wi, Matrix Y, int *order,
+                     Arena workspace)
+{
+        int m = K->m;
+        size_t mark = arenaMark(workspace);
+        Matrix S = arenaMatrix(workspace, m, m);
+        Ritz *ritz = arenaAlloc(workspace, m*sizeof(Ritz));
+
+        copyMatrix(K->H, S);
+
+        int info;
+        if (K->symmetric)
+        {
+                info = _symmetricEigen(S, 0, m-1, wr, Y, workspace);
+                for (int j=0; j<m; j++)
+                        wi[j] = 0;
+        }
+        else
+        {
+                info = _eigenvalueQR(S, wr, wi, Y, workspace);
+        }
+
+        for (int j=0; j<m; j++)
+        {
+                switch (which)
+                {
+                case 'S':
+                        ritz[j].key = -wr[j];
+                        break;
+                case 'M':
+                        ritz[j].key = hypot(wr[j], wi[j]);
+                        break;
+                default:
+                        ritz[j].key = wr[j];
+                        break;
+                }
+                ritz[j].imag = wi[j];
+                ritz[j].index = j;
+        }
+        qsort(ritz, m, sizeof(Ritz), compareRitz);
+        for (int j=0; j<m; j++)
+                order[j] = ritz[j].index;
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/*
+  reflect
+
+  apply the reflector I - 2 v vT / vT v on the r <= 3 rows and
+  columns p .. p+r-1 of H, accumulated into the same columns of Q,
+  with v chosen to map x onto the first of them. A zero x leaves
+  everything as it is.
+*/
+static void reflect(Matrix H, Matrix Q, int p, int r, const double *x)
+{
+        double alpha = 0;
+        for (int i=0; i<r; i++)
+                alpha = hypot(alpha, x[i]);
+        if (alpha == 0)
+                return;
+
+        double v[3];
+        for (int i=0; i<r; i++)
+                v[i] = x[i];
+        v[0] += x[0] < 0 ? -alpha : alpha;
+        double vv = 0;
+        for (int i=0; i<r; i++)
+                vv += v[i] * v[i];
+
+        for (int j=0; j<H->m; j++)
+        {
+                double d = 0;
+                for (int i=0; i<r; i++)
+                        d += v[i] * maccess(H, p+i, j);
+                for (int i=0; i<r; i++)
+                        mset(H, p+i, j, maccess(H, p+i, j) - 2 * d / vv * v[i]);
+        }
+
+        for (int i=0; i<H->n; i++)
+        {
+                double d = 0, e = 0;
+                for (int j=0; j<r; j++)
+                {
+                        d += maccess(H, i, p+j) * v[j];
+                        e += maccess(Q, i, p+j) * v[j];
+                }
+                for (int j=0; j<r; j++)
+                {
+                        mset(H, i, p+j, maccess(H, i, p+j) - 2 * d / vv * v[j]);
+                        mset(Q, i, p+j, maccess(Q, i, p+j) - 2 * e / vv * v[j]);
+                }
+        }
+}
+
+/*
+  shiftBlock
+
+  one implicit QR step on the unreduced block first .. last of H with
+  the real shift wr, or the pair wr ± i wi as a double shift: the
+  first column of (H - μI) or (H - μI)(H - conj(μ)I) sets the first
+  reflector and the bulge it leaves is chased down the block, so H
+  stays Hessenberg by construction
+*/
+static void shiftBlock(Matrix H, Matrix Q, int first, int last, double wr, double wi)
+{
+        int size = wi == 0 ? 2 : 3;
+        double x[3] = { 0, 0, 0 };
+
+        double h00 = maccess(H, first, first);
+        double h10 = maccess(H, first+1, first);
+        if (wi == 0)
+        {
+                x[0] = h00 - wr;
+                x[1] = h10;
+        }
+        else
+        {
+                x[0] = h00 * h00 + maccess(H, first, first+1) * h10 - 2 * wr * h00 + wr * wr + wi * wi;
+                x[1] = h10 * (h00 + maccess(H, first+1, first+1) - 2 * wr);
+                if (last > first+1)
+                        x[2] = h10 * maccess(H, first+2, first+1);
+        }
+
+        for (int p=first; p<last; p++)
+        {
+                int r = min(size, last-p+1);
+                if (p > first)
+                        for (int i=0; i<r; i++)
+                                x[i] = maccess(H, p+i, p-1);
+
+                reflect(H, Q, p, r, x);
+                if (p > first)
+                        for (int i=1; i<r; i++)
+                                mset(H, p+i, p-1, 0);
+        }
+}
+
+/*
+  restart
+
+  implicit restart of the m-step factorization down to kk steps. The
+  Ritz values order[kk:m] are shifts of QR steps H <- QT H Q, a
+  complex one together with its conjugate as a real double shift.
+  Each shift is applied to every unreduced block of H on its own, a
+  negligible subdiagonal being set to zero first, since a bulge
+  chased across a deflation point loses the Hessenberg form. The
+  first kk columns of V Q then span the filtered Krylov space and
+  V Q e_kk H[kk][kk-1] + f Q[m-1][kk-1] is its residual, left in
+  column kk of V for acceptVector.
+*/
+static void restart(Krylov *K, int kk, const int *order, const double *wr, const double *wi,
+                    Arena workspace)
+{
+        int n = K->n;
+        int m = K->m;
+        Matrix V = K->V;
+        Matrix H = K->H;
+
+        size_t mark = arenaMark(workspace);
+        Matrix Q = arenaMatrix(workspace, m, m);
+
+        setMatrixValues(1, 'I', Q);
+        for (int c=kk; c<m; c++)
+        {
+                int s = order[c];
+
+                for (int i=0; i+1<m; i++)
+                {
+                        double d = fabs(maccess(H, i, i)) + fabs(maccess(H, i+1, i+1));
+                        if (fabs(maccess(H, i+1, i)) <= DBL_EPSILON * d)
+                                mset(H, i+1, i, 0);
+                }
+
+                for (int first=0, last; first<m; first=last+1)
+                {
+                        for (last=first; (last+1 < m) && (maccess(H, last+1, last) != 0); last++)
+                                ;
+                        if (last > first)
+                                shiftBlock(H, Q, first, last, wr[s], wi[s]);
+                }
+
+                /* its conjugate went with it */
+                if (wi[s] != 0)
+                        c++;
+
+                /* Lanczos, the terms outside the tridiagonal are rounding */
+                if (K->symmetric)
+                {
+                        for (int i=0; i<m; i++)
+                        {
+                                for (int j=i+1; j<m; j++)
+                                        mset(H, i, j, j == i+1 ? maccess(H, j, i) : 0);
+                        }
+                }
+        }
+
+        double beta = maccess(H, kk, kk-1);
+        double sigma = maccess(Q, m-1, kk-1);
+
+        MatrixView _basis, _columns, _head;
+        Matrix W = arenaMatrix(workspace, n, kk+1);
+        multiplyMatrices(viewMatrix(V, 0, 0, n, m, &_basis), 0,
+                         viewMatrix(Q, 0, 0, m, kk+1, &_columns), 0, W, 0);
+
+        copyMatrix(viewMatrix(W, 0, 0, n, kk, &_head), viewMatrix(V, 0, 0, n, kk, &_basis));
+        for (int i=0; i<n; i++)
+                mset(V, i, kk, beta * maccess(W, i, kk) + sigma * maccess(V, i, m));
+
+        for (int i=0; i<m; i++)
+        {
+                for (int j=0; j<m; j++)
+                {
+                        if ((i >= kk) | (j >= kk))
+                                mset(H, i, j, 0);
+                }
+        }
+
+        arenaRelease(workspace, mark);
+}
+
+/* basis size given, or the default for k eigenpairs of an order n operator */
+static int basisSize(int n, int k, int m)
+{
+        return m > 0 ? m : min(n, max(2*k+1, k+KRYLOV_EXTRA));
+}
+
+/*
+  restartedKrylov
+
+  implicitly restarted Arnoldi, or Lanczos, for the k Ritz pairs
+  picked by which. A pair has converged when its residual
+  ||A x - θ x|| = ||f|| |e_mT y| is below tol |θ|. After each restart
+  a few converged pairs beyond k are kept too, which speeds up the
+  others, and a conjugate pair is never split between kept and
+  shifted.
+
+  @return number of the k pairs that did not converge
+*/
+static int restartedKrylov(Krylov *K, int k, char which, double tol,
+                           double *wr, double *wi, Matrix Z, Arena workspace)
+{
+        int n = K->n;
+        int m = K->m;
+        Matrix V = K->V;
+
+        size_t mark = arenaMark(workspace);
+        double *ritzR = arenaAlloc(workspace, 2*m*sizeof(double));
+        double *ritzI = ritzR + m;
+        int *order = arenaAlloc(workspace, m*sizeof(int));
+        Matrix Y = arenaMatrix(workspace, m, m);
+
+        if (tol <= 0)
+                tol = DBL_EPSILON;
+        double smallest = pow(DBL_EPSILON, 2.0/3);
+
+        for (int i=0; i<n; i++)
+                mset(V, i, 0, (double)rand() / RAND_MAX - 0.5);
+        normalizeColumn(V, 0);
+        setMatrixValues(0, 'V', K->H);
+
+        int start = 0;
+        int converged = 0;
+        for (int iter=0; ; iter++)
+        {
+                extend(K, start);
+
+                double beta = norm('C', V, m);
+                if (ritzPairs(K, which, ritzR, ritzI, Y, order, workspace) != 0)
+                {
+                        converged = 0;
+                        break;
+                }
+
+                double scale = 0;
+                converged = 0;
+                for (int c=0; c<m; c++)
+                {
+                        int s = order[c];
+                        double size = hypot(ritzR[s], ritzI[s]);
+                        scale = max(scale, size);
+                        if (c >= k)
+                                continue;
+
+                        /* a complex pair's vector is its two columns, real part first */
+                        int re = ritzI[s] < 0 ? s-1 : s;
+                        double last = ritzI[s] == 0 ? fabs(maccess(Y, m-1, s))
+                                : hypot(maccess(Y, m-1, re), maccess(Y, m-1, re+1));
+                        converged += beta * last <= tol * max(smallest, size);
+                }
+
+                if ((converged >= k) | (iter == KRYLOV_MAX_RESTARTS))
+                        break;
+
+                int kk = k + min(converged, (m-k)/2);
+                if (ritzI[order[kk-1]] > 0)
+                        kk = kk+1 < m ? kk+1 : kk-1;
+
+                restart(K, kk, order, ritzR, ritzI, workspace);
+                acceptVector(K, kk, scale);
+                start = kk;
+        }
+
+        /* Ritz vectors V Y of the wanted pairs, in the layout of eigenvalueQR */
+        int columns = K->symmetric ? k : k+1;
+        Matrix S = arenaMatrix(workspace, m, columns);
+        setMatrixValues(0, 'V', S);
+
+        for (int c=0; c<k; c++)
+        {
+                int s = order[c];
+                wr[c] = ritzR[s];
+                wi[c] = ritzI[s];
+                copyColumn(Y, s, S, c);
+        }
+
+        /* a pair cut by the end of the range still gets its conjugate */
+        if (!K->symmetric)
+        {
+                int s = order[k-1];
+                wr[k] = ritzI[s] > 0 ? ritzR[s] : 0;
+                wi[k] = ritzI[s] > 0 ? -ritzI[s] : 0;
+                if (ritzI[s] > 0)
+                        copyColumn(Y, s+1, S, k);
+        }
+
+        if (Z != NULL)
+        {
+                MatrixView _basis;
+                multiplyMatrices(viewMatrix(V, 0, 0, n, m, &_basis), 0, S, 0, Z, 0);
+        }
+
+        arenaRelease(workspace, mark);
+        return k - converged;
+}
+
+/* workspace bytes of restartedKrylov and the factorization it works on */
+static size_t krylovWorkspaceSize(int n, int k, int m)
+{
+        size_t ritz = arenaMatrixSize(m, m) + arenaAllocSize(m*sizeof(Ritz))
+                + max(symmetricEigenWorkspaceSize(m), eigenvalueQRWorkspaceSize(m));
+        size_t restart = arenaMatrixSize(m, m) + arenaMatrixSize(n, m);
+
+        return arenaMatrixSize(n, m+1) + arenaMatrixSize(m, m) + arenaAllocSize(2*n*sizeof(double))
+                + arenaAllocSize((k+1)*sizeof(double))
+                + arenaAllocSize(2*m*sizeof(double)) + arenaAllocSize(m*sizeof(int))
+                + arenaMatrixSize(m, m) + max(max(ritz, restart), arenaMatrixSize(m, k+1));
+}
+
+/* the factorization of an n x n operator with an m vector basis, carved from workspace */
+static Krylov krylov(MatVec A, void *op, int n, int m, int symmetric, Arena workspace)
+{
+        Krylov K = {
+                A, op, n, m, symmetric,
+                arenaMatrix(workspace, n, m+1),
+                arenaMatrix(workspace, m, m),
+                arenaAlloc(workspace, 2*n*sizeof(double)),
+                NULL
+        };
+        K.y = K.x + n;
+
+        return K;
+}
+
+/*
+  Lanczos eigenpairs
+
+  k eigenpairs of a symmetric n x n operator by implicitly restarted
+  Lanczos with full reorthogonalization, the operator given only by
+  y = A x. which picks them: 'L' largest, 'S' smallest, 'M' largest
+  magnitude, and they come back in that order. The basis of m vectors
+  (0 for max(2k+1, k+KRYLOV_EXTRA)) costs n m doubles and each restart
+  m-k products. Extremal, well separated eigenvalues converge fastest.
+
+  @param A callback computing y = A x, for example denseMatVec
+  @param op operator passed to A
+  @param n order of the operator
+  @param k eigenpairs wanted, k < m <= n
+  @param which 'L', 'S' or 'M'
+  @param m basis size, 0 for the default
+  @param tol relative residual of a converged pair, 0 for machine precision
+  @param w k eigenvalues
+  @param Z n x k orthonormal eigenvectors, or NULL
+  @param workspace arena for scratch, see lanczosEigenWorkspaceSize
+  @return 0, or the number of the k pairs that did not converge
+  within KRYLOV_MAX_RESTARTS restarts, w and Z hold their estimates
+*/
+int _lanczosEigen(MatVec A, void *op, int n, int k, char which, int m, double tol,
+                  double *w, Matrix Z, Arena workspace)
+{
+        m = basisSize(n, k, m);
+        assert((0 < k) & (k < m) & (m <= n));
+        assert((Z == NULL) || ((Z->n == n) & (Z->m == k)));
+
+        size_t mark = arenaMark(workspace);
+        Krylov K = krylov(A, op, n, m, 1, workspace);
+        double *wi = arenaAlloc(workspace, (k+1)*sizeof(double));
+
+        int info = restartedKrylov(&K, k, which, tol, w, wi, Z, workspace);
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _lanczosEigen */
+size_t lanczosEigenWorkspaceSize(int n, int k, int m)
+{
+        return krylovWorkspaceSize(n, k, basisSize(n, k, m));
+}
+
+/*
+  Lanczos eigenpairs
+
+  allocates its own workspace, see _lanczosEigen
+*/
+int lanczosEigen(MatVec A, void *op, int n, int k, char which, int m, double tol,
+                 double *w, Matrix Z)
+{
+        Arena workspace = allocArena(lanczosEigenWorkspaceSize(n, k, m));
+
+        int info = _lanczosEigen(A, op, n, k, which, m, tol, w, Z, workspace);
+
+        freeArena(workspace);
+        return info;
+}
+
+/*
+  Arnoldi eigenpairs
+
+  k eigenpairs of a general n x n operator by implicitly restarted
+  Arnoldi, as _lanczosEigen with 'L' and 'S' comparing real parts.
+  Eigenvalue c is wr[c] + i wi[c] and the vectors follow eigenvalueQR:
+  a complex pair has the real and imaginary parts of its eigenvector
+  in two consecutive columns. So that a pair is never cut in half
+  there is room for k+1 of everything: when eigenvalue k-1 opens a
+  complex pair, entry k and column k hold its conjugate, otherwise
+  they are zero.
+
+  @param A callback computing y = A x, for example denseMatVec
+  @param op operator passed to A
+  @param n order of the operator
+  @param k eigenpairs wanted, k+1 < m <= n
+  @param which 'L', 'S' or 'M'
+  @param m basis size, 0 for the default
+  @param tol relative residual of a converged pair, 0 for machine precision
+  @param wr k+1 real parts
+  @param wi k+1 imaginary parts
+  @param V n x (k+1) eigenvectors, or NULL
+  @param workspace arena for scratch, see arnoldiEigenWorkspaceSize
+  @return 0, or the number of the k pairs that did not converge
+*/
+int _arnoldiEigen(MatVec A, void *op, int n, int k, char which, int m, double tol,
+                  double *wr, double *wi, Matrix V, Arena workspace)
+{
+        m = basisSize(n, k, m);
+        assert((0 < k) & (k+1 < m) & (m <= n));
+        assert((V == NULL) || ((V->n == n) & (V->m == k+1)));
+
+        size_t mark = arenaMark(workspace);
+        Krylov K = krylov(A, op, n, m, 0, workspace);
+
+        int info = restartedKrylov(&K, k, which, tol, wr, wi, V, workspace);
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _arnoldiEigen */
+size_t arnoldiEigenWorkspaceSize(int n, int k, int m)
+{
+        return krylovWorkspaceSize(n, k, basisSize(n, k, m));
+}
+
+/*
+  Arnoldi eigenpairs
+
+  allocates its own workspace, see _arnoldiEigen
+*/
+int arnoldiEigen(MatVec A, void *op, int n, int k, char which, int m, double tol,
+                 double *wr, double *wi, Matrix V)
+{
+        Arena workspace = allocArena(arnoldiEigenWorkspaceSize(n, k, m));
+
+        int info = _arnoldiEigen(A, op, n, k, which, m, tol, wr, wi, V, workspace);
+
+        freeArena(workspace);
+        return info;
+}
+
+/*
+  formJacobi
+
+  the Jacobi preconditioner of A, the inverse of its diagonal, for
+  applyJacobi
+
+  @param A n x n matrix with a nonzero diagonal
+  @param D 1 x n target
+*/
+void formJacobi(Matrix A, Matrix D)
+{
+        assert(A->n == A->m);
+        assert((D->n == 1) & (D->m == A->n));
+
+        for (int i=0; i<A->n; i++)
+        {
+                assert(maccess(A, i, i) != 0);
+                mset(D, 0, i, 1 / maccess(A, i, i));
+        }
+}
+
+/* Preconditioner for the 1 x n inverse diagonal from formJacobi, z = D r */
+void applyJacobi(void *D, const double *r, double *z)
+{
+        Matrix d = D;
+        const double *inverse = mptr(d, 0, 0);
+
+        for (int i=0; i<d->m; i++)
+                z[i] = inverse[i] * r[i];
+}
+
+/*
+  incompleteLU
+
+  ILU(0) in place: the LU factorization of A with every update that
+  would fill in a zero of A dropped, so L and U keep the sparsity of A.
+  The unit lower L is stored below the diagonal and U on and above it,
+  as in LUDecomposition.
+
+  @param A n x n matrix, overwritten with the factors
+  @return 0, or i+1 when pivot i is zero
+*/
+int incompleteLU(Matrix A)
+{
+        assert(A->n == A->m);
+        int n = A->n;
+
+        for (int i=0; i<n; i++)
+        {
+                double *row = mptr(A, i, 0);
+
+                for (int k=0; k<i; k++)
+                {
+                        if (row[k] == 0)
+                                continue;
+
+                        const double *pivot = mptr(A, k, 0);
+                        row[k] /= pivot[k];
+                        for (int j=k+1; j<n; j++)
+                                if (row[j] != 0)
+                                        row[j] -= row[k] * pivot[j];
+                }
+
+                if (row[i] == 0)
+                        return i+1;
+        }
+
+        return 0;
+}
+
+/* Preconditioner for the factors from incompleteLU, z = U^-1 L^-1 r */
+void applyIncompleteLU(void *LU, const double *r, double *z)
+{
+        Matrix F = LU;
+        int n = F->n;
+
+        for (int i=0; i<n; i++)
+                z[i] = r[i] - vectorDot(i, mptr(F, i, 0), 1, z, 1);
+
+        for (int i=n-1; i>=0; i--)
+                z[i] = (z[i] - vectorDot(n-i-1, mptr(F, i, i+1), 1, z+i+1, 1))
+                        / maccess(F, i, i);
+}
+
+/* z = M^-1 r, a copy when there is no preconditioner */
+static void precondition(Preconditioner M, void *pre, int n, const double *r, double *z)
+{
+        if (M != NULL)
+                M(pre, r, z);
+        else
+                for (int i=0; i<n; i++)
+                        z[i] = r[i];
+}
+
+/* r = b - A x */
+static void residual(MatVec A, void *op, int n, const double *b, const double *x, double *r)
+{
+        A(op, x, r);
+        for (int i=0; i<n; i++)
+                r[i] = b[i] - r[i];
+}
+
+/* the convergence bookkeeping shared by the linear solvers */
+typedef struct {
+
+        double target; /* tol times the norm of b */
+        double scale; /* 1 / norm of b */
+        int maxit;
+        double *history;
+        int *iterations;
+
+} Progress;
+
+static Progress progress(int n, const double *b, double tol, int maxit, double *history,
+                         int *iterations)
+{
+        double bnorm = sqrt(vectorDot(n, b, 1, b, 1));
+
+        Progress P = {
+                (tol > 0 ? tol : KRYLOV_TOLERANCE) * bnorm,
+                bnorm > 0 ? 1 / bnorm : 1,
+                maxit > 0 ? maxit : n,
+                history,
+                iterations
+        };
+
+        return P;
+}
+
+/* record the residual norm after iteration it, nonzero once it is small enough */
+static int report(Progress *P, int it, double rnorm)
+{
+        if (P->history != NULL)
+                P->history[it] = rnorm * P->scale;
+        if (P->iterations != NULL)
+                *P->iterations = it;
+
+        return rnorm <= P->target;
+}
+
+/* b = 0 has the solution x = 0, which no iteration from another x would reach exactly */
+static int zeroRightHandSide(Progress *P, int n, double *x)
+{
+        if (P->target > 0)
+                return 0;
+
+        for (int i=0; i<n; i++)
+                x[i] = 0;
+        report(P, 0, 0);
+        return 1;
+}
+
+/*
+  Conjugate gradient
+
+  solves A x = b for symmetric positive definite A, each iteration one
+  product, one preconditioner application and O(n) vector work. The
+  preconditioner must be symmetric positive definite too, and the
+  convergence rate depends on the condition number of M^-1 A.
+
+  @param A callback computing y = A x, for example denseMatVec
+  @param op operator passed to A
+  @param n order of the system
+  @param b right hand side
+  @param x initial guess, overwritten with the solution
+  @param M callback computing z = M^-1 r, or NULL for none
+  @param pre preconditioner passed to M
+  @param tol relative residual |b - A x| / |b| to reach, 0 for KRYLOV_TOLERANCE
+  @param maxit iteration limit, 0 for n
+  @param history maxit+1 relative residuals, the initial one first, or NULL
+  @param iterations iterations done, or NULL
+  @param workspace arena for scratch, see conjugateGradientWorkspaceSize
+  @return SOLVE_CONVERGED, SOLVE_MAX_ITERATIONS or SOLVE_BREAKDOWN
+*/
+int _conjugateGradient(MatVec A, void *op, int n, const double *b, double *x,
+                       Preconditioner M, void *pre, double tol, int maxit,
+                       double *history, int *iterations, Arena workspace)
+{
+        Progress P = progress(n, b, tol, maxit, history, iterations);
+        if (zeroRightHandSide(&P, n, x))
+                return SOLVE_CONVERGED;
+
+        size_t mark = arenaMark(workspace);
+        double *r = arenaAlloc(workspace, n*sizeof(double));
+        double *z = arenaAlloc(workspace, n*sizeof(double));
+        double *p = arenaAlloc(workspace, n*sizeof(double));
+        double *q = arenaAlloc(workspace, n*sizeof(double));
+
+        residual(A, op, n, b, x, r);
+        int info = report(&P, 0, sqrt(vectorDot(n, r, 1, r, 1))) ? SOLVE_CONVERGED
+                : SOLVE_MAX_ITERATIONS;
+
+        precondition(M, pre, n, r, z);
+        for (int i=0; i<n; i++)
+                p[i] = z[i];
+        double rz = vectorDot(n, r, 1, z, 1);
+
+        for (int it=1; (it<=P.maxit) & (info != SOLVE_CONVERGED); it++)
+        {
+                A(op, p, q);
+                double pq = vectorDot(n, p, 1, q, 1);
+                if (pq == 0)
+                {
+                        info = SOLVE_BREAKDOWN;
+                        break;
+                }
+
+                double alpha = rz / pq;
+                vectorAxpy(n, alpha, p, 1, x, 1);
+                vectorAxpy(n, -alpha, q, 1, r, 1);
+
+                if (report(&P, it, sqrt(vectorDot(n, r, 1, r, 1))))
+                {
+                        info = SOLVE_CONVERGED;
+                        break;
+                }
+
+                precondition(M, pre, n, r, z);
+                double _rz = vectorDot(n, r, 1, z, 1);
+                double beta = _rz / rz;
+                rz = _rz;
+
+                /* p = z + beta p */
+                vectorScale(n, beta, p, 1);
+                vectorAxpy(n, 1, z, 1, p, 1);
+        }
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _conjugateGradient */
+size_t conjugateGradientWorkspaceSize(int n)
+{
+        return 4 * arenaAllocSize(n*sizeof(double));
+}
+
+/*
+  Conjugate gradient
+
+  allocates its own workspace, see _conjugateGradient
+*/
+int conjugateGradient(MatVec A, void *op, int n, const double *b, double *x,
+                      Preconditioner M, void *pre, double tol, int maxit,
+                      double *history, int *iterations)
+{
+        Arena workspace = allocArena(conjugateGradientWorkspaceSize(n));
+
+        int info = _conjugateGradient(A, op, n, b, x, M, pre, tol, maxit,
+                                      history, iterations, workspace);
+
+        freeArena(workspace);
+        return info;
+}
+
+/* a plane rotation taking (a, b) to (r, 0) */
+static void givens(double a, double b, double *c, double *s)
+{
+        double r = hypot(a, b);
+
+        *c = r > 0 ? a / r : 1;
+        *s = r > 0 ? b / r : 0;
+}
+
+/*
+  Restarted GMRES
+
+  solves A x = b for general A by GMRES(m): up to m Arnoldi steps
+  minimize the residual over the Krylov space, then x is updated and
+  the basis restarted from the new residual. The least squares problem
+  on the Hessenberg matrix is kept triangular by Givens rotations, so
+  its residual, which equals that of x, is known at every step without
+  forming x. Preconditioning is on the right, A M^-1 u = b with x =
+  M^-1 u. The basis costs n (m+1) doubles and every step
+  orthogonalizes against all of it, so larger m converges in fewer
+  products but at more vector work per product.
+
+  @param A callback computing y = A x, for example denseMatVec
+  @param op operator passed to A
+  @param n order of the system
+  @param b right hand side
+  @param x initial guess, overwritten with the solution
+  @param M callback computing z = M^-1 r, or NULL for none
+  @param pre preconditioner passed to M
+  @param m basis size between restarts, 0 for GMRES_RESTART
+  @param tol relative residual |b - A x| / |b| to reach, 0 for KRYLOV_TOLERANCE
+  @param maxit iteration limit counting every step, 0 for n
+  @param history maxit+1 relative residuals, the initial one first, or NULL
+  @param iterations iterations done, or NULL
+  @param workspace arena for scratch, see GMRESWorkspaceSize
+  @return SOLVE_CONVERGED or SOLVE_MAX_ITERATIONS
+*/
+int _GMRES(MatVec A, void *op, int n, const double *b, double *x,
+           Preconditioner M, void *pre, int m, double tol, int maxit,
+           double *history, int *iterations, Arena workspace)
+{
+        Progress P = progress(n, b, tol, maxit, history, iterations);
+        if (zeroRightHandSide(&P, n, x))
+                return SOLVE_CONVERGED;
+        if (m <= 0)
+                m = GMRES_RESTART;
+        m = min(m, n);
+
+        size_t mark = arenaMark(workspace);
+        Matrix V = arenaMatrix(workspace, m+1, n); /* basis vectors as rows */
+        Matrix H = arenaMatrix(workspace, m+1, m);
+        double *z = arenaAlloc(workspace, n*sizeof(double));
+        double *w = arenaAlloc(workspace, n*sizeof(double));
+        double *g = arenaAlloc(workspace, 3*(m+1)*sizeof(double));
+        double *c = g + m + 1;
+        double *s = c + m + 1;
+
+        int info = SOLVE_MAX_ITERATIONS;
+        int it = 0;
+        while (1)
+        {
+                double *v = mptr(V, 0, 0);
+                residual(A, op, n, b, x, v);
+                double beta = sqrt(vectorDot(n, v, 1, v, 1));
+
+                /* only the first restart records, later ones match the last step */
+                if (((it == 0) && report(&P, 0, beta)) || (beta == 0))
+                        info = SOLVE_CONVERGED;
+                if ((info == SOLVE_CONVERGED) | (it >= P.maxit))
+                        break;
+
+                vectorScale(n, 1 / beta, v, 1);
+                g[0] = beta;
+
+                int j = 0;
+                while ((j < m) & (it < P.maxit) & (info != SOLVE_CONVERGED))
+                {
+                        precondition(M, pre, n, mptr(V, j, 0), z);
+                        A(op, z, w);
+
+                        /* Gram-Schmidt against the basis, twice is enough */
+                        for (int i=0; i<=j; i++)
+                                mset(H, i, j, 0);
+                        for (int pass=0; pass<2; pass++)
+                                for (int i=0; i<=j; i++)
+                                {
+                                        double h = vectorDot(n, mptr(V, i, 0), 1, w, 1);
+                                        vectorAxpy(n, -h, mptr(V, i, 0), 1, w, 1);
+                                        mset(H, i, j, maccess(H, i, j) + h);
+                                }
+
+                        double h = sqrt(vectorDot(n, w, 1, w, 1));
+                        mset(H, j+1, j, h);
+                        double *next = mptr(V, j+1, 0);
+                        for (int i=0; i<n; i++)
+                                next[i] = h > 0 ? w[i] / h : 0;
+
+                        /* the earlier rotations, then one that zeroes H[j+1][j] */
+                        for (int i=0; i<j; i++)
+                        {
+                                double a = maccess(H, i, j);
+                                double d = maccess(H, i+1, j);
+                                mset(H, i, j, c[i] * a + s[i] * d);
+                                mset(H, i+1, j, c[i] * d - s[i] * a);
+                        }
+                        givens(maccess(H, j, j), h, c+j, s+j);
+                        mset(H, j, j, c[j] * maccess(H, j, j) + s[j] * h);
+                        mset(H, j+1, j, 0);
+
+                        g[j+1] = -s[j] * g[j];
+                        g[j] = c[j] * g[j];
+
+                        j++;
+                        it++;
+
+                        /* h = 0 means the space is invariant and the solution is in it */
+                        if (report(&P, it, fabs(g[j])) | (h == 0))
+                                info = SOLVE_CONVERGED;
+                }
+
+                /* x = x + M^-1 V y for the triangular H y = g */
+                for (int i=j-1; i>=0; i--)
+                {
+                        double y = g[i];
+                        for (int l=i+1; l<j; l++)
+                                y -= maccess(H, i, l) * g[l];
+                        g[i] = y / maccess(H, i, i);
+                }
+
+                for (int i=0; i<n; i++)
+                        w[i] = 0;
+                for (int i=0; i<j; i++)
+                        vectorAxpy(n, g[i], mptr(V, i, 0), 1, w, 1);
+                precondition(M, pre, n, w, z);
+                vectorAxpy(n, 1, z, 1, x, 1);
+
+                if ((info == SOLVE_CONVERGED) | (it >= P.maxit))
+                        break;
+        }
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _GMRES */
+size_t GMRESWorkspaceSize(int n, int m)
+{
+        if (m <= 0)
+                m = GMRES_RESTART;
+        m = min(m, n);
+
+        return arenaMatrixSize(m+1, n) + arenaMatrixSize(m+1, m)
+                + 2 * arenaAllocSize(n*sizeof(double))
+                + arenaAllocSize(3*(m+1)*sizeof(double));
+}
+
+/*
+  Restarted GMRES
+
+  allocates its own workspace, see _GMRES
+*/
+int GMRES(MatVec A, void *op, int n, const double *b, double *x,
+          Preconditioner M, void *pre, int m, double tol, int maxit,
+          double *history, int *iterations)
+{
+        Arena workspace = allocArena(GMRESWorkspaceSize(n, m));
+
+        int info = _GMRES(A, op, n, b, x, M, pre, m, tol, maxit,
+                          history, iterations, workspace);
+
+        freeArena(workspace);
+        return info;
+}
+
+/*
+  BiCGSTAB
+
+  solves A x = b for general A by the stabilized biconjugate gradient
+  method of van der Vorst. Each iteration costs two products and two
+  preconditioner applications with a fixed n doubles of memory, unlike
+  GMRES whose basis grows with m. The residual is not monotone and the
+  method stops with SOLVE_BREAKDOWN if one of its recurrences divides
+  by zero, in which case x holds the last iterate. Preconditioning is
+  on the right.
+
+  @param A callback computing y = A x, for example denseMatVec
+  @param op operator passed to A
+  @param n order of the system
+  @param b right hand side
+  @param x initial guess, overwritten with the solution
+  @param M callback computing z = M^-1 r, or NULL for none
+  @param pre preconditioner passed to M
+  @param tol relative residual |b - A x| / |b| to reach, 0 for KRYLOV_TOLERANCE
+  @param maxit iteration limit, 0 for n
+  @param history maxit+1 relative residuals, the initial one first, or NULL
+  @param iterations iterations done, or NULL
+  @param workspace arena for scratch, see BiCGSTABWorkspaceSize
+  @return SOLVE_CONVERGED, SOLVE_MAX_ITERATIONS or SOLVE_BREAKDOWN
+*/
+int _BiCGSTAB(MatVec A, void *op, int n, const double *b, double *x,
+              Preconditioner M, void *pre, double tol, int maxit,
+              double *history, int *iterations, Arena workspace)
+{
+        Progress P = progress(n, b, tol, maxit, history, iterations);
+        if (zeroRightHandSide(&P, n, x))
+                return SOLVE_CONVERGED;
+
+        size_t mark = arenaMark(workspace);
+        double *r = arenaAlloc(workspace, n*sizeof(double));
+        double *r0 = arenaAlloc(workspace, n*sizeof(double));
+        double *p = arenaAlloc(workspace, n*sizeof(double));
+        double *v = arenaAlloc(workspace, n*sizeof(double));
+        double *y = arenaAlloc(workspace, n*sizeof(double));
+        double *t = arenaAlloc(workspace, n*sizeof(double));
+
+        residual(A, op, n, b, x, r);
+        int info = report(&P, 0, sqrt(vectorDot(n, r, 1, r, 1))) ? SOLVE_CONVERGED
+                : SOLVE_MAX_ITERATIONS;
+
+        for (int i=0; i<n; i++)
+        {
+                r0[i] = r[i];
+                p[i] = 0;
+                v[i] = 0;
+        }
+        double rho = 1, alpha = 1, omega = 1;
+
+        for (int it=1; (it<=P.maxit) & (info != SOLVE_CONVERGED); it++)
+        {
+                double _rho = vectorDot(n, r0, 1, r, 1);
+                if (_rho == 0)
+                {
+                        info = SOLVE_BREAKDOWN;
+                        break;
+                }
+
+                /* p = r + beta (p - omega v) */
+                double beta = (_rho / rho) * (alpha / omega);
+                rho = _rho;
+                vectorAxpy(n, -omega, v, 1, p, 1);
+                vectorScale(n, beta, p, 1);
+                vectorAxpy(n, 1, r, 1, p, 1);
+
+                precondition(M, pre, n, p, y);
+                A(op, y, v);
+                double r0v = vectorDot(n, r0, 1, v, 1);
+                if (r0v == 0)
+                {
+                        info = SOLVE_BREAKDOWN;
+                        break;
+                }
+                alpha = rho / r0v;
+
+                /* the half step, r becomes s = r - alpha v */
+                vectorAxpy(n, alpha, y, 1, x, 1);
+                vectorAxpy(n, -alpha, v, 1, r, 1);
+
+                double snorm = sqrt(vectorDot(n, r, 1, r, 1));
+                if (snorm <= P.target)
+                {
+                        report(&P, it, snorm);
+                        info = SOLVE_CONVERGED;
+                        break;
+                }
+
+                precondition(M, pre, n, r, y);
+                A(op, y, t);
+                double tt = vectorDot(n, t, 1, t, 1);
+                omega = tt > 0 ? vectorDot(n, t, 1, r, 1) / tt : 0;
+
+                vectorAxpy(n, omega, y, 1, x, 1);
+                vectorAxpy(n, -omega, t, 1, r, 1);
+
+                if (report(&P, it, sqrt(vectorDot(n, r, 1, r, 1))))
+                        info = SOLVE_CONVERGED;
+                else if (omega == 0)
+                        info = SOLVE_BREAKDOWN;
+
+                if (info == SOLVE_BREAKDOWN)
+                        break;
+        }
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _BiCGSTAB */
+size_t BiCGSTABWorkspaceSize(int n)
+{
+        return 6 * arenaAllocSize(n*sizeof(double));
+}
+
+/*
+  BiCGSTAB
+
+  allocates its own workspace, see _BiCGSTAB
+*/
+int BiCGSTAB(MatVec A, void *op, int n, const double *b, double *x,
+             Preconditioner M, void *pre, double tol, int maxit,
+             double *history, int *iterations)
+{
+        Arena workspace = allocArena(BiCGSTABWorkspaceSize(n));
+
+        int info = _BiCGSTAB(A, op, n, b, x, M, pre, tol, maxit,
+                             history, iterations, workspace);
+
+        freeArena(workspace);
+        return info;
+}
@@ -4,11 +4,17 @@
   QR Decomposition
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include <mem.h>
 #include <matrix.h>
 #include <factorization.h>
+#include <tiled.h>
+#include <eigen.h>
+#include <svd.h>
+#include <krylov.h>
+#include <tsqr.h>
 #include <estimation.h>
 #include <precision.h>
 
@@ -24,12 +30,25 @@ void printHelp(char message[])
                 "Commands:\n"
                 "---------\n\n"
                 "qrhh: QR factorization with Householder reduction\n"
+                "qrhhb: blocked QR factorization with Householder reduction\n"
                 "qrgs: QR factorization with Gram-Schmidt method\n"
+                "qrgsb: blocked QR factorization with reorthogonalized Gram-Schmidt\n"
                 "lu: LU factorization\n"
                 "plu: LU factorization with pivoting\n"
+                "plub: blocked LU factorization with pivoting\n"
+                "chol: Cholesky factorization of a symmetric positive definite matrix\n"
+                "tiled: Tiled LU, Cholesky and QR against their blocked counterparts\n"
+                "eig: Eigenvalues and eigenvectors with Hessenberg QR\n"
+                "seig: Symmetric eigenvalues and eigenvectors with divide and conquer\n"
+                "svd: Singular value decomposition with parallel one-sided Jacobi\n"
+                "rsvd: Randomized rank 2 approximation of a rank 2 matrix\n"
+                "krylov: Lanczos and Arnoldi eigenpairs against the dense eigensolvers\n"
+                "iter: CG, GMRES and BiCGSTAB with Jacobi and ILU(0) preconditioners\n"
                 "gj: Gauss Jordan with pivots\n"
+                "inv: Matrix inverse from LU\n"
                 "bs: Back substitution\n"
-                "ols: Ordinary least squares\n\n"
+                "ols: Ordinary least squares\n"
+                "olsb: Ordinary least squares of a tall system split into TSQR blocks\n\n"
                 "Options:\n"
                 "--------\n\n"
                 "-v: verbose\n\n"
@@ -55,9 +74,15 @@ void qr(char method, int debug)
         case 'h':
                 hhReflectionsQR(A, QR, debug);
                 break;
+        case 'b':
+                hhReflectionsQRBlocked(A, QR, 2, debug);
+                break;
         case 'g':
                 gramSchmidtQR(A, QR, debug);
                 break;
+        case 'c':
+                blockGramSchmidtQR(A, QR, 2, debug);
+                break;
         }
 
         printf("Q=\n");
@@ -103,7 +128,10 @@ void lu(int pivot, int debug)
                 LU[2] = popMatrixStack(stack);
                 PA = popMatrixStack(stack);
 
-                PLUDecomposition(A, LU, debug);
+                if (pivot == 2)
+                        PLUDecompositionBlocked(A, LU, 4, debug);
+                else
+                        PLUDecomposition(A, LU, debug);
 
                 printf("P=\n");
                 drawMatrix(LU[0]);
@@ -141,6 +169,589 @@ void lu(int pivot, int debug)
 
 }
 
+void chol(int debug)
+{
+        Matrix M = allocMatrix(SIZE_N, SIZE_N);
+        Matrix A = allocMatrix(SIZE_N, SIZE_N);
+        Matrix L = allocMatrix(SIZE_N, SIZE_N);
+        Matrix _A = allocMatrix(SIZE_N, SIZE_N);
+
+        /* MT M plus the identity is symmetric positive definite */
+        setMatrixValues(RANGE, METHOD, M);
+        multiplyMatrices(M, 1, M, 0, A, 0);
+        for (int i=0; i<SIZE_N; i++)
+                mset(A, i, i, maccess(A, i, i) + 1);
+
+        printf("A=\n");
+        drawMatrix(A);
+
+        copyMatrix(A, L);
+        int info = choleskyDecompositionInPlace(L, 2);
+        if (info != 0)
+                printf("not positive definite at row %d\n", info-1);
+
+        for (int i=0; i<SIZE_N; i++)
+                for (int j=i+1; j<SIZE_N; j++)
+                        mset(L, i, j, 0);
+
+        printf("L=\n");
+        drawMatrix(L);
+
+        multiplyMatrices(L, 0, L, 1, _A, 0);
+
+        if (debug)
+        {
+                printf("LLT=\n");
+                drawMatrix(_A);
+        }
+
+        double stats[2];
+        matrixComparison(A, _A, stats);
+        printf("Mean Error = %.16lf\n", stats[0]);
+        printf("Max Error = %.16lf\n", stats[1]);
+
+        freeMatrix(M);
+        freeMatrix(A);
+        freeMatrix(L);
+        freeMatrix(_A);
+}
+
+/* print how far two results that should agree are apart */
+static void printComparison(const char *name, Matrix A, Matrix B)
+{
+        double stats[2];
+        matrixComparison(A, B, stats);
+        printf("%s\n", name);
+        printf("Mean Error = %.16lf\n", stats[0]);
+        printf("Max Error = %.16lf\n", stats[1]);
+}
+
+void tiled(int debug)
+{
+        /* sizes that are not multiples of the tile, so the edge tiles are ragged */
+        const int n = 300;
+        const int m = 250;
+        const int nb = 64;
+
+        Matrix A = allocMatrix(n, m);
+        Matrix X = allocMatrix(n, m);
+        Matrix Y = allocMatrix(n, m);
+        Matrix M = allocMatrix(m, m);
+        Matrix S = allocMatrix(m, m);
+        Matrix L = allocMatrix(m, m);
+        int *ipiv = malloc(m*sizeof(int));
+        int *_ipiv = malloc(m*sizeof(int));
+        double *tau = malloc(tiledQRTauSize(n, m, nb)*sizeof(double));
+
+        setMatrixValues(RANGE, METHOD, A);
+
+        /* LU, the tiles against the blocked LU */
+        copyMatrix(A, X);
+        copyMatrix(A, Y);
+        tiledLU(X, ipiv, nb);
+        PLUDecompositionInPlace(Y, _ipiv, nb);
+
+        int same = 1;
+        for (int i=0; i<m; i++)
+                same &= ipiv[i] == _ipiv[i];
+        if (!same)
+                printf("LU pivots differ\n");
+        printComparison("LU:", X, Y);
+
+        /* Cholesky of MT M + m I */
+        setMatrixValues(RANGE, METHOD, M);
+        multiplyMatrices(M, 1, M, 0, S, 0);
+        for (int i=0; i<m; i++)
+                mset(S, i, i, maccess(S, i, i) + m);
+        copyMatrix(S, L);
+
+        if ((tiledCholesky(S, nb) != 0) | (choleskyDecompositionInPlace(L, nb) != 0))
+                printf("not positive definite\n");
+        printComparison("Cholesky:", S, L);
+
+        /* QR, QT A is R over zeros and Q QT A is A again */
+        copyMatrix(A, X);
+        tiledQR(X, tau, nb);
+
+        copyMatrix(A, Y);
+        tiledApplyQ(X, tau, nb, Y, 1);
+
+        Matrix R = allocMatrix(n, m);
+        copyMatrix(X, R);
+        for (int i=0; i<n; i++)
+                for (int j=0; (j<i) & (j<m); j++)
+                        mset(R, i, j, 0);
+
+        if (debug)
+        {
+                printf("R=\n");
+                drawMatrix(R);
+        }
+        printComparison("QR, QTA against R:", Y, R);
+        freeMatrix(R);
+
+        tiledApplyQ(X, tau, nb, Y, 0);
+        printComparison("QR, QQTA against A:", Y, A);
+
+        freeMatrix(A);
+        freeMatrix(X);
+        freeMatrix(Y);
+        freeMatrix(M);
+        freeMatrix(S);
+        freeMatrix(L);
+        free(ipiv);
+        free(_ipiv);
+        free(tau);
+}
+
+void eig(int debug)
+{
+        Matrix A = allocMatrix(SIZE_N, SIZE_N);
+        Matrix H = allocMatrix(SIZE_N, SIZE_N);
+        Matrix V = allocMatrix(SIZE_N, SIZE_N);
+        Matrix D = allocMatrix(SIZE_N, SIZE_N);
+        Matrix AV = allocMatrix(SIZE_N, SIZE_N);
+        Matrix VD = allocMatrix(SIZE_N, SIZE_N);
+        double wr[SIZE_N], wi[SIZE_N];
+
+        setMatrixValues(RANGE, METHOD, A);
+
+        printf("A=\n");
+        drawMatrix(A);
+
+        copyMatrix(A, H);
+        int info = eigenvalueQR(H, wr, wi, V);
+        if (info != 0)
+        {
+                printf("eigenvalue %d did not converge\n", info-1);
+                return;
+        }
+
+        printf("eigenvalues=\n");
+        for (int j=0; j<SIZE_N; j++)
+        {
+                if (wi[j] == 0)
+                        printf("%f\n", wr[j]);
+                else
+                        printf("%f %+fi\n", wr[j], wi[j]);
+        }
+
+        printf("V=\n");
+        drawMatrix(V);
+
+        /* real block diagonal D, a complex pair is a 2 x 2 rotation block */
+        setMatrixValues(0, 'V', D);
+        for (int j=0; j<SIZE_N; j++)
+        {
+                mset(D, j, j, wr[j]);
+                if (wi[j] > 0)
+                        mset(D, j, j+1, wi[j]);
+                else if (wi[j] < 0)
+                        mset(D, j, j-1, wi[j]);
+        }
+
+        multiplyMatrices(A, 0, V, 0, AV, 0);
+        multiplyMatrices(V, 0, D, 0, VD, 0);
+
+        if (debug)
+        {
+                printf("AV=\n");
+                drawMatrix(AV);
+                printf("VD=\n");
+                drawMatrix(VD);
+        }
+
+        double stats[2];
+        matrixComparison(AV, VD, stats);
+        printf("Mean Error = %.16lf\n", stats[0]);
+        printf("Max Error = %.16lf\n", stats[1]);
+
+        freeMatrix(A);
+        freeMatrix(H);
+        freeMatrix(V);
+        freeMatrix(D);
+        freeMatrix(AV);
+        freeMatrix(VD);
+}
+
+void seig(int debug)
+{
+        Matrix M = allocMatrix(SIZE_N, SIZE_N);
+        Matrix A = allocMatrix(SIZE_N, SIZE_N);
+        Matrix H = allocMatrix(SIZE_N, SIZE_N);
+        Matrix Z = allocMatrix(SIZE_N, SIZE_N);
+        Matrix AZ = allocMatrix(SIZE_N, SIZE_N);
+        double w[SIZE_N];
+
+        /* M plus MT is symmetric */
+        setMatrixValues(RANGE, METHOD, M);
+        transposeMatrix(M, A);
+        addMatrix(A, M);
+
+        printf("A=\n");
+        drawMatrix(A);
+
+        copyMatrix(A, H);
+        if (symmetricEigen(H, 0, SIZE_N-1, w, Z) != 0)
+        {
+                printf("eigenvalues did not converge\n");
+                return;
+        }
+
+        printf("eigenvalues=\n");
+        for (int j=0; j<SIZE_N; j++)
+                printf("%f\n", w[j]);
+
+        printf("Z=\n");
+        drawMatrix(Z);
+
+        multiplyMatrices(A, 0, Z, 0, AZ, 0);
+        for (int j=0; j<SIZE_N; j++)
+                scaleColumn(Z, j, w[j]);
+
+        if (debug)
+        {
+                printf("AZ=\n");
+                drawMatrix(AZ);
+                printf("ZL=\n");
+                drawMatrix(Z);
+        }
+
+        double stats[2];
+        matrixComparison(AZ, Z, stats);
+        printf("Mean Error = %.16lf\n", stats[0]);
+        printf("Max Error = %.16lf\n", stats[1]);
+
+        freeMatrix(M);
+        freeMatrix(A);
+        freeMatrix(H);
+        freeMatrix(Z);
+        freeMatrix(AZ);
+}
+
+void svd(int debug)
+{
+        Matrix A = allocMatrix(SIZE_N, SIZE_M);
+        Matrix U = allocMatrix(SIZE_N, SIZE_M);
+        Matrix V = allocMatrix(SIZE_M, SIZE_M);
+        Matrix _A = allocMatrix(SIZE_N, SIZE_M);
+        double s[SIZE_M];
+
+        setMatrixValues(RANGE, METHOD, A);
+
+        printf("A=\n");
+        drawMatrix(A);
+
+        if (singularValueDecomposition(A, s, U, V) != 0)
+        {
+                printf("singular values did not converge\n");
+                return;
+        }
+
+        printf("singular values=\n");
+        for (int j=0; j<SIZE_M; j++)
+                printf("%f\n", s[j]);
+
+        printf("U=\n");
+        drawMatrix(U);
+        printf("V=\n");
+        drawMatrix(V);
+
+        /* U S VT */
+        for (int j=0; j<SIZE_M; j++)
+                scaleColumn(U, j, s[j]);
+        multiplyMatrices(U, 0, V, 1, _A, 0);
+
+        if (debug)
+        {
+                printf("USVT=\n");
+                drawMatrix(_A);
+        }
+
+        double stats[2];
+        matrixComparison(A, _A, stats);
+        printf("Mean Error = %.16lf\n", stats[0]);
+        printf("Max Error = %.16lf\n", stats[1]);
+
+        freeMatrix(A);
+        freeMatrix(U);
+        freeMatrix(V);
+        freeMatrix(_A);
+}
+
+void rsvd(int debug)
+{
+        const int k = 2;
+        Matrix B = allocMatrix(SIZE_N, k);
+        Matrix C = allocMatrix(k, SIZE_M);
+        Matrix A = allocMatrix(SIZE_N, SIZE_M);
+        Matrix U = allocMatrix(SIZE_N, k);
+        Matrix V = allocMatrix(SIZE_M, k);
+        Matrix _A = allocMatrix(SIZE_N, SIZE_M);
+        double s[k];
+
+        /* BC has rank k, so the rank k approximation is exact */
+        setMatrixValues(RANGE, METHOD, B);
+        setMatrixValues(RANGE, METHOD, C);
+        multiplyMatrices(B, 0, C, 0, A, 0);
+
+        printf("A=\n");
+        drawMatrix(A);
+
+        if (randomizedSVD(A, k, -1, -1, s, U, V) != 0)
+        {
+                printf("singular values did not converge\n");
+                return;
+        }
+
+        printf("singular values=\n");
+        for (int j=0; j<k; j++)
+                printf("%f\n", s[j]);
+
+        printf("U=\n");
+        drawMatrix(U);
+        printf("V=\n");
+        drawMatrix(V);
+
+        for (int j=0; j<k; j++)
+                scaleColumn(U, j, s[j]);
+        multiplyMatrices(U, 0, V, 1, _A, 0);
+
+        if (debug)
+        {
+                printf("USVT=\n");
+                drawMatrix(_A);
+        }
+
+        double stats[2];
+        matrixComparison(A, _A, stats);
+        printf("Mean Error = %.16lf\n", stats[0]);
+        printf("Max Error = %.16lf\n", stats[1]);
+
+        freeMatrix(B);
+        freeMatrix(C);
+        freeMatrix(A);
+        freeMatrix(U);
+        freeMatrix(V);
+        freeMatrix(_A);
+}
+
+/* how wanted an eigenvalue is for which, larger first */
+static double wanted(char which, double re, double im)
+{
+        if (which == 'L')
+                return re;
+        if (which == 'S')
+                return -re;
+        return hypot(re, im);
+}
+
+/* order[0..n-1] indexes wr, wi from most to least wanted */
+static void wantedOrder(char which, int n, const double *wr, const double *wi, int *order)
+{
+        for (int i=0; i<n; i++)
+        {
+                int j = i;
+                while ((j > 0) && (wanted(which, wr[order[j-1]], wi[order[j-1]])
+                                   < wanted(which, wr[i], wi[i])))
+                {
+                        order[j] = order[j-1];
+                        j--;
+                }
+                order[j] = i;
+        }
+}
+
+/*
+  compare k Krylov eigenvalues with the k most wanted of a dense
+  solver, each one against the nearest of those, and print the
+  residual of A V = V L, L block diagonal with a 2 x 2 block per
+  complex pair as in eigenvalueQR
+*/
+static void krylovReport(const char *name, char which, Matrix A, int k,
+                         const double *wr, const double *wi, Matrix V,
+                         const double *_wr, const double *_wi)
+{
+        int n = A->n;
+        int order[n];
+        wantedOrder(which, n, _wr, _wi, order);
+
+        double error = 0;
+        for (int c=0; c<k; c++)
+        {
+                double nearest = INFINITY;
+                for (int i=0; i<k; i++)
+                        nearest = fmin(nearest, hypot(wr[c] - _wr[order[i]], wi[c] - _wi[order[i]]));
+                error = fmax(error, nearest);
+        }
+
+        Matrix L = allocMatrix(V->m, V->m);
+        Matrix AV = allocMatrix(n, V->m);
+        Matrix VL = allocMatrix(n, V->m);
+
+        setMatrixValues(0, 'V', L);
+        for (int c=0; c<V->m; c++)
+        {
+                mset(L, c, c, wr[c]);
+                if (wi[c] > 0)
+                {
+                        mset(L, c+1, c, -wi[c]);
+                        mset(L, c, c+1, wi[c]);
+                }
+        }
+
+        multiplyMatrices(A, 0, V, 0, AV, 0);
+        multiplyMatrices(V, 0, L, 0, VL, 0);
+
+        double stats[2];
+        matrixComparison(AV, VL, stats);
+        printf("%s '%c': eigenvalue error %.2e\n", name, which, error);
+        printf("Mean Error = %.16lf\n", stats[0]);
+        printf("Max Error = %.16lf\n", stats[1]);
+
+        freeMatrix(L);
+        freeMatrix(AV);
+        freeMatrix(VL);
+}
+
+void krylovEig(int debug)
+{
+        const int n = 200;
+        const int k = 6;
+        const char which[] = { 'L', 'S', 'M' };
+
+        Matrix M = allocMatrix(n, n);
+        Matrix S = allocMatrix(n, n);
+        Matrix H = allocMatrix(n, n);
+        Matrix Z = allocMatrix(n, k);
+        Matrix V = allocMatrix(n, k+1);
+        double _wr[n], _wi[n], wr[k+1], wi[k+1];
+
+        /* symmetric S = M + MT against symmetricEigen */
+        setMatrixValues(RANGE, METHOD, M);
+        transposeMatrix(M, S);
+        addMatrix(S, M);
+
+        copyMatrix(S, H);
+        symmetricEigen(H, 0, n-1, _wr, NULL);
+        for (int i=0; i<n; i++)
+                _wi[i] = 0;
+
+        for (int c=0; c<3; c++)
+        {
+                if (lanczosEigen(denseMatVec, S, n, k, which[c], 0, 0, wr, Z) != 0)
+                        printf("Lanczos did not converge\n");
+                for (int i=0; i<k; i++)
+                        wi[i] = 0;
+
+                if (debug)
+                        for (int i=0; i<k; i++)
+                                printf("%f\n", wr[i]);
+                krylovReport("Lanczos", which[c], S, k, wr, wi, Z, _wr, _wi);
+        }
+
+        /* general M against eigenvalueQR */
+        copyMatrix(M, H);
+        eigenvalueQR(H, _wr, _wi, NULL);
+
+        for (int c=0; c<3; c++)
+        {
+                if (arnoldiEigen(denseMatVec, M, n, k, which[c], 0, 0, wr, wi, V) != 0)
+                        printf("Arnoldi did not converge\n");
+
+                if (debug)
+                        for (int i=0; i<=k; i++)
+                                printf("%f %+fi\n", wr[i], wi[i]);
+                krylovReport("Arnoldi", which[c], M, k, wr, wi, V, _wr, _wi);
+        }
+
+        freeMatrix(M);
+        freeMatrix(S);
+        freeMatrix(H);
+        freeMatrix(Z);
+        freeMatrix(V);
+}
+
+/* run one iterative solve of A x = b and compare A x with b */
+static void iterativeSolve(const char *name, Matrix A, Matrix b, int method,
+                           Preconditioner M, void *pre, int debug)
+{
+        double history[SIZE_N+1];
+        Matrix x = allocMatrix(1, SIZE_N);
+        Matrix Ax = allocMatrix(1, SIZE_N);
+        int iterations = 0;
+        int info = 0;
+
+        setMatrixValues(0, 'V', x);
+
+        if (method == 0)
+                info = conjugateGradient(denseMatVec, A, SIZE_N, mptr(b, 0, 0), mptr(x, 0, 0), M, pre,
+                                         0, 0, history, &iterations);
+        else if (method == 1)
+                info = GMRES(denseMatVec, A, SIZE_N, mptr(b, 0, 0), mptr(x, 0, 0), M, pre,
+                             0, 0, 0, history, &iterations);
+        else
+                info = BiCGSTAB(denseMatVec, A, SIZE_N, mptr(b, 0, 0), mptr(x, 0, 0), M, pre,
+                                0, 0, history, &iterations);
+
+        printf("%s: %s after %d iterations\n", name,
+               info == SOLVE_CONVERGED ? "converged" : "did not converge", iterations);
+
+        if (debug)
+                for (int i=0; i<=iterations; i++)
+                        printf("%d %e\n", i, history[i]);
+
+        denseMatVec(A, mptr(x, 0, 0), mptr(Ax, 0, 0));
+
+        double stats[2];
+        matrixComparison(Ax, b, stats);
+        printf("Mean Error = %.16lf\n", stats[0]);
+        printf("Max Error = %.16lf\n", stats[1]);
+
+        freeMatrix(x);
+        freeMatrix(Ax);
+}
+
+void iter(int debug)
+{
+        Matrix A = allocMatrix(SIZE_N, SIZE_N);
+        Matrix S = allocMatrix(SIZE_N, SIZE_N);
+        Matrix LU = allocMatrix(SIZE_N, SIZE_N);
+        Matrix D = allocMatrix(1, SIZE_N);
+        Matrix b = allocMatrix(1, SIZE_N);
+
+        /* diagonally dominant, and S = A + AT symmetric positive definite */
+        setMatrixValues(RANGE, METHOD, A);
+        for (int i=0; i<SIZE_N; i++)
+                mset(A, i, i, maccess(A, i, i) + SIZE_N * RANGE);
+        transposeMatrix(A, S);
+        addMatrix(S, A);
+        setMatrixValues(RANGE, METHOD, b);
+
+        printf("A=\n");
+        drawMatrix(A);
+        printf("b=\n");
+        drawMatrix(b);
+
+        formJacobi(S, D);
+        iterativeSolve("CG, Jacobi, A + AT", S, b, 0, applyJacobi, D, debug);
+
+        copyMatrix(A, LU);
+        if (incompleteLU(LU) != 0)
+                printf("ILU(0) has a zero pivot\n");
+        else
+                iterativeSolve("GMRES, ILU(0)", A, b, 1, applyIncompleteLU, LU, debug);
+
+        formJacobi(A, D);
+        iterativeSolve("BiCGSTAB, Jacobi", A, b, 2, applyJacobi, D, debug);
+
+        freeMatrix(A);
+        freeMatrix(S);
+        freeMatrix(LU);
+        freeMatrix(D);
+        freeMatrix(b);
+}
+
 void gj(int debug)
 {
         MatrixStack stack = allocMatrixStack(SIZE_N,SIZE_N,5);
@@ -183,6 +794,42 @@ void gj(int debug)
         freeMatrixStackAll(stack);
 }
 
+void inv(int debug)
+{
+        Matrix A = allocMatrix(SIZE_N, SIZE_N);
+        Matrix X = allocMatrix(SIZE_N, SIZE_N);
+        Matrix C = allocMatrix(SIZE_N, SIZE_N);
+
+        setMatrixValues(RANGE, METHOD, A);
+
+        printf("A=\n");
+        drawMatrix(A);
+
+        copyMatrix(A, X);
+        if (inverseMatrix(X) != 0)
+                printf("A is singular\n");
+
+        printf("A-1=\n");
+        drawMatrix(X);
+
+        simpleMultiplyMatrices(A, X, C);
+
+        if (debug)
+        {
+                printf("AA-1=\n");
+                drawMatrix(C);
+        }
+
+        double stats[2];
+        identityPrecision(C, stats);
+        printf("Mean Error=%.16lf\n", stats[0]);
+        printf("Max Error=%.16lf\n", stats[1]);
+
+        freeMatrix(A);
+        freeMatrix(X);
+        freeMatrix(C);
+}
+
 void bs()
 {
         Matrix A = allocMatrix(10,10);
@@ -211,7 +858,8 @@ void bs()
         };
         fillMatrix(_values, b);
 
-        backSubstitution(A, solution, b);
+        if (backSubstitution(A, solution, b) != 0)
+                printf("A is singular\n");
 
         printf("A=\n");
         drawMatrix(A);
@@ -248,7 +896,8 @@ void ols()
         printf("b=\n");
         drawMatrix(b);
 
-        linearRegression(A,x,b);
+        if (linearRegression(A,x,b) != 0)
+                printf("A is rank deficient\n");
 
         printf("x=\n");
         drawMatrix(x);
@@ -258,6 +907,47 @@ void ols()
         freeMatrix(x);
 }
 
+/*
+  least squares with a known solution and enough rows for several
+  TSQR blocks, so the R factors go through the merge tree and QT b
+  walks back down it
+*/
+void olsb(int debug)
+{
+        const int n = 3 * TSQR_BLOCK_ROWS;
+        const int m = SIZE_M;
+
+        Matrix A = allocMatrix(n, m);
+        Matrix x = allocMatrix(m, 1);
+        Matrix _x = allocMatrix(m, 1);
+        Matrix b = allocMatrix(n, 1);
+
+        setMatrixValues(RANGE, METHOD, A);
+        setMatrixValues(RANGE, METHOD, _x);
+        multiplyMatrices(A, 0, _x, 0, b, 0);
+
+        printf("%d x %d in %d blocks\n", n, m, tsqrBlocks(n, m, 0));
+
+        if (ordinaryLeastSquares(A, x, b) != 0)
+                printf("A is rank deficient\n");
+
+        if (debug)
+        {
+                printf("x=\n");
+                drawMatrix(x);
+        }
+
+        double stats[2];
+        matrixComparison(_x, x, stats);
+        printf("Mean Error = %.16lf\n", stats[0]);
+        printf("Max Error = %.16lf\n", stats[1]);
+
+        freeMatrix(A);
+        freeMatrix(x);
+        freeMatrix(_x);
+        freeMatrix(b);
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -267,20 +957,26 @@ int main(int argc, char *argv[])
                 return 1;
         }
 
-        int debug;
-        if (argc < 3)
-                debug = 0;
-        else if (strcmp(argv[2],"-v") == 0)
+        int debug = 0;
+        if ((argc >= 3) && (strcmp(argv[2],"-v") == 0))
                 debug = 1;
 
         if (strcmp(argv[1], "qrhh") == 0)
         {
                 qr('h', debug);
         }
+        else if (strcmp(argv[1], "qrhhb") == 0)
+        {
+                qr('b', debug);
+        }
         else if (strcmp(argv[1], "qrgs") == 0)
         {
                 qr('g', debug);
         }
+        else if (strcmp(argv[1], "qrgsb") == 0)
+        {
+                qr('c', debug);
+        }
         else if (strcmp(argv[1], "lu") == 0)
         {
                 lu(0, debug);
@@ -289,10 +985,50 @@ int main(int argc, char *argv[])
         {
                 lu(1, debug);
         }
+        else if (strcmp(argv[1], "plub") == 0)
+        {
+                lu(2, debug);
+        }
+        else if (strcmp(argv[1], "chol") == 0)
+        {
+                chol(debug);
+        }
+        else if (strcmp(argv[1], "tiled") == 0)
+        {
+                tiled(debug);
+        }
+        else if (strcmp(argv[1], "eig") == 0)
+        {
+                eig(debug);
+        }
+        else if (strcmp(argv[1], "seig") == 0)
+        {
+                seig(debug);
+        }
+        else if (strcmp(argv[1], "svd") == 0)
+        {
+                svd(debug);
+        }
+        else if (strcmp(argv[1], "rsvd") == 0)
+        {
+                rsvd(debug);
+        }
+        else if (strcmp(argv[1], "krylov") == 0)
+        {
+                krylovEig(debug);
+        }
+        else if (strcmp(argv[1], "iter") == 0)
+        {
+                iter(debug);
+        }
         else if (strcmp(argv[1], "gj") == 0)
         {
                 gj(debug);
         }
+        else if (strcmp(argv[1], "inv") == 0)
+        {
+                inv(debug);
+        }
         else if (strcmp(argv[1], "bs") == 0)
         {
                 bs();
@@ -301,11 +1037,14 @@ int main(int argc, char *argv[])
         {
                 ols();
         }
+        else if (strcmp(argv[1], "olsb") == 0)
+        {
+                olsb(debug);
+        }
         else
         {
                 char message[100];
-                strcat(message, "command not recognized: ");
-                strcat(message, argv[1]);
+                snprintf(message, sizeof(message), "command not recognized: %s", argv[1]);
                 printHelp(message);
                 return 1;
         }
@@ -9,22 +9,28 @@
 #include <math.h>
 #include <mem.h>
 #include <matrix.h>
+#include <gemm.h>
+#include <kernels.h>
 
 /* constants for rendering tables */
 const int PADDING = 1;
 const int PRECISION = 3;
 const char *FORMATTING  = "%.3lf";
 
+/* row oriented, consecutive rows are ld doubles apart */
 double maccess(Matrix matrix, int i, int j)
 {
-        /* for now, assume row oriented */
-        return matrix->values[(i*(matrix->m))+ j];
+        return matrix->values[(i*(matrix->ld))+ j];
 }
 
 void mset(Matrix matrix, int i, int j, double value)
 {
-        /* for now, assume row oriented */
-        matrix->values[(i*(matrix->m))+ j] = value;
+        matrix->values[(i*(matrix->ld))+ j] = value;
+}
+
+double *mptr(Matrix matrix, int i, int j)
+{
+        return matrix->values + (i*(matrix->ld)) + j;
 }
 
 void fillMatrix(double values[], Matrix matrix)
@@ -103,20 +109,14 @@ void copyRow(Matrix source, int idx_s, Matrix target, int idx_t)
 
 void switchRow(Matrix matrix, int row1, int row2)
 {
-        double scratch[matrix->n];
-        for (int i=0; i<matrix->m; i++)
-        {
-                scratch[i] = maccess(matrix, row1, i);
-        }
-
-        for (int i=0; i<matrix->m; i++)
-        {
-                mset(matrix, row1, i,  maccess(matrix, row2, i));
-        }
-
+        double *_row1 = mptr(matrix, row1, 0);
+        double *_row2 = mptr(matrix, row2, 0);
+        double scratch;
         for (int i=0; i<matrix->m; i++)
         {
-                mset(matrix, row2, i, scratch[i]);
+                scratch = _row1[i];
+                _row1[i] = _row2[i];
+                _row2[i] = scratch;
         }
 }
 
@@ -133,24 +133,12 @@ void transposeMatrix(Matrix source, Matrix target)
 
 double matrixMax(Matrix matrix, int _abs)
 {
-        double max, curr;
+        double max = vectorMax(matrix->m, mptr(matrix, 0, 0), 1, _abs);
 
-        for (int i=0; i < matrix->n; i++)
+        for (int i=1; i < matrix->n; i++)
         {
-                for (int j=0; j < matrix->m; j++)
-                {
-                        if ((i==0) & (j==0))
-                        {
-                                max = maccess(matrix, 0, 0);
-                                if (_abs)
-                                        max = fabs(max);
-                        }
-
-                        curr = maccess(matrix, i, j);
-                        if (_abs) curr = fabs(curr);
-
-                        if (max < curr) max = curr;
-                }
+                double curr = vectorMax(matrix->m, mptr(matrix, i, 0), 1, _abs);
+                if (max < curr) max = curr;
         }
         return max;
 }
@@ -158,17 +146,9 @@ double matrixMax(Matrix matrix, int _abs)
 double sumMatrix(Matrix matrix, int _abs)
 {
         double sum = 0;
-        double value;
         for (int i=0;i<matrix->n;i++)
         {
-                for (int j=0;j<matrix->m;j++)
-                {
-                        value = maccess(matrix, i, j);
-                        if (_abs)
-                                sum = sum + fabs(value);
-                        else
-                                sum = sum + value;
-                }
+                sum = sum + vectorSum(matrix->m, mptr(matrix, i, 0), 1, _abs);
         }
         return sum;
 }
@@ -255,25 +235,19 @@ void drawMatrix(Matrix matrix)
 /* scaling operations */
 void scaleColumn(Matrix matrix, int idx, double scalar)
 {
-        for (int i=0;i<matrix->n;i++)
-        {
-                mset(matrix, i, idx,  (maccess(matrix, i, idx) * scalar));
-        }
+        vectorScale(matrix->n, scalar, mptr(matrix, 0, idx), matrix->ld);
 }
 
 void scaleRow(Matrix matrix, int idx, double scalar)
 {
-        for (int i=0;i<matrix->n;i++)
-        {
-                mset(matrix, idx, i, (maccess(matrix, idx, i) * scalar));;
-        }
+        vectorScale(matrix->m, scalar, mptr(matrix, idx, 0), 1);
 }
 
 void scaleMatrix(Matrix matrix, double scalar)
 {
-        for (int i=0;i<matrix->m;i++)
+        for (int i=0;i<matrix->n;i++)
         {
-                scaleColumn(matrix, i, scalar);
+                scaleRow(matrix, i, scalar);
         }
 }
 
@@ -281,10 +255,7 @@ void absMatrix(Matrix matrix)
 {
         for (int i=0; i<matrix->n; i++)
         {
-                for (int j=0; j<matrix->m; j++)
-                {
-                        mset(matrix, i, j, fabs(maccess(matrix, i, j)));
-                }
+                vectorAbs(matrix->m, mptr(matrix, i, 0), 1);
         }
 }
 
@@ -292,10 +263,8 @@ void absMatrix(Matrix matrix)
 void addColumn(Matrix target, int idx1, Matrix source, int idx2)
 {
         assert(source->n == target->n);
-        for (int i=0; i<target->n; i++)
-        {
-                mset(target, i, idx1, maccess(target, i, idx1) + maccess(source, i, idx2));
-        }
+        vectorAxpy(target->n, 1.0, mptr(source, 0, idx2), source->ld,
+                   mptr(target, 0, idx1), target->ld);
 }
 
 void addMatrix(Matrix target, Matrix source)
@@ -310,20 +279,16 @@ void addMatrix(Matrix target, Matrix source)
 void subtractRow(Matrix target, int idx1, Matrix source, int idx2)
 {
         assert(source->m == target->m);
-        for (int i=0; i<target->m; i++)
-        {
-                mset(target, idx1, i, maccess(target, idx1, i) - maccess(source, idx2, i));
-        }
+        vectorAxpy(target->m, -1.0, mptr(source, idx2, 0), 1,
+                   mptr(target, idx1, 0), 1);
 }
 
 
 void subtractColumn(Matrix target, int idx1, Matrix source, int idx2)
 {
         assert(source->n == target->n);
-        for (int i=0; i<target->n; i++)
-        {
-                mset(target, i, idx1, maccess(target, i, idx1) - maccess(source, i, idx2));
-        }
+        vectorAxpy(target->n, -1.0, mptr(source, 0, idx2), source->ld,
+                   mptr(target, 0, idx1), target->ld);
 }
 
 void subtractMatrix(Matrix target, Matrix source) {
@@ -338,12 +303,8 @@ void subtractMatrix(Matrix target, Matrix source) {
 void addRowScalarMultiple(Matrix target, int idx_t, double scalar, Matrix source, int idx_s)
 {
         assert(source->m == target->m);
-        for (int i=0; i<target->m; i++)
-        {
-                mset(target, idx_t, i,
-                     (maccess(source, idx_s, i) * scalar) + \
-                     maccess(target, idx_t, i));
-        }
+        vectorAxpy(target->m, scalar, mptr(source, idx_s, 0), 1,
+                   mptr(target, idx_t, 0), 1);
 }
 
 /* dot product */
@@ -355,17 +316,15 @@ double dotProduct(char orient, Matrix matrix1, int idx1, Matrix matrix2, int idx
         {
         case 'R':
                 assert(matrix1->m == matrix2->m);
-                for (int i=0; i<matrix1->m; i++)
-                {
-                        x = x + (maccess(matrix1, idx1, i) * maccess(matrix2, idx2, i));
-                }
+                x = vectorDot(matrix1->m,
+                              mptr(matrix1, idx1, 0), 1,
+                              mptr(matrix2, idx2, 0), 1);
                 break;
         case 'C':
                 assert(matrix1->n == matrix2->n);
-                for (int i=0; i<matrix1->n; i++)
-                {
-                        x = x + (maccess(matrix1, i, idx1) * maccess(matrix2, i, idx2));
-                }
+                x = vectorDot(matrix1->n,
+                              mptr(matrix1, 0, idx1), matrix1->ld,
+                              mptr(matrix2, 0, idx2), matrix2->ld);
                 break;
         }
 
@@ -446,11 +405,17 @@ void project(Matrix source1, int idx1, Matrix source2, int idx2, double proj_sca
         else
                 st_dot = st_dot / norm_squared;
 
-        for (int i=0; i<source1->n; i++)
+        /* target column aliases the projection direction */
+        if ((target == source2) & (idx_t == idx2))
         {
-                mset(target, i, idx_t, (proj_scalar * maccess(source2, i, idx2) * st_dot) + \
-                     (tscalar * maccess(target, i, idx_t)));
+                scaleColumn(target, idx_t, tscalar + (proj_scalar * st_dot));
+                return;
         }
+
+        if (tscalar != 1)
+                scaleColumn(target, idx_t, tscalar);
+        vectorAxpy(target->n, proj_scalar * st_dot, mptr(source2, 0, idx2), source2->ld,
+                   mptr(target, 0, idx_t), target->ld);
 }
 
 /*
@@ -477,24 +442,12 @@ void outerMatrix(Matrix source, int idx_s, Matrix target)
   simpleMultiplyMatrices
 
   simplified version of multiplyMatrices
+
+  target <- source1 * source2
 */
 void simpleMultiplyMatrices(Matrix source1, Matrix source2, Matrix target)
 {
-        assert(source1->m == source2->n);
-        assert(source1->n == target->n);
-        assert(source2->m == target->m);
-        for (int i=0; i<source1->n; i++)
-        {
-                for (int j=0; j<source2->m; j++)
-                {
-                        double value = 0;
-                        for (int k=0; k<source1->m; k++)
-                        {
-                                value = value + ( maccess(source1, i, k) * maccess(source2, k, j));
-                        }
-                        mset(target, i, j, value);
-                }
-        }
+        multiplyMatrices(source1, 0, source2, 0, target, 0);
 }
 
 
@@ -508,9 +461,26 @@ void simpleMultiplyMatrices(Matrix source1, Matrix source2, Matrix target)
   adding a scalar multiple of the target to the result
   inspired by GEMM of BLAS
 
+  the product is computed by the packed, cache-blocked engine in gemm.c
+  when tscalar is zero the target is overwritten without being read
 */
 void multiplyMatrices(Matrix source1, int transpose1, Matrix source2, int transpose2,
                       Matrix target, double tscalar)
+{
+        scaledMultiplyMatrices(source1, transpose1, source2, transpose2, 1.0,
+                               target, tscalar);
+}
+
+/*
+  scaledMultiplyMatrices
+
+  target <- scalar * transpose1(source1)transpose2(source2) + (tscalar * target)
+
+  multiplyMatrices with a scalar on the product, e.g. -1 for the
+  trailing updates of blocked factorizations
+*/
+void scaledMultiplyMatrices(Matrix source1, int transpose1, Matrix source2, int transpose2,
+                            double scalar, Matrix target, double tscalar)
 {
         int iterations;
         if (transpose1 & transpose2)
@@ -546,32 +516,8 @@ void multiplyMatrices(Matrix source1, int transpose1, Matrix source2, int transp
                 iterations = source1->m;
         }
 
-        for (int i=0; i<target->n; i++)
-        {
-                for (int j=0; j<target->m; j++)
-                {
-                        double value = 0;
-                        for (int k=0; k<iterations; k++)
-                        {
-                                if (transpose1 & transpose2)
-                                        value = value +
-                                                (maccess(source1, k, i) *
-                                                   maccess(source2, j, k));
-                                else if (transpose1)
-                                        value = value +
-                                                (maccess(source1, k, i) *
-                                                 maccess(source2, k, j));
-                                else if (transpose2)
-                                        value = value +
-                                                (maccess(source1, i, k) *
-                                                 maccess(source2, j, k));
-                                else
-                                        value = value +
-                                                (maccess(source1, i, k) *
-                                                 maccess(source2, k, j));
-                        }
-                        mset(target, i, j,
-                             value + (tscalar * maccess(target, i, j)));
-                }
-        }
+        gemm(transpose1, transpose2, target->n, target->m, iterations,
+             scalar, source1->values, source1->ld,
+             source2->values, source2->ld,
+             tscalar, target->values, target->ld);
 }
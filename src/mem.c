@@ -7,23 +7,275 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 #include <mem.h>
 
+/* transparent huge pages are only requested past this size */
+#define HUGE_PAGE_SIZE (2 << 20)
+
+#define roundUp(x, multiple) ((((x) + (multiple) - 1) / (multiple)) * (multiple))
+
 Matrix allocMatrix(int n, int m)
 {
         Matrix matrix = malloc(sizeof(struct _Matrix_));
 
         matrix->n = n;
         matrix->m = m;
+        matrix->ld = m;
+        matrix->storage = MATRIX_SPLIT;
         matrix->values = malloc(n*m*sizeof(double));
 
         return matrix;
 }
 
+/*
+  alignedStride
+
+  row stride for m columns such that every row starts on a
+  MATRIX_ALIGN boundary. Strides that are a multiple of 4KB would map
+  the same column of every row to the same cache set, so those get
+  one extra cache line of padding. Column vectors stay packed.
+*/
+int alignedStride(int m)
+{
+    if (m == 1)
+        return 1;
+
+    int per_line = MATRIX_ALIGN / sizeof(double);
+    int ld = roundUp(m, per_line);
+
+    if ((ld % (4096 / sizeof(double))) == 0)
+        ld += per_line;
+
+    return ld;
+}
+
+/*
+  allocMatrixAligned
+
+  allocate header and values in a single block with the values and
+  every row aligned to MATRIX_ALIGN, rows are padded to alignedStride(m)
+
+  @param n rows
+  @param m columns
+  @param huge_pages back values larger than a huge page with
+  transparent huge pages where the platform supports it
+*/
+Matrix allocMatrixAligned(int n, int m, int huge_pages)
+{
+    size_t header = roundUp(sizeof(struct _Matrix_), MATRIX_ALIGN);
+    int ld = alignedStride(m);
+    size_t data = (size_t)n * ld * sizeof(double);
+    size_t size = roundUp(header + data, MATRIX_ALIGN);
+    void *block = NULL;
+
+#ifdef MADV_HUGEPAGE
+    if (huge_pages && (data >= HUGE_PAGE_SIZE))
+    {
+        size = roundUp(size, HUGE_PAGE_SIZE);
+        if (posix_memalign(&block, HUGE_PAGE_SIZE, size) == 0)
+            madvise(block, size, MADV_HUGEPAGE);
+        else
+            block = NULL;
+    }
+#else
+    (void)huge_pages;
+#endif
+
+    if (block == NULL)
+        block = aligned_alloc(MATRIX_ALIGN, size);
+    assert(block != NULL);
+
+    Matrix matrix = block;
+    matrix->n = n;
+    matrix->m = m;
+    matrix->ld = ld;
+    matrix->storage = MATRIX_BLOCK;
+    matrix->values = (double *)((char *)block + header);
+
+    return matrix;
+}
+
 void freeMatrix(Matrix matrix)
 {
-    free(matrix->values);
-    free(matrix);
+    switch (matrix->storage)
+    {
+    case MATRIX_SPLIT:
+        free(matrix->values);
+        free(matrix);
+        break;
+    case MATRIX_BLOCK:
+        free(matrix);
+        break;
+    case MATRIX_VIEW:
+    case MATRIX_ARENA:
+        /* nothing owned */
+        break;
+    }
+}
+
+/*
+  viewMatrix
+
+  describe the n x m block of parent whose top left element is
+  parent[i][j] without copying. The view shares values and ld with
+  parent, so writes through it land in parent, and it stays valid as
+  long as parent does. Views of views are allowed.
+
+  @param parent matrix or view being referenced
+  @param i first row of the block
+  @param j first column of the block
+  @param n rows of the block
+  @param m columns of the block
+  @param view header storage, usually a MatrixView on the caller's stack
+*/
+Matrix viewMatrix(Matrix parent, int i, int j, int n, int m, MatrixView *view)
+{
+    assert((i >= 0) & (j >= 0) & (n >= 0) & (m >= 0));
+    assert(i + n <= parent->n);
+    assert(j + m <= parent->m);
+
+    view->n = n;
+    view->m = m;
+    view->ld = parent->ld;
+    view->storage = MATRIX_VIEW;
+    view->values = parent->values + ((size_t)i * parent->ld) + j;
+
+    return view;
+}
+
+/*
+  allocArena
+
+  allocate an arena able to hand out size bytes, header and region
+  come from a single allocation
+*/
+Arena allocArena(size_t size)
+{
+    size_t header = roundUp(sizeof(struct _Arena_), MATRIX_ALIGN);
+    size = roundUp(size, MATRIX_ALIGN);
+
+    char *block = aligned_alloc(MATRIX_ALIGN, header + size);
+    assert(block != NULL);
+
+    Arena arena = (Arena)block;
+    arena->base = block + header;
+    arena->size = size;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->owned = 1;
+
+    return arena;
+}
+
+/*
+  initArena
+
+  build an arena inside caller-provided memory, the header is placed
+  at the start of buffer and the rest becomes the region. Nothing is
+  allocated, freeArena leaves buffer untouched.
+*/
+Arena initArena(void *buffer, size_t size)
+{
+    size_t header = roundUp(sizeof(struct _Arena_), MATRIX_ALIGN);
+    size_t skip = roundUp((size_t)buffer, MATRIX_ALIGN) - (size_t)buffer;
+    assert(size >= skip + header);
+
+    Arena arena = (Arena)((char *)buffer + skip);
+    arena->base = (char *)arena + header;
+    arena->size = ((size - skip - header) / MATRIX_ALIGN) * MATRIX_ALIGN;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->owned = 0;
+
+    return arena;
+}
+
+/*
+  arenaBufferSize
+
+  bytes of caller memory initArena needs to provide a region of size
+  bytes, covers the header and the worst case alignment of buffer
+*/
+size_t arenaBufferSize(size_t size)
+{
+    return (MATRIX_ALIGN - 1) + roundUp(sizeof(struct _Arena_), MATRIX_ALIGN)
+        + roundUp(size, MATRIX_ALIGN);
+}
+
+void freeArena(Arena arena)
+{
+    if (arena->owned)
+        free(arena);
+}
+
+/*
+  arenaMark
+
+  current position of the arena, everything allocated after the mark
+  is given back by arenaRelease(arena, mark)
+*/
+size_t arenaMark(Arena arena)
+{
+    return arena->used;
+}
+
+void arenaRelease(Arena arena, size_t mark)
+{
+    assert(mark <= arena->used);
+    arena->used = mark;
+}
+
+/* bytes of the region consumed by arenaAlloc(arena, size) */
+size_t arenaAllocSize(size_t size)
+{
+    return roundUp(size, MATRIX_ALIGN);
+}
+
+/*
+  arenaAlloc
+
+  size bytes aligned to MATRIX_ALIGN, asserts the arena is large enough
+*/
+void *arenaAlloc(Arena arena, size_t size)
+{
+    size = arenaAllocSize(size);
+    assert(arena->used + size <= arena->size);
+
+    void *ptr = arena->base + arena->used;
+    arena->used += size;
+    if (arena->used > arena->peak)
+        arena->peak = arena->used;
+
+    return ptr;
+}
+
+/* bytes of the region consumed by arenaMatrix(arena, n, m) */
+size_t arenaMatrixSize(int n, int m)
+{
+    return arenaAllocSize(sizeof(struct _Matrix_))
+        + arenaAllocSize((size_t)n * alignedStride(m) * sizeof(double));
+}
+
+/*
+  arenaMatrix
+
+  n x m matrix with the same layout as allocMatrixAligned, drawn from
+  the arena. freeMatrix on it is a no-op, the memory is reclaimed with
+  arenaRelease or freeArena.
+*/
+Matrix arenaMatrix(Arena arena, int n, int m)
+{
+    Matrix matrix = arenaAlloc(arena, sizeof(struct _Matrix_));
+    matrix->n = n;
+    matrix->m = m;
+    matrix->ld = alignedStride(m);
+    matrix->storage = MATRIX_ARENA;
+    matrix->values = arenaAlloc(arena, (size_t)n * matrix->ld * sizeof(double));
+
+    return matrix;
 }
 
 MatrixStack allocMatrixStack(int n, int m, int depth)
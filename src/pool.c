@@ -0,0 +1,359 @@
+/*
+  @file pool.c
+  @author Gerardo Veltri
+  Persistent thread pool shared by the parallel kernels
+
+  Workers are started on the first parallel loop and sleep between
+  loops, so fanning out costs a wake-up instead of a thread creation.
+  A loop of count independent iterations is split evenly into one
+  deque per thread. Every thread takes iterations from the back of
+  its own deque and, once that is empty, steals from the front of the
+  others, so uneven iterations balance themselves. The calling thread
+  works as thread 0 and returns once every iteration has run.
+
+  A loop started from inside another one, or while a different thread
+  of the application is running a loop, runs serially on the calling
+  thread. Kernels can therefore nest, and can be called from threads
+  the pool does not own, without oversubscribing the cores.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <gemm.h>
+#include <pool.h>
+
+/* iterations of the current loop left to one thread, [front, back) */
+typedef struct {
+
+        pthread_mutex_t lock;
+        int front;
+        int back;
+
+} Deque;
+
+typedef struct {
+
+        PoolTask work;
+        void *arg;
+
+} Job;
+
+static struct {
+
+        int threads; /* size including the calling thread, 0 until known */
+        int *cpus; /* worker k runs on cpus[k % ncpus] */
+        int ncpus;
+
+        int started;
+        pthread_t *workers; /* threads-1 of them */
+        Deque *deques; /* one per thread, the caller's first */
+
+        pthread_mutex_t submit; /* held while a loop runs */
+        pthread_mutex_t lock; /* guards everything below */
+        pthread_cond_t wake;
+        pthread_cond_t done;
+        Job *job; /* NULL when no loop accepts more workers */
+        unsigned long generation;
+        int active; /* workers inside the current loop */
+        int stop;
+
+} pool = {
+        .submit = PTHREAD_MUTEX_INITIALIZER,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wake = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+};
+
+/* set on workers and on a caller while it runs a loop */
+static __thread int insideLoop = 0;
+
+static int takeBack(Deque *deque, int *i)
+{
+        int found = 0;
+
+        pthread_mutex_lock(&deque->lock);
+        if (deque->front < deque->back)
+        {
+                *i = --deque->back;
+                found = 1;
+        }
+        pthread_mutex_unlock(&deque->lock);
+
+        return found;
+}
+
+static int takeFront(Deque *deque, int *i)
+{
+        int found = 0;
+
+        pthread_mutex_lock(&deque->lock);
+        if (deque->front < deque->back)
+        {
+                *i = deque->front++;
+                found = 1;
+        }
+        pthread_mutex_unlock(&deque->lock);
+
+        return found;
+}
+
+/* run iterations until every deque is empty, own deque first */
+static void drain(Job *job, int self)
+{
+        int threads = pool.threads;
+        int i;
+
+        for (;;)
+        {
+                if (takeBack(&pool.deques[self], &i))
+                {
+                        job->work(job->arg, i);
+                        continue;
+                }
+
+                int stolen = 0;
+                for (int v=1; (v<threads) & !stolen; v++)
+                        stolen = takeFront(&pool.deques[(self+v) % threads], &i);
+
+                if (!stolen)
+                        return;
+
+                job->work(job->arg, i);
+        }
+}
+
+static void *worker(void *_self)
+{
+        int self = (int)(intptr_t)_self;
+        unsigned long seen = 0;
+
+        insideLoop = 1;
+
+        pthread_mutex_lock(&pool.lock);
+        for (;;)
+        {
+                while (!pool.stop && ((pool.job == NULL) | (pool.generation == seen)))
+                        pthread_cond_wait(&pool.wake, &pool.lock);
+
+                if (pool.stop)
+                        break;
+
+                Job *job = pool.job;
+                seen = pool.generation;
+                pool.active++;
+                pthread_mutex_unlock(&pool.lock);
+
+                drain(job, self);
+
+                pthread_mutex_lock(&pool.lock);
+                if (--pool.active == 0)
+                        pthread_cond_signal(&pool.done);
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        gemmFreeBuffers();
+        return NULL;
+}
+
+static void startWorkers(void)
+{
+        int threads = pool.threads;
+
+        pool.deques = malloc(threads*sizeof(Deque));
+        pool.workers = malloc((threads-1)*sizeof(pthread_t));
+        assert((pool.deques != NULL) & (pool.workers != NULL));
+
+        for (int t=0; t<threads; t++)
+        {
+                pthread_mutex_init(&pool.deques[t].lock, NULL);
+                pool.deques[t].front = 0;
+                pool.deques[t].back = 0;
+        }
+
+        pool.stop = 0;
+        pool.generation = 0;
+
+        for (int t=1; t<threads; t++)
+        {
+                pthread_attr_t attr;
+                pthread_attr_init(&attr);
+
+                if (pool.ncpus > 0)
+                {
+                        cpu_set_t set;
+                        CPU_ZERO(&set);
+                        CPU_SET(pool.cpus[(t-1) % pool.ncpus], &set);
+                        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+                }
+
+                int error = pthread_create(&pool.workers[t-1], &attr, worker, (void *)(intptr_t)t);
+                if (error != 0)
+                {
+                        fprintf(stderr, "thread pool: cannot start worker %d\n", t);
+                        exit(EXIT_FAILURE);
+                }
+
+                pthread_attr_destroy(&attr);
+        }
+
+        pool.started = 1;
+}
+
+static void stopWorkers(void)
+{
+        if (!pool.started)
+                return;
+
+        pthread_mutex_lock(&pool.lock);
+        pool.stop = 1;
+        pthread_cond_broadcast(&pool.wake);
+        pthread_mutex_unlock(&pool.lock);
+
+        for (int t=1; t<pool.threads; t++)
+                pthread_join(pool.workers[t-1], NULL);
+
+        for (int t=0; t<pool.threads; t++)
+                pthread_mutex_destroy(&pool.deques[t].lock);
+
+        free(pool.workers);
+        free(pool.deques);
+        pool.workers = NULL;
+        pool.deques = NULL;
+        pool.started = 0;
+}
+
+/*
+  poolThreads
+
+  threads a parallel loop runs on, the calling thread included,
+  one per online CPU unless set with setPoolThreads
+*/
+int poolThreads(void)
+{
+        if (pool.threads == 0)
+        {
+                long online = sysconf(_SC_NPROCESSORS_ONLN);
+                pool.threads = online > 0 ? (int)online : 1;
+        }
+        return pool.threads;
+}
+
+/*
+  setPoolThreads
+
+  resize the pool, waiting for a loop in progress. Workers are
+  started again on the next loop. Must not be called from inside a
+  parallel loop.
+
+  @param threads total threads including the caller, 1 disables the
+  pool so every kernel runs serially, 0 restores one per online CPU
+*/
+void setPoolThreads(int threads)
+{
+        assert(threads >= 0);
+
+        pthread_mutex_lock(&pool.submit);
+        stopWorkers();
+        pool.threads = threads;
+        pthread_mutex_unlock(&pool.submit);
+}
+
+/*
+  setPoolAffinity
+
+  pin the workers to CPUs, worker k (k = 0 .. poolThreads()-2) to
+  cpus[k % count]. The calling thread of a loop keeps whatever
+  affinity the application gave it.
+
+  @param cpus CPU numbers, copied
+  @param count entries of cpus, 0 lets the workers float again
+*/
+void setPoolAffinity(const int *cpus, int count)
+{
+        assert(count >= 0);
+
+        pthread_mutex_lock(&pool.submit);
+        stopWorkers();
+
+        free(pool.cpus);
+        pool.cpus = NULL;
+        pool.ncpus = count;
+        if (count > 0)
+        {
+                pool.cpus = malloc(count*sizeof(int));
+                assert(pool.cpus != NULL);
+                for (int k=0; k<count; k++)
+                        pool.cpus[k] = cpus[k];
+        }
+
+        pthread_mutex_unlock(&pool.submit);
+}
+
+/* join the workers and release the pool, the next loop starts it again */
+void freePool(void)
+{
+        pthread_mutex_lock(&pool.submit);
+        stopWorkers();
+        pthread_mutex_unlock(&pool.submit);
+}
+
+/*
+  poolFor
+
+  work(arg, i) for i = 0 .. count-1, spread over the pool. Iterations
+  must be independent of each other, they run in no particular order
+  and possibly all at once.
+
+  @param count number of iterations
+  @param work loop body
+  @param arg passed to every call of work
+*/
+void poolFor(int count, PoolTask work, void *arg)
+{
+        if (count <= 0)
+                return;
+
+        if ((count == 1) | insideLoop | (poolThreads() == 1)
+            || pthread_mutex_trylock(&pool.submit) != 0)
+        {
+                for (int i=0; i<count; i++)
+                        work(arg, i);
+                return;
+        }
+
+        if (!pool.started)
+                startWorkers();
+
+        /* no worker is inside a loop, the deques are ours */
+        int threads = pool.threads;
+        for (int t=0; t<threads; t++)
+        {
+                pool.deques[t].front = (int)(((long)count * t) / threads);
+                pool.deques[t].back = (int)(((long)count * (t+1)) / threads);
+        }
+
+        Job job = { work, arg };
+
+        pthread_mutex_lock(&pool.lock);
+        pool.job = &job;
+        pool.generation++;
+        pthread_cond_broadcast(&pool.wake);
+        pthread_mutex_unlock(&pool.lock);
+
+        insideLoop = 1;
+        drain(&job, 0);
+        insideLoop = 0;
+
+        pthread_mutex_lock(&pool.lock);
+        pool.job = NULL;
+        while (pool.active > 0)
+                pthread_cond_wait(&pool.done, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+
+        pthread_mutex_unlock(&pool.submit);
+}
@@ -5,51 +5,93 @@
    introduced by precision errors
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <math.h>
 #include <mem.h>
 #include <matrix.h>
+#include <pool.h>
 
-void identityPrecision(Matrix matrix, double *stats)
+/* rows summarized by one task of the thread pool */
+#define PRECISION_ROWS 64
+
+/* a comparison split into blocks of rows, each with its own sum and max */
+typedef struct {
+
+        Matrix matrix1;
+        Matrix matrix2; /* NULL to compare against the identity */
+        double *sum;
+        double *max;
+
+} Comparison;
+
+static void compareRows(void *_comparison, int block)
 {
+        Comparison *comparison = _comparison;
+        Matrix matrix1 = comparison->matrix1;
+        Matrix matrix2 = comparison->matrix2;
+
+        int first = block * PRECISION_ROWS;
+        int last = first + PRECISION_ROWS < matrix1->n ? first + PRECISION_ROWS : matrix1->n;
+
         double curr;
         double max = 0;
         double sum = 0;
-        for (int i=0;i<matrix->n;i++)
+        for (int i=first;i<last;i++)
         {
-                for (int j=0;j<matrix->m;j++)
+                for (int j=0;j<matrix1->m;j++)
                 {
-                        if (i==j)
-                                curr = fabs(maccess(matrix, i,j) - 1.0);
+                        if (matrix2 != NULL)
+                                curr = fabs(maccess(matrix1, i,j) - maccess(matrix2, i,j));
+                        else if (i==j)
+                                curr = fabs(maccess(matrix1, i,j) - 1.0);
                         else
-                                curr = fabs(maccess(matrix, i,j));
+                                curr = fabs(maccess(matrix1, i,j));
                         max = curr > max ? curr : max;
                         sum = sum + curr;
                 }
         }
-        sum = sum / (matrix->n * matrix->m);
-        stats[0] = sum;
-        stats[1] = max;
+        comparison->sum[block] = sum;
+        comparison->max[block] = max;
 }
 
-void matrixComparison(Matrix matrix1, Matrix matrix2, double *stats)
+/* mean and max absolute difference, row blocks run on the thread pool */
+static void compare(Matrix matrix1, Matrix matrix2, double *stats)
 {
-        assert(matrix1->n == matrix2->n);
-        assert(matrix1->m == matrix2->m);
+        int blocks = (matrix1->n + PRECISION_ROWS - 1) / PRECISION_ROWS;
+
+        Comparison comparison;
+        comparison.matrix1 = matrix1;
+        comparison.matrix2 = matrix2;
+        comparison.sum = malloc(2*blocks*sizeof(double));
+        assert(comparison.sum != NULL);
+        comparison.max = comparison.sum + blocks;
+
+        poolFor(blocks, compareRows, &comparison);
 
-        double curr;
         double max = 0;
         double sum = 0;
-        for (int i=0;i<matrix1->n;i++)
+        for (int b=0;b<blocks;b++)
         {
-                for (int j=0;j<matrix1->m;j++)
-                {
-                        curr = fabs(maccess(matrix1, i,j) - maccess(matrix2, i,j));
-                        max = curr > max ? curr : max;
-                        sum = sum + curr;
-                }
+                max = comparison.max[b] > max ? comparison.max[b] : max;
+                sum = sum + comparison.sum[b];
         }
+        free(comparison.sum);
+
         sum = sum / (matrix1->n * matrix1->m);
         stats[0] = sum;
         stats[1] = max;
 }
+
+void identityPrecision(Matrix matrix, double *stats)
+{
+        compare(matrix, NULL, stats);
+}
+
+void matrixComparison(Matrix matrix1, Matrix matrix2, double *stats)
+{
+        assert(matrix1->n == matrix2->n);
+        assert(matrix1->m == matrix2->m);
+
+        compare(matrix1, matrix2, stats);
+}
@@ -0,0 +1,241 @@
+/*
+  @file solver.c
+  @author Gerardo Veltri
+  Factor once, solve many: factorizations kept for repeated solves
+
+  A Factorization holds the packed factors of A so every later solve
+  costs O(n^2) per right-hand side, no matter how many arrive. Solves
+  overwrite B, whose columns are the right-hand sides, so a batch of
+  k vectors goes through the factors together in one call.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <mem.h>
+#include <matrix.h>
+#include <factorization.h>
+#include <solver.h>
+
+struct _Factorization_ {
+
+        int kind;
+        int n; /* rows of A */
+        int m; /* columns of A */
+        int info; /* 0, or i+1 when factor i broke down */
+
+        Matrix F; /* packed factors */
+        int *ipiv; /* LU row interchanges */
+        double *tau; /* QR reflector scalars */
+
+};
+
+/*
+  factorize
+
+  factor a copy of A once, A itself is left untouched
+
+  LU: PA = LU with partial pivoting, A square
+  QR: compact Householder A = QR, A n x m with n >= m
+  Cholesky: A = LLT, only the lower triangle of A is read
+
+  A breakdown (singular U or R, A not positive definite) is recorded
+  and reported by factorizationStatus and by every solve. U and R are
+  singular when a diagonal entry is zero relative to the largest, as
+  tested by zeroPivot.
+
+  @param A matrix to be factored
+  @param kind FACTOR_LU, FACTOR_QR or FACTOR_CHOLESKY
+  @return handle owning the factors, release with freeFactorization
+*/
+Factorization factorize(Matrix A, int kind)
+{
+        Factorization F = malloc(sizeof(struct _Factorization_));
+        assert(F != NULL);
+
+        F->kind = kind;
+        F->n = A->n;
+        F->m = A->m;
+        F->info = 0;
+        F->ipiv = NULL;
+        F->tau = NULL;
+        F->F = allocMatrixAligned(A->n, A->m, 0);
+        copyMatrix(A, F->F);
+
+        switch (kind)
+        {
+        case FACTOR_LU:
+                assert(A->n == A->m);
+                F->ipiv = malloc(A->n*sizeof(int));
+                assert(F->ipiv != NULL);
+
+                PLUDecompositionInPlace(F->F, F->ipiv, 0);
+                F->info = zeroPivot(F->F);
+                break;
+
+        case FACTOR_QR:
+        {
+                assert(A->n >= A->m);
+                F->tau = malloc(A->m*sizeof(double));
+                assert(F->tau != NULL);
+
+                Arena workspace = allocArena(householderQRBlockedWorkspaceSize(A->n, A->m, 0));
+                householderQRBlocked(F->F, F->tau, 0, workspace);
+                freeArena(workspace);
+
+                MatrixView _R;
+                F->info = zeroPivot(viewMatrix(F->F, 0, 0, A->m, A->m, &_R));
+                break;
+        }
+
+        case FACTOR_CHOLESKY:
+                assert(A->n == A->m);
+                F->info = choleskyDecompositionInPlace(F->F, 0);
+                break;
+
+        default:
+                fprintf(stderr, "unknown factorization %d\n", kind);
+                exit(EXIT_FAILURE);
+        }
+
+        return F;
+}
+
+void freeFactorization(Factorization F)
+{
+        freeMatrix(F->F);
+        free(F->ipiv);
+        free(F->tau);
+        free(F);
+}
+
+/* 0 when the factors can be solved with, else i+1 for the factor that broke down */
+int factorizationStatus(Factorization F)
+{
+        return F->info;
+}
+
+/*
+  Solve with a Factorization
+
+  B <- A^-1 B, or AT^-1 B when transpose is set, for all columns of B
+  at once. B has n rows (the rows of A) in every case.
+
+  For QR the solve is in the least squares sense: the solution of
+  min |A X - B| is left in the first m rows of B. Transposed, the
+  first m rows of B hold the right-hand sides of AT X = B on entry and
+  B is overwritten by the n rows of the minimum norm solution.
+
+  @param F factorization from factorize
+  @param B right-hand sides, one per column, overwritten
+  @param transpose solve with AT
+  @param workspace arena for scratch, see factorizationSolveWorkspaceSize,
+  may be NULL when that is 0
+  @return 0, or factorizationStatus(F) when the factors are singular,
+  B is untouched in that case
+*/
+int _factorizationSolve(Factorization F, Matrix B, int transpose, Arena workspace)
+{
+        assert(B->n == F->n);
+
+        if (F->info != 0)
+                return F->info;
+
+        MatrixView _top, _bottom;
+
+        switch (F->kind)
+        {
+        case FACTOR_LU:
+                if (!transpose)
+                {
+                        applyPivots(B, F->ipiv, F->n, 0);
+                        triangularSolve(F->F, B, 0, 0, 1);
+                        triangularSolve(F->F, B, 1, 0, 0);
+                }
+                else
+                {
+                        triangularSolve(F->F, B, 1, 1, 0);
+                        triangularSolve(F->F, B, 0, 1, 1);
+                        applyPivots(B, F->ipiv, F->n, 1);
+                }
+                break;
+
+        case FACTOR_QR:
+        {
+                MatrixView _R;
+                Matrix R = viewMatrix(F->F, 0, 0, F->m, F->m, &_R);
+                Matrix top = viewMatrix(B, 0, 0, F->m, B->m, &_top);
+
+                if (!transpose)
+                {
+                        applyHouseholderQ(F->F, F->tau, F->m, B, 1, workspace);
+                        triangularSolve(R, top, 1, 0, 0);
+                }
+                else
+                {
+                        triangularSolve(R, top, 1, 1, 0);
+                        setMatrixValues(0, 'V',
+                                        viewMatrix(B, F->m, 0, F->n-F->m, B->m, &_bottom));
+                        applyHouseholderQ(F->F, F->tau, F->m, B, 0, workspace);
+                }
+                break;
+        }
+
+        case FACTOR_CHOLESKY:
+                choleskySolve(F->F, B);
+                break;
+        }
+
+        return 0;
+}
+
+/* workspace bytes needed by _factorizationSolve for k right-hand sides */
+size_t factorizationSolveWorkspaceSize(Factorization F, int k)
+{
+        if (F->kind == FACTOR_QR)
+                return arenaAllocSize(k*sizeof(double));
+
+        return 0;
+}
+
+/* _factorizationSolve with a workspace of its own, none for LU and Cholesky */
+static int solveAllocated(Factorization F, Matrix B, int transpose)
+{
+        size_t size = factorizationSolveWorkspaceSize(F, B->m);
+        if (size == 0)
+                return _factorizationSolve(F, B, transpose, NULL);
+
+        Arena workspace = allocArena(size);
+
+        int info = _factorizationSolve(F, B, transpose, workspace);
+
+        freeArena(workspace);
+        return info;
+}
+
+/*
+  Solve with a Factorization
+
+  allocates its own workspace when one is needed, see _factorizationSolve
+
+  @param F factorization from factorize
+  @param B right-hand sides, one per column, overwritten
+  @return 0, or factorizationStatus(F) when the factors are singular
+*/
+int factorizationSolve(Factorization F, Matrix B)
+{
+        return solveAllocated(F, B, 0);
+}
+
+/*
+  Solve with the transpose of a Factorization
+
+  allocates its own workspace when one is needed, see _factorizationSolve
+
+  @param F factorization from factorize
+  @param B right-hand sides, one per column, overwritten
+  @return 0, or factorizationStatus(F) when the factors are singular
+*/
+int factorizationSolveTransposed(Factorization F, Matrix B)
+{
+        return solveAllocated(F, B, 1);
+}
@@ -0,0 +1,485 @@
+/*
+  @file svd.c
+  @author Gerardo Veltri
+  Singular value decomposition
+
+  One-sided Jacobi (Hestenes): plane rotations are applied to pairs of
+  columns of A until every pair is orthogonal, A V = U Σ. The column
+  norms are then the singular values and V is the product of the
+  rotations. Every singular value, small ones included, comes out to
+  high relative accuracy.
+
+  A rotation touches only its two columns, so rotations of disjoint
+  pairs are independent. A sweep visits all m(m-1)/2 pairs in m-1
+  rounds of a round-robin tournament, each round m/2 disjoint pairs
+  that run in parallel on the thread pool. The columns are worked on
+  as the rows of a transposed copy, contiguous and each written by a
+  single thread. A tall matrix is first reduced to its m x m R by QR,
+  so the sweeps run on a square problem.
+
+  The randomized SVD finds an approximate basis Q of the range of A
+  from the product of A with a few random vectors and takes the SVD of
+  the small QT A. Its cost is a handful of GEMMs with A.
+*/
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <assert.h>
+#include <mem.h>
+#include <matrix.h>
+#include <pool.h>
+#include <factorization.h>
+#include <svd.h>
+
+#define min(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a < _b ? _a : _b; })
+
+#define max(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a > _b ? _a : _b; })
+
+/* one round of a sweep, the pairs of rows that are rotated together */
+typedef struct {
+
+        Matrix W; /* vectors to orthogonalize, one per row */
+        Matrix V; /* rotations accumulated in the same rows, or NULL */
+        double *length; /* squared norms of the rows of W */
+        const int *position; /* the round-robin table */
+        int players; /* rows, rounded up to even */
+        double tol;
+        int *rotated; /* one flag per pair */
+
+} Round;
+
+/* rows p and q of M <- (c p - s q, s p + c q) */
+static void rotateRows(Matrix M, int p, int q, double c, double s)
+{
+        double *x = mptr(M, p, 0);
+        double *y = mptr(M, q, 0);
+
+        for (int j=0; j<M->m; j++)
+        {
+                double t = x[j];
+                x[j] = c * t - s * y[j];
+                y[j] = s * t + c * y[j];
+        }
+}
+
+/*
+  rotatePair
+
+  the rotation that makes rows p and q of W orthogonal, skipped when
+  they already are to tol relative to their lengths. The squared norms
+  are carried from rotation to rotation rather than recomputed, which
+  saves two of the three dot products per pair.
+*/
+static void rotatePair(void *_round, int pair)
+{
+        Round *round = _round;
+        int p = round->position[pair];
+        int q = round->position[round->players-1-pair];
+
+        round->rotated[pair] = 0;
+        if (max(p, q) >= round->W->n)
+                return;
+
+        double alpha = round->length[p];
+        double beta = round->length[q];
+        double gamma = dotProduct('R', round->W, p, round->W, q);
+
+        if (fabs(gamma) <= round->tol * sqrt(alpha) * sqrt(beta))
+                return;
+
+        /* tan of the angle, the smaller root so it stays within 45 degrees */
+        double zeta = (beta - alpha) / (2 * gamma);
+        double t = copysign(1, zeta) / (fabs(zeta) + hypot(1, zeta));
+        double c = 1 / hypot(1, t);
+        double s = c * t;
+
+        rotateRows(round->W, p, q, c, s);
+        round->length[p] = alpha - t * gamma;
+        round->length[q] = beta + t * gamma;
+        if (round->V != NULL)
+                rotateRows(round->V, p, q, c, s);
+        round->rotated[pair] = 1;
+}
+
+/*
+  jacobiSweeps
+
+  orthogonalize the rows of W against each other by rotations, the
+  same rotations applied to the rows of V
+
+  @return 0, or 1 when still not orthogonal after JACOBI_MAX_SWEEPS
+*/
+static int jacobiSweeps(Matrix W, Matrix V, Arena workspace)
+{
+        int k = W->n;
+        int players = k + (k & 1);
+        int pairs = players / 2;
+
+        size_t mark = arenaMark(workspace);
+        double *length = arenaAlloc(workspace, k*sizeof(double));
+        int *position = arenaAlloc(workspace, (players + pairs)*sizeof(int));
+        int *rotated = position + players;
+
+        Round round = {
+                W, V, length, position, players, sqrt(W->m) * DBL_EPSILON, rotated
+        };
+
+        int info = 1;
+        for (int sweep=0; sweep<JACOBI_MAX_SWEEPS; sweep++)
+        {
+                /* fresh norms each sweep so the updates do not drift */
+                for (int i=0; i<k; i++)
+                        length[i] = dotProduct('R', W, i, W, i);
+                for (int i=0; i<players; i++)
+                        position[i] = i;
+
+                int rotations = 0;
+                for (int r=0; r<players-1; r++)
+                {
+                        poolFor(pairs, rotatePair, &round);
+                        for (int i=0; i<pairs; i++)
+                                rotations += rotated[i];
+
+                        /* round-robin, the first player stays and the rest move one seat */
+                        int last = position[players-1];
+                        for (int i=players-1; i>1; i--)
+                                position[i] = position[i-1];
+                        position[1] = last;
+                }
+
+                if (rotations == 0)
+                {
+                        info = 0;
+                        break;
+                }
+        }
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* a singular value and the row it came from, for sorting */
+typedef struct {
+
+        double value;
+        int index;
+
+} Singular;
+
+static int compareSingular(const void *_a, const void *_b)
+{
+        const Singular *a = _a;
+        const Singular *b = _b;
+
+        return (a->value < b->value) - (a->value > b->value);
+}
+
+/* SVD of A with n >= m, see _singularValueDecomposition */
+static int tallSVD(Matrix A, double *s, Matrix U, Matrix V, Arena workspace)
+{
+        int n = A->n;
+        int m = A->m;
+        int reduce = n > m;
+
+        size_t mark = arenaMark(workspace);
+        Matrix W = arenaMatrix(workspace, m, reduce ? m : n);
+        Matrix Vt = V != NULL ? arenaMatrix(workspace, m, m) : NULL;
+        Singular *singular = arenaAlloc(workspace, m*sizeof(Singular));
+        Matrix F = NULL;
+        double *tau = NULL;
+
+        /* the columns to orthogonalize, those of R for a tall A, as rows of W */
+        if (reduce)
+        {
+                F = arenaMatrix(workspace, n, m);
+                tau = arenaAlloc(workspace, m*sizeof(double));
+                copyMatrix(A, F);
+                householderQRBlocked(F, tau, 0, workspace);
+
+                for (int i=0; i<m; i++)
+                        for (int j=0; j<m; j++)
+                                mset(W, i, j, j <= i ? maccess(F, j, i) : 0);
+        }
+        else
+        {
+                transposeMatrix(A, W);
+        }
+
+        if (Vt != NULL)
+                setMatrixValues(1, 'I', Vt);
+
+        int info = jacobiSweeps(W, Vt, workspace);
+
+        for (int j=0; j<m; j++)
+        {
+                singular[j].value = norm('R', W, j);
+                singular[j].index = j;
+        }
+        qsort(singular, m, sizeof(Singular), compareSingular);
+
+        for (int j=0; j<m; j++)
+        {
+                int r = singular[j].index;
+                s[j] = singular[j].value;
+
+                if (Vt != NULL)
+                        for (int i=0; i<m; i++)
+                                mset(V, i, j, maccess(Vt, r, i));
+
+                if (U == NULL)
+                        continue;
+
+                /* a zero singular value has no direction, its column stays zero */
+                double scale = s[j] > 0 ? 1 / s[j] : 0;
+                for (int i=0; i<W->m; i++)
+                        mset(U, i, j, scale * maccess(W, r, i));
+        }
+
+        /* U = Q [UR; 0] */
+        if (reduce & (U != NULL))
+        {
+                MatrixView _rest;
+                setMatrixValues(0, 'V', viewMatrix(U, m, 0, n-m, m, &_rest));
+                applyHouseholderQ(F, tau, m, U, 0, workspace);
+        }
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/*
+  Singular value decomposition
+
+  A = U Σ VT, thin: for A n x m and k = min(n, m), U is n x k and V is
+  m x k with orthonormal columns and Σ holds the k singular values in
+  decreasing order. One-sided Jacobi with the column pairs of each
+  round rotated in parallel. A tall A is reduced to R by QR first, a
+  wide one is handled through its transpose. Columns of U for zero
+  singular values are left zero. A is not modified.
+
+  @param A n x m matrix
+  @param s k singular values, decreasing
+  @param U n x k left singular vectors, or NULL
+  @param V m x k right singular vectors, or NULL
+  @param workspace arena for scratch, see singularValueDecompositionWorkspaceSize
+  @return 0, or 1 when the sweeps did not converge in JACOBI_MAX_SWEEPS
+*/
+int _singularValueDecomposition(Matrix A, double *s, Matrix U, Matrix V, Arena workspace)
+{
+        int n = A->n;
+        int m = A->m;
+        int k = min(n, m);
+
+        assert((U == NULL) || ((U->n == n) & (U->m == k)));
+        assert((V == NULL) || ((V->n == m) & (V->m == k)));
+
+        if (n >= m)
+                return tallSVD(A, s, U, V, workspace);
+
+        /* AT = V Σ UT */
+        size_t mark = arenaMark(workspace);
+        Matrix At = arenaMatrix(workspace, m, n);
+        transposeMatrix(A, At);
+
+        int info = tallSVD(At, s, V, U, workspace);
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _singularValueDecomposition for an n x m input */
+size_t singularValueDecompositionWorkspaceSize(int n, int m)
+{
+        size_t transpose = 0;
+        if (n < m)
+        {
+                transpose = arenaMatrixSize(m, n);
+                int t = n;
+                n = m;
+                m = t;
+        }
+
+        size_t sweeps = arenaAllocSize(m*sizeof(double))
+                + arenaAllocSize((m + 1 + (m + 1) / 2)*sizeof(int));
+        size_t reduce = arenaMatrixSize(n, m) + arenaAllocSize(m*sizeof(double))
+                + max(householderQRBlockedWorkspaceSize(n, m, 0), arenaAllocSize(m*sizeof(double)));
+
+        return transpose + arenaMatrixSize(m, n) + arenaMatrixSize(m, m)
+                + arenaAllocSize(m*sizeof(Singular)) + reduce + sweeps;
+}
+
+/*
+  Singular value decomposition
+
+  allocates its own workspace, see _singularValueDecomposition
+
+  @param A n x m matrix
+  @param s min(n, m) singular values, decreasing
+  @param U n x min(n, m) left singular vectors, or NULL
+  @param V m x min(n, m) right singular vectors, or NULL
+  @return 0, or 1 when the sweeps did not converge
+*/
+int singularValueDecomposition(Matrix A, double *s, Matrix U, Matrix V)
+{
+        Arena workspace = allocArena(singularValueDecompositionWorkspaceSize(A->n, A->m));
+
+        int info = _singularValueDecomposition(A, s, U, V, workspace);
+
+        freeArena(workspace);
+        return info;
+}
+
+/* fill M with independent standard normal values, Box-Muller on rand */
+static void gaussianMatrix(Matrix M)
+{
+        for (int i=0; i<M->n; i++)
+                for (int j=0; j<M->m; j+=2)
+                {
+                        double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+                        double v = (double)rand() / RAND_MAX;
+                        double r = sqrt(-2 * log(u));
+
+                        mset(M, i, j, r * cos(2 * M_PI * v));
+                        if (j+1 < M->m)
+                                mset(M, i, j+1, r * sin(2 * M_PI * v));
+                }
+}
+
+/* Y <- Q of its thin QR, tau holds Y->m doubles */
+static void orthonormalize(Matrix Y, double *tau, Arena workspace)
+{
+        householderQRBlocked(Y, tau, 0, workspace);
+        formHouseholderQBlocked(Y, tau, Y->m, Y, 0, workspace);
+}
+
+static size_t orthonormalizeWorkspaceSize(int n, int l)
+{
+        return max(householderQRBlockedWorkspaceSize(n, l, 0),
+                   formHouseholderQBlockedWorkspaceSize(n, l, l, 0));
+}
+
+/* sketch columns, k + p but no more than the rank can be */
+static int sketchSize(int n, int m, int k, int p)
+{
+        if (p < 0)
+                p = RSVD_OVERSAMPLING;
+
+        return min(k + p, min(n, m));
+}
+
+/*
+  Randomized SVD
+
+  rank k approximation A ~ U Σ VT. The range of A is sampled by Y = A Ω
+  for an m x (k+p) Gaussian Ω, sharpened by q power iterations Y <-
+  (A AT) Y that push the trailing singular values down by their 2q-th
+  power, and orthonormalized by Householder QR into Q. The SVD of the
+  small B = QT A then gives A ~ Q B. Each power iteration costs two
+  products with A and the rest is O((n+m)(k+p)^2), so for k+p much
+  smaller than n and m nearly all of the work is in multiplyMatrices.
+  Y is orthonormalized after every product so the small singular
+  values are not lost to rounding. Random numbers come from rand. A is
+  not modified.
+
+  @param A n x m matrix
+  @param k rank of the approximation, at most min(n, m)
+  @param p oversampling, RSVD_OVERSAMPLING when negative
+  @param q power iterations, RSVD_POWER_ITERATIONS when negative
+  @param s k largest singular values, decreasing
+  @param U n x k left singular vectors, or NULL
+  @param V m x k right singular vectors, or NULL
+  @param workspace arena for scratch, see randomizedSVDWorkspaceSize
+  @return 0, or 1 when the small SVD did not converge
+*/
+int _randomizedSVD(Matrix A, int k, int p, int q, double *s, Matrix U, Matrix V,
+                   Arena workspace)
+{
+        int n = A->n;
+        int m = A->m;
+        int l = sketchSize(n, m, k, p);
+
+        assert((k > 0) & (k <= min(n, m)));
+        assert((U == NULL) || ((U->n == n) & (U->m == k)));
+        assert((V == NULL) || ((V->n == m) & (V->m == k)));
+
+        if (q < 0)
+                q = RSVD_POWER_ITERATIONS;
+
+        size_t mark = arenaMark(workspace);
+        Matrix Y = arenaMatrix(workspace, n, l);
+        Matrix Z = arenaMatrix(workspace, m, l);
+        Matrix Ub = arenaMatrix(workspace, m, l);
+        Matrix Vb = arenaMatrix(workspace, l, l);
+        double *tau = arenaAlloc(workspace, l*sizeof(double));
+        double *sb = arenaAlloc(workspace, l*sizeof(double));
+
+        gaussianMatrix(Z);
+        multiplyMatrices(A, 0, Z, 0, Y, 0);
+        orthonormalize(Y, tau, workspace);
+
+        for (int i=0; i<q; i++)
+        {
+                multiplyMatrices(A, 1, Y, 0, Z, 0);
+                orthonormalize(Z, tau, workspace);
+                multiplyMatrices(A, 0, Z, 0, Y, 0);
+                orthonormalize(Y, tau, workspace);
+        }
+
+        /* BT = AT Q = Ub Σ VbT is tall, so A ~ Q B = (Q Vb) Σ UbT */
+        multiplyMatrices(A, 1, Y, 0, Z, 0);
+        int info = _singularValueDecomposition(Z, sb, Ub, Vb, workspace);
+
+        for (int j=0; j<k; j++)
+                s[j] = sb[j];
+
+        MatrixView _lead;
+        if (V != NULL)
+                copyMatrix(viewMatrix(Ub, 0, 0, m, k, &_lead), V);
+        if (U != NULL)
+                multiplyMatrices(Y, 0, viewMatrix(Vb, 0, 0, l, k, &_lead), 0, U, 0);
+
+        arenaRelease(workspace, mark);
+        return info;
+}
+
+/* workspace bytes needed by _randomizedSVD for an n x m input */
+size_t randomizedSVDWorkspaceSize(int n, int m, int k, int p)
+{
+        int l = sketchSize(n, m, k, p);
+        size_t scratch = max(max(orthonormalizeWorkspaceSize(n, l),
+                                 orthonormalizeWorkspaceSize(m, l)),
+                             singularValueDecompositionWorkspaceSize(m, l));
+
+        return arenaMatrixSize(n, l) + (2 * arenaMatrixSize(m, l)) + arenaMatrixSize(l, l)
+                + (2 * arenaAllocSize(l*sizeof(double))) + scratch;
+}
+
+/*
+  Randomized SVD
+
+  allocates its own workspace, see _randomizedSVD
+
+  @param A n x m matrix
+  @param k rank of the approximation
+  @param p oversampling, RSVD_OVERSAMPLING when negative
+  @param q power iterations, RSVD_POWER_ITERATIONS when negative
+  @param s k largest singular values, decreasing
+  @param U n x k left singular vectors, or NULL
+  @param V m x k right singular vectors, or NULL
+  @return 0, or 1 when the small SVD did not converge
+*/
+int randomizedSVD(Matrix A, int k, int p, int q, double *s, Matrix U, Matrix V)
+{
+        Arena workspace = allocArena(randomizedSVDWorkspaceSize(A->n, A->m, k, p));
+
+        int info = _randomizedSVD(A, k, p, q, s, U, V, workspace);
+
+        freeArena(workspace);
+        return info;
+}
@@ -0,0 +1,892 @@
+/*
+  @file tiled.c
+  @author Gerardo Veltri
+  Tiled factorizations scheduled as a graph of tasks
+
+  The matrix is cut into nb x nb tiles, addressed through views, so no
+  copy into a tile layout is made. Every step of a factorization
+  (panel, triangular solve, trailing update) becomes a task on one or
+  a few tiles. Tasks are added in the order a serial loop would run
+  them, each with the tiles it reads and writes, and the graph derives
+  the dependencies from that: a task waits for the last writer of
+  every tile it touches, and a write also waits for the readers since.
+
+  The threads of the pool then run whichever tasks are ready, those
+  writing the leftmost columns first. The next panel is therefore
+  factored as soon as its own columns are updated, while the rest of
+  the previous trailing update is still running, instead of leaving
+  cores idle at the join of every step.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <pthread.h>
+#include <mem.h>
+#include <matrix.h>
+#include <kernels.h>
+#include <pool.h>
+#include <factorization.h>
+#include <tiled.h>
+
+#define min(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a < _b ? _a : _b; })
+
+#define max(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a > _b ? _a : _b; })
+
+/* rows of the diagonal tile updates done as one GEMM below the diagonal */
+#define TRIANGLE_BLOCK 32
+
+/* kinds of task */
+#define TASK_POTRF 0 /* Cholesky of a diagonal tile */
+#define TASK_TRSM 1 /* tile below it times L^-T */
+#define TASK_SYRK 2 /* lower triangle of a diagonal tile, minus A AT */
+#define TASK_GEMM 3 /* tile minus a product of two tiles */
+#define TASK_PANEL 4 /* LU of a tile column */
+#define TASK_SWAP 5 /* interchanges and U of a tile column right of a panel */
+#define TASK_SWAP_LEFT 6 /* interchanges of a tile column left of a panel */
+#define TASK_GEQRT 7 /* QR of a diagonal tile */
+#define TASK_UNMQR 8 /* its QT applied to a tile right of it */
+#define TASK_TSQRT 9 /* QR of the diagonal R stacked on a tile below */
+#define TASK_TSMQR 10 /* its QT applied to the two tiles right of them */
+
+typedef struct {
+
+        int kind;
+        int k; /* step of the factorization */
+        int i;
+        int j;
+        int priority; /* ready tasks with a higher priority run first */
+
+        int waiting; /* unfinished tasks this one depends on */
+        int *successors;
+        int count;
+        int capacity;
+
+} Task;
+
+/* access history of one tile */
+typedef struct {
+
+        int writer; /* last task writing it, -1 if none */
+        int *readers; /* tasks reading it since */
+        int count;
+        int capacity;
+
+} Datum;
+
+typedef struct {
+
+        Task *tasks;
+        int count;
+        int capacity;
+
+        Datum *data;
+        int ndata;
+
+        void (*body)(void *arg, Task *task);
+        void *arg;
+
+        /* scheduling state while running */
+        pthread_mutex_t lock;
+        pthread_cond_t ready;
+        int *heap; /* ready tasks, a max-heap on priority */
+        int queued;
+        int finished;
+
+} Graph;
+
+/* state of one tiled factorization, shared by its tasks */
+typedef struct {
+
+        Matrix A;
+        int nb;
+        int mt; /* tile rows */
+        int nt; /* tile columns */
+
+        int *ipiv;
+        double *tau;
+        int info;
+
+} Tiled;
+
+static void *grow(void *array, int *capacity, size_t size)
+{
+        *capacity = *capacity > 0 ? 2 * *capacity : 8;
+        array = realloc(array, *capacity * size);
+        assert(array != NULL);
+        return array;
+}
+
+static void initGraph(Graph *g, int ndata, void (*body)(void *, Task *), void *arg)
+{
+        g->tasks = NULL;
+        g->count = 0;
+        g->capacity = 0;
+
+        g->data = calloc(ndata, sizeof(Datum));
+        assert(g->data != NULL);
+        g->ndata = ndata;
+        for (int d=0; d<ndata; d++)
+                g->data[d].writer = -1;
+
+        g->body = body;
+        g->arg = arg;
+}
+
+static void freeGraph(Graph *g)
+{
+        for (int t=0; t<g->count; t++)
+                free(g->tasks[t].successors);
+        for (int d=0; d<g->ndata; d++)
+                free(g->data[d].readers);
+        free(g->tasks);
+        free(g->data);
+}
+
+static int addTask(Graph *g, int kind, int k, int i, int j, int priority)
+{
+        if (g->count == g->capacity)
+                g->tasks = grow(g->tasks, &g->capacity, sizeof(Task));
+
+        Task *task = &g->tasks[g->count];
+        task->kind = kind;
+        task->k = k;
+        task->i = i;
+        task->j = j;
+        task->priority = priority;
+        task->waiting = 0;
+        task->successors = NULL;
+        task->count = 0;
+        task->capacity = 0;
+
+        return g->count++;
+}
+
+/* task to waits for task from, the same edge twice in a row is added once */
+static void depend(Graph *g, int from, int to)
+{
+        Task *task = &g->tasks[from];
+
+        if ((from == to) || ((task->count > 0) && (task->successors[task->count-1] == to)))
+                return;
+
+        if (task->count == task->capacity)
+                task->successors = grow(task->successors, &task->capacity, sizeof(int));
+
+        task->successors[task->count++] = to;
+        g->tasks[to].waiting++;
+}
+
+static void reads(Graph *g, int task, int datum)
+{
+        Datum *d = &g->data[datum];
+
+        if (d->writer >= 0)
+                depend(g, d->writer, task);
+
+        if (d->count == d->capacity)
+                d->readers = grow(d->readers, &d->capacity, sizeof(int));
+        d->readers[d->count++] = task;
+}
+
+/* read and write, after the last writer and every reader since */
+static void writes(Graph *g, int task, int datum)
+{
+        Datum *d = &g->data[datum];
+
+        if (d->writer >= 0)
+                depend(g, d->writer, task);
+        for (int r=0; r<d->count; r++)
+                depend(g, d->readers[r], task);
+
+        d->writer = task;
+        d->count = 0;
+}
+
+static void pushReady(Graph *g, int t)
+{
+        int *heap = g->heap;
+        int c = g->queued++;
+
+        while (c > 0)
+        {
+                int parent = (c-1) / 2;
+                if (g->tasks[heap[parent]].priority >= g->tasks[t].priority)
+                        break;
+                heap[c] = heap[parent];
+                c = parent;
+        }
+        heap[c] = t;
+}
+
+static int popReady(Graph *g)
+{
+        int *heap = g->heap;
+        int top = heap[0];
+        int last = heap[--g->queued];
+        int c = 0;
+
+        for (;;)
+        {
+                int child = 2*c + 1;
+                if (child >= g->queued)
+                        break;
+                if ((child+1 < g->queued)
+                    && (g->tasks[heap[child+1]].priority > g->tasks[heap[child]].priority))
+                        child++;
+                if (g->tasks[heap[child]].priority <= g->tasks[last].priority)
+                        break;
+                heap[c] = heap[child];
+                c = child;
+        }
+        heap[c] = last;
+
+        return top;
+}
+
+/*
+  runner
+
+  one thread of the pool: take the most urgent ready task, run it,
+  release its successors, until every task has finished. A runner
+  only sleeps while other runners hold tasks, so a single runner
+  finishes the graph alone when the pool has no other thread.
+*/
+static void runner(void *_g, int r)
+{
+        Graph *g = _g;
+        (void)r;
+
+        pthread_mutex_lock(&g->lock);
+        for (;;)
+        {
+                while ((g->queued == 0) & (g->finished < g->count))
+                        pthread_cond_wait(&g->ready, &g->lock);
+
+                if (g->finished == g->count)
+                        break;
+
+                Task *task = &g->tasks[popReady(g)];
+                pthread_mutex_unlock(&g->lock);
+
+                g->body(g->arg, task);
+
+                pthread_mutex_lock(&g->lock);
+                g->finished++;
+                for (int s=0; s<task->count; s++)
+                {
+                        int t = task->successors[s];
+                        if (--g->tasks[t].waiting == 0)
+                                pushReady(g, t);
+                }
+                pthread_cond_broadcast(&g->ready);
+        }
+        pthread_mutex_unlock(&g->lock);
+}
+
+static void runGraph(Graph *g)
+{
+        g->heap = malloc(max(g->count, 1)*sizeof(int));
+        assert(g->heap != NULL);
+        g->queued = 0;
+        g->finished = 0;
+        pthread_mutex_init(&g->lock, NULL);
+        pthread_cond_init(&g->ready, NULL);
+
+        for (int t=0; t<g->count; t++)
+        {
+                if (g->tasks[t].waiting == 0)
+                        pushReady(g, t);
+        }
+
+        poolFor(poolThreads(), runner, g);
+
+        pthread_cond_destroy(&g->ready);
+        pthread_mutex_destroy(&g->lock);
+        free(g->heap);
+}
+
+static void initTiled(Tiled *T, Matrix A, int nb)
+{
+        T->A = A;
+        T->nb = nb;
+        T->mt = (A->n + nb - 1) / nb;
+        T->nt = (A->m + nb - 1) / nb;
+        T->ipiv = NULL;
+        T->tau = NULL;
+        T->info = 0;
+}
+
+static Matrix tile(Tiled *T, int i, int j, MatrixView *view)
+{
+        int nb = T->nb;
+        return viewMatrix(T->A, i*nb, j*nb, min(nb, T->A->n - i*nb), min(nb, T->A->m - j*nb), view);
+}
+
+/* tiles i = k .. mt-1 of tile column j, as one view */
+static Matrix tileColumn(Tiled *T, int k, int j, MatrixView *view)
+{
+        int nb = T->nb;
+        return viewMatrix(T->A, k*nb, j*nb, T->A->n - k*nb, min(nb, T->A->m - j*nb), view);
+}
+
+static int tileId(Tiled *T, int i, int j)
+{
+        return i*T->nt + j;
+}
+
+/*
+  urgency of a task writing tile column column at step k: the further
+  left the column the sooner it is needed, earlier steps first
+*/
+static int priority(Tiled *T, int column, int k)
+{
+        return (T->nt - column)*(T->nt + 1) - k;
+}
+
+/* reflector scalars of the tile (i, k) */
+static double *tileTau(Tiled *T, int i, int k)
+{
+        return T->tau + ((size_t)i*T->nt + k)*T->nb;
+}
+
+/*
+  solveLowerTransposedRight
+
+  B <- B L^-T for L lower triangular, row by row with unit stride dot
+  products, as in choleskyDecompositionInPlace
+*/
+static void solveLowerTransposedRight(Matrix L, Matrix B)
+{
+        for (int r=0; r<B->n; r++)
+        {
+                double *row = mptr(B, r, 0);
+                for (int c=0; c<B->m; c++)
+                {
+                        double *_row = mptr(L, c, 0);
+                        row[c] = (row[c] - vectorDot(c, row, 1, _row, 1)) / _row[c];
+                }
+        }
+}
+
+/*
+  updateLower
+
+  lower triangle of C <- C - A AT, the strict upper triangle of C is
+  not touched. Blocks of rows below the diagonal go through GEMM, the
+  small triangles on the diagonal through dot products.
+*/
+static void updateLower(Matrix A, Matrix C)
+{
+        for (int r=0; r<C->n; r+=TRIANGLE_BLOCK)
+        {
+                int rb = min(TRIANGLE_BLOCK, C->n - r);
+                MatrixView _Ar, _A0, _C;
+
+                if (r > 0)
+                        scaledMultiplyMatrices(viewMatrix(A, r, 0, rb, A->m, &_Ar), 0,
+                                               viewMatrix(A, 0, 0, r, A->m, &_A0), 1,
+                                               -1.0, viewMatrix(C, r, 0, rb, r, &_C), 1.0);
+
+                for (int i=r; i<r+rb; i++)
+                {
+                        for (int c=r; c<=i; c++)
+                        {
+                                double dot = vectorDot(A->m, mptr(A, i, 0), 1, mptr(A, c, 0), 1);
+                                mset(C, i, c, maccess(C, i, c) - dot);
+                        }
+                }
+        }
+}
+
+/*
+  applyStacked
+
+  [C1; C2] <- (I - tau v vT) [C1; C2] for reflector c of tsqrt: v is 1
+  on row c of C1, zero on the other rows of C1 and column c of V2 on
+  C2, so row c is the only row of C1 that changes
+
+  @param w scratch of C1->m doubles
+*/
+static void applyStacked(Matrix V2, int c, double tau, Matrix C1, Matrix C2, double *w)
+{
+        int q = C1->m;
+
+        if ((tau == 0) | (q == 0))
+                return;
+
+        /* w <- C1[c]T + C2T v */
+        memcpy(w, mptr(C1, c, 0), q*sizeof(double));
+        for (int r=0; r<C2->n; r++)
+                vectorAxpy(q, maccess(V2, r, c), mptr(C2, r, 0), 1, w, 1);
+
+        vectorAxpy(q, -tau, w, 1, mptr(C1, c, 0), 1);
+        for (int r=0; r<C2->n; r++)
+                vectorAxpy(q, -tau * maccess(V2, r, c), w, 1, mptr(C2, r, 0), 1);
+}
+
+/*
+  tsqrt
+
+  QR of an upper triangular R stacked on a full A2, [R; A2] = Q [R'; 0].
+  R' overwrites R and the reflectors overwrite A2 as in householderQR,
+  except that their part on R is a single 1 (see applyStacked), so the
+  zeros below the diagonal of R are neither stored nor worked on.
+
+  @param w scratch of R->m doubles
+*/
+static void tsqrt(Matrix R, Matrix A2, double *tau, double *w)
+{
+        int n = A2->n;
+        int m = R->m;
+
+        for (int c=0; c<m; c++)
+        {
+                double *alpha = mptr(R, c, c);
+                double *v = mptr(A2, 0, c);
+                double xnorm = sqrt(vectorDot(n, v, A2->ld, v, A2->ld));
+
+                tau[c] = 0;
+                if (xnorm == 0)
+                        continue;
+
+                /* opposite sign of alpha avoids cancellation in alpha - beta */
+                double beta = -copysign(hypot(*alpha, xnorm), *alpha);
+                tau[c] = (beta - *alpha) / beta;
+                vectorScale(n, 1 / (*alpha - beta), v, A2->ld);
+                *alpha = beta;
+
+                MatrixView _R, _A2;
+                applyStacked(A2, c, tau[c],
+                             viewMatrix(R, 0, c+1, m, m-c-1, &_R),
+                             viewMatrix(A2, 0, c+1, n, m-c-1, &_A2), w);
+        }
+}
+
+/*
+  tsmqr
+
+  [C1; C2] <- QT [C1; C2], or Q [C1; C2], for the Q of a tsqrt whose
+  reflectors are in V2
+
+  @param w scratch of C1->m doubles
+*/
+static void tsmqr(Matrix V2, double *tau, Matrix C1, Matrix C2, int transpose, double *w)
+{
+        int k = V2->m;
+
+        for (int s=0; s<k; s++)
+        {
+                int c = transpose ? s : k-1-s;
+                applyStacked(V2, c, tau[c], C1, C2, w);
+        }
+}
+
+static void runTile(void *_T, Task *task)
+{
+        Tiled *T = _T;
+        int k = task->k;
+        int i = task->i;
+        int j = task->j;
+        int nb = T->nb;
+        MatrixView _Akk, _Aik, _Ajk, _Akj, _Aij, _column;
+
+        switch (task->kind)
+        {
+        case TASK_POTRF:
+        {
+                int info = choleskyDecompositionInPlace(tile(T, k, k, &_Akk), 0);
+                if (info != 0)
+                        T->info = k*nb + info;
+                break;
+        }
+
+        /* every later task depends on the failed POTRF, which already ran */
+        case TASK_TRSM:
+                if (T->info == 0)
+                        solveLowerTransposedRight(tile(T, k, k, &_Akk), tile(T, i, k, &_Aik));
+                break;
+
+        case TASK_SYRK:
+                if (T->info == 0)
+                        updateLower(tile(T, j, k, &_Ajk), tile(T, j, j, &_Aij));
+                break;
+
+        case TASK_GEMM:
+        {
+                if (T->info != 0)
+                        break;
+
+                /* Cholesky: A_ij - A_ik A_jkT, LU: A_ij - L_ik U_kj */
+                Matrix Aik = tile(T, i, k, &_Aik);
+                if (T->ipiv == NULL)
+                        scaledMultiplyMatrices(Aik, 0, tile(T, j, k, &_Ajk), 1,
+                                               -1.0, tile(T, i, j, &_Aij), 1.0);
+                else
+                        scaledMultiplyMatrices(Aik, 0, tile(T, k, j, &_Akj), 0,
+                                               -1.0, tile(T, i, j, &_Aij), 1.0);
+                break;
+        }
+
+        case TASK_PANEL:
+                PLUDecompositionInPlace(tileColumn(T, k, k, &_column), T->ipiv + k*nb, nb);
+                break;
+
+        case TASK_SWAP:
+        {
+                Matrix Akk = tile(T, k, k, &_Akk);
+                int jb = min(Akk->n, Akk->m);
+                Matrix column = tileColumn(T, k, j, &_column);
+
+                applyPivots(column, T->ipiv + k*nb, jb, 0);
+                triangularSolve(viewMatrix(Akk, 0, 0, jb, jb, &_Aik),
+                                viewMatrix(column, 0, 0, jb, column->m, &_Akj), 0, 0, 1);
+                break;
+        }
+
+        case TASK_SWAP_LEFT:
+        {
+                Matrix Akk = tile(T, k, k, &_Akk);
+                applyPivots(tileColumn(T, k, j, &_column), T->ipiv + k*nb, min(Akk->n, Akk->m), 0);
+                break;
+        }
+
+        case TASK_GEQRT:
+        {
+                Matrix Akk = tile(T, k, k, &_Akk);
+                char buffer[arenaBufferSize(householderQRWorkspaceSize(Akk->n, Akk->m))];
+                householderQR(Akk, tileTau(T, k, k), initArena(buffer, sizeof(buffer)));
+                break;
+        }
+
+        case TASK_UNMQR:
+        {
+                Matrix Akk = tile(T, k, k, &_Akk);
+                Matrix Akj = tile(T, k, j, &_Akj);
+                char buffer[arenaBufferSize(arenaAllocSize(Akj->m*sizeof(double)))];
+                applyHouseholderQ(Akk, tileTau(T, k, k), Akk->m, Akj, 1,
+                                  initArena(buffer, sizeof(buffer)));
+                break;
+        }
+
+        case TASK_TSQRT:
+        {
+                Matrix Akk = tile(T, k, k, &_Akk);
+                double w[Akk->m];
+                tsqrt(viewMatrix(Akk, 0, 0, Akk->m, Akk->m, &_column), tile(T, i, k, &_Aik),
+                      tileTau(T, i, k), w);
+                break;
+        }
+
+        case TASK_TSMQR:
+        {
+                Matrix Aik = tile(T, i, k, &_Aik);
+                Matrix Akj = tile(T, k, j, &_Akj);
+                double w[Akj->m];
+                tsmqr(Aik, tileTau(T, i, k), viewMatrix(Akj, 0, 0, Aik->m, Akj->m, &_column),
+                      tile(T, i, j, &_Aij), 1, w);
+                break;
+        }
+        }
+}
+
+/*
+  Tiled Cholesky Decomposition
+
+  A = L LT, same output and conventions as choleskyDecompositionInPlace:
+  L overwrites the lower triangle and the strict upper triangle is
+  never read or written. For every step k the diagonal tile is
+  factored (POTRF), the tiles below it are solved against it (TRSM)
+  and the trailing tiles of the lower triangle are updated (SYRK on
+  the diagonal, GEMM below it), each as a separate task.
+
+  @param A symmetric positive definite matrix, lower triangle overwritten by L
+  @param nb tile size, TILE_SIZE when not positive
+  @return 0, or i+1 when the leading minor of order i+1 is not
+  positive definite, A is then only partly factored
+*/
+int tiledCholesky(Matrix A, int nb)
+{
+        assert(A->n == A->m);
+
+        if (nb <= 0)
+                nb = TILE_SIZE;
+
+        Tiled T;
+        initTiled(&T, A, nb);
+        int nt = T.nt;
+
+        Graph g;
+        initGraph(&g, nt*nt, runTile, &T);
+
+        for (int k=0; k<nt; k++)
+        {
+                int t = addTask(&g, TASK_POTRF, k, k, k, priority(&T, k, k));
+                writes(&g, t, tileId(&T, k, k));
+
+                for (int i=k+1; i<nt; i++)
+                {
+                        t = addTask(&g, TASK_TRSM, k, i, k, priority(&T, k, k));
+                        reads(&g, t, tileId(&T, k, k));
+                        writes(&g, t, tileId(&T, i, k));
+                }
+
+                for (int j=k+1; j<nt; j++)
+                {
+                        t = addTask(&g, TASK_SYRK, k, j, j, priority(&T, j, k));
+                        reads(&g, t, tileId(&T, j, k));
+                        writes(&g, t, tileId(&T, j, j));
+
+                        for (int i=j+1; i<nt; i++)
+                        {
+                                t = addTask(&g, TASK_GEMM, k, i, j, priority(&T, j, k));
+                                reads(&g, t, tileId(&T, i, k));
+                                reads(&g, t, tileId(&T, j, k));
+                                writes(&g, t, tileId(&T, i, j));
+                        }
+                }
+        }
+
+        runGraph(&g);
+        freeGraph(&g);
+
+        return T.info;
+}
+
+/*
+  Tiled LU Decomposition with Pivoting
+
+  PA = LU, same output and conventions as PLUDecompositionInPlace. For
+  every step k the tile column k is factored by PLUDecompositionInPlace
+  with partial pivoting over all rows below (PANEL). Each tile column
+  to the right then gets the interchanges and its block of U in one
+  task (SWAP), after which every tile below it is updated by its own
+  GEMM. The interchanges are applied to the finished tile columns on
+  the left last, as tasks of the lowest priority.
+
+  @param A n x m matrix, overwritten by L\U
+  @param ipiv min(n, m) pivots, row i was interchanged with row ipiv[i]
+  @param nb tile size, TILE_SIZE when not positive
+*/
+void tiledLU(Matrix A, int *ipiv, int nb)
+{
+        if (nb <= 0)
+                nb = TILE_SIZE;
+
+        Tiled T;
+        initTiled(&T, A, nb);
+        T.ipiv = ipiv;
+        int mt = T.mt;
+        int nt = T.nt;
+        int kt = (min(A->n, A->m) + nb - 1) / nb;
+
+        Graph g;
+        initGraph(&g, mt*nt, runTile, &T);
+
+        for (int k=0; k<kt; k++)
+        {
+                int t = addTask(&g, TASK_PANEL, k, k, k, priority(&T, k, k));
+                for (int i=k; i<mt; i++)
+                        writes(&g, t, tileId(&T, i, k));
+
+                for (int j=k+1; j<nt; j++)
+                {
+                        t = addTask(&g, TASK_SWAP, k, k, j, priority(&T, j, k));
+                        reads(&g, t, tileId(&T, k, k));
+                        for (int i=k; i<mt; i++)
+                                writes(&g, t, tileId(&T, i, j));
+
+                        for (int i=k+1; i<mt; i++)
+                        {
+                                t = addTask(&g, TASK_GEMM, k, i, j, priority(&T, j, k));
+                                reads(&g, t, tileId(&T, i, k));
+                                reads(&g, t, tileId(&T, k, j));
+                                writes(&g, t, tileId(&T, i, j));
+                        }
+                }
+
+                for (int j=0; j<k; j++)
+                {
+                        t = addTask(&g, TASK_SWAP_LEFT, k, k, j, priority(&T, nt, k));
+                        reads(&g, t, tileId(&T, k, k));
+                        for (int i=k; i<mt; i++)
+                                writes(&g, t, tileId(&T, i, j));
+                }
+        }
+
+        runGraph(&g);
+        freeGraph(&g);
+
+        /* the panels left their pivots relative to their first row */
+        for (int k=0; k<kt; k++)
+        {
+                for (int i=k*nb; i<min((k+1)*nb, min(A->n, A->m)); i++)
+                        ipiv[i] += k*nb;
+        }
+}
+
+/* reflector scalars needed by tiledQR, in doubles */
+int tiledQRTauSize(int n, int m, int nb)
+{
+        if (nb <= 0)
+                nb = TILE_SIZE;
+
+        return ((n + nb - 1) / nb) * ((m + nb - 1) / nb) * nb;
+}
+
+/*
+  Tiled Householder QR
+
+  A = QR for A n x m with n >= m. R overwrites the upper triangle of A.
+  For every step k the diagonal tile is factored with householderQR
+  (GEQRT) and its QT applied across the tile row (UNMQR). R is then
+  stacked on each tile below in turn and factored again (TSQRT), with
+  the matching update of the two tile rows to the right (TSMQR), so
+  updates of tile column j only wait for the tiles they touch.
+
+  Q is left implicit in A and tau: the reflectors of the diagonal
+  tiles below their diagonal as in householderQR and those of the
+  stacked factorizations in the tiles under the diagonal. Apply it
+  with tiledApplyQ.
+
+  @param A matrix to be decomposed, overwritten
+  @param tau tiledQRTauSize(n, m, nb) reflector scalars
+  @param nb tile size, TILE_SIZE when not positive
+*/
+void tiledQR(Matrix A, double *tau, int nb)
+{
+        assert(A->n >= A->m);
+
+        if (nb <= 0)
+                nb = TILE_SIZE;
+
+        Tiled T;
+        initTiled(&T, A, nb);
+        T.tau = tau;
+        int mt = T.mt;
+        int nt = T.nt;
+
+        /*
+          tile (k, k) counts twice: its reflectors, read by UNMQR, and
+          its R, rewritten by every TSQRT, so the two do not wait on
+          each other
+        */
+        Graph g;
+        initGraph(&g, mt*nt + nt, runTile, &T);
+
+        for (int k=0; k<nt; k++)
+        {
+                int reflectors = mt*nt + k;
+
+                int t = addTask(&g, TASK_GEQRT, k, k, k, priority(&T, k, k));
+                writes(&g, t, tileId(&T, k, k));
+                writes(&g, t, reflectors);
+
+                for (int j=k+1; j<nt; j++)
+                {
+                        t = addTask(&g, TASK_UNMQR, k, k, j, priority(&T, j, k));
+                        reads(&g, t, reflectors);
+                        writes(&g, t, tileId(&T, k, j));
+                }
+
+                for (int i=k+1; i<mt; i++)
+                {
+                        t = addTask(&g, TASK_TSQRT, k, i, k, priority(&T, k, k));
+                        writes(&g, t, tileId(&T, k, k));
+                        writes(&g, t, tileId(&T, i, k));
+
+                        for (int j=k+1; j<nt; j++)
+                        {
+                                t = addTask(&g, TASK_TSMQR, k, i, j, priority(&T, j, k));
+                                reads(&g, t, tileId(&T, i, k));
+                                writes(&g, t, tileId(&T, k, j));
+                                writes(&g, t, tileId(&T, i, j));
+                        }
+                }
+        }
+
+        runGraph(&g);
+        freeGraph(&g);
+}
+
+/* tiledApplyQ on one tile column of B */
+typedef struct {
+
+        Tiled T; /* over the factored matrix */
+        Matrix B;
+        int transpose;
+
+} ApplyQ;
+
+static void applyTileColumn(void *_apply, int c)
+{
+        ApplyQ *apply = _apply;
+        Tiled *T = &apply->T;
+        int nb = T->nb;
+        int n = T->A->n;
+        int q = min(nb, apply->B->m - c*nb);
+
+        double w[q];
+        char buffer[arenaBufferSize(arenaAllocSize(q*sizeof(double)))];
+        Arena scratch = initArena(buffer, sizeof(buffer));
+
+        MatrixView _Akk, _Aik, _Bk, _Bi, _C1;
+
+        for (int s=0; s<T->nt; s++)
+        {
+                int k = apply->transpose ? s : T->nt-1-s;
+                Matrix Akk = tile(T, k, k, &_Akk);
+                Matrix Bk = viewMatrix(apply->B, k*nb, c*nb, Akk->n, q, &_Bk);
+                Matrix C1 = viewMatrix(Bk, 0, 0, Akk->m, q, &_C1);
+
+                if (apply->transpose)
+                        applyHouseholderQ(Akk, tileTau(T, k, k), Akk->m, Bk, 1, scratch);
+
+                for (int _i=k+1; _i<T->mt; _i++)
+                {
+                        int i = apply->transpose ? _i : T->mt+k-_i;
+                        Matrix Aik = tile(T, i, k, &_Aik);
+                        tsmqr(Aik, tileTau(T, i, k), C1,
+                              viewMatrix(apply->B, i*nb, c*nb, min(nb, n - i*nb), q, &_Bi),
+                              apply->transpose, w);
+                }
+
+                if (!apply->transpose)
+                        applyHouseholderQ(Akk, tileTau(T, k, k), Akk->m, Bk, 0, scratch);
+        }
+}
+
+/*
+  Apply the Q of a tiled QR
+
+  B <- QT B or B <- Q B, Q being the n x n orthogonal factor left by
+  tiledQR. QT B leaves the m rows that pair with R at the top of B.
+  Tile columns of B are independent and run on the thread pool.
+
+  @param V output of tiledQR, n x m
+  @param tau its reflector scalars
+  @param nb tile size tiledQR was called with
+  @param B matrix with n rows, overwritten
+  @param transpose apply QT, else Q
+*/
+void tiledApplyQ(Matrix V, double *tau, int nb, Matrix B, int transpose)
+{
+        assert(V->n == B->n);
+
+        if (nb <= 0)
+                nb = TILE_SIZE;
+
+        ApplyQ apply;
+        initTiled(&apply.T, V, nb);
+        apply.T.tau = tau;
+        apply.B = B;
+        apply.transpose = transpose;
+
+        poolFor((B->m + nb - 1) / nb, applyTileColumn, &apply);
+}
@@ -0,0 +1,377 @@
+/*
+  @file tsqr.c
+  @author Gerardo Veltri
+  Tall-skinny QR, row blocks factored in parallel and reduced in a tree
+
+  A (n x m, n >> m) is split into blocks of consecutive rows, as many
+  as the rows allow up to TSQR_MAX_BLOCKS or a given thread count,
+  and the pool runs them however many threads it has. Each block is
+  factored on its own with householderQRBlocked, leaving its
+  reflectors in place in A and an m x m R on top. The R factors are
+  then combined pairwise, level by level: two R stacked into a 2m x m
+  matrix are factored again and the upper one carries on. After
+  log2(blocks) levels the R of block 0 is the R of A. The leaves and
+  every level of the tree are one parallel loop each.
+
+  Q is never formed. It is the product of the leaf reflectors and the
+  reflectors of every tree node, all kept in the handle, and is
+  applied to a matrix by walking the same tree: QT B leaf first and
+  upwards, Q B from the root down. Blocks only meet at the tree
+  nodes, which move 2m rows, so the threads share almost no data.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <mem.h>
+#include <matrix.h>
+#include <pool.h>
+#include <factorization.h>
+#include <tsqr.h>
+
+#define min(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a < _b ? _a : _b; })
+
+#define max(a,b)                                \
+        ({ __typeof__ (a) _a = (a);             \
+                __typeof__ (b) _b = (b);        \
+                _a > _b ? _a : _b; })
+
+struct _TSQR_ {
+
+        int n;
+        int m;
+        int blocks;
+        int levels; /* depth of the reduction tree */
+
+        MatrixView A; /* leaf reflectors, written over the caller's A */
+        int *rows; /* first row of each block, blocks+1 entries */
+        double *tau; /* m scalars per block */
+
+        /*
+          2m x m factor of the tree node at level l over block i, with
+          its m scalars, at [l*blocks + i], NULL where there is none
+        */
+        Matrix *nodes;
+        double *nodeTau;
+
+        MatrixView R;
+
+};
+
+/* state shared by the tasks of one parallel loop, one task per block */
+typedef struct {
+
+        TSQR T;
+        Arena *scratch; /* one arena per block */
+        MatrixView *top; /* current R of each block while reducing */
+        Matrix B; /* target of an apply pass */
+        int transpose;
+        int level; /* of the tree nodes being processed */
+
+} Pass;
+
+static int treeLevels(int blocks)
+{
+        int levels = 0;
+        while ((1 << levels) < blocks)
+                levels++;
+        return levels;
+}
+
+/* the block that block i is merged with at level l, or -1 if i is not a node there */
+static int partner(TSQR T, int l, int i)
+{
+        int s = 1 << l;
+        if ((i % (2*s) != 0) | (i+s >= T->blocks))
+                return -1;
+        return i+s;
+}
+
+/*
+  tsqrBlocks
+
+  row blocks for an n x m input on the given number of threads, each
+  block gets at least TSQR_BLOCK_ROWS and 2m rows
+
+  @param threads upper bound on the blocks, TSQR_MAX_BLOCKS when not positive
+*/
+int tsqrBlocks(int n, int m, int threads)
+{
+        if (threads <= 0)
+                threads = TSQR_MAX_BLOCKS;
+
+        int blocks = n / max(TSQR_BLOCK_ROWS, 2*m);
+        return max(1, min(blocks, threads));
+}
+
+static Matrix leafBlock(TSQR T, Matrix M, int i, MatrixView *view)
+{
+        return viewMatrix(M, T->rows[i], 0, T->rows[i+1] - T->rows[i], M->m, view);
+}
+
+static void factorLeaf(void *_pass, int i)
+{
+        Pass *pass = _pass;
+        TSQR T = pass->T;
+
+        MatrixView _leaf;
+        Matrix leaf = leafBlock(T, &T->A, i, &_leaf);
+        householderQRBlocked(leaf, T->tau + (size_t)i*T->m, 0, pass->scratch[i]);
+        viewMatrix(leaf, 0, 0, T->m, T->m, &pass->top[i]);
+}
+
+/* stack the upper triangles of the R of blocks i and its partner and factor again */
+static void mergeNode(void *_pass, int i)
+{
+        Pass *pass = _pass;
+        TSQR T = pass->T;
+        int l = pass->level;
+        int m = T->m;
+
+        int j = partner(T, l, i);
+        if (j < 0)
+                return;
+
+        Matrix node = T->nodes[l*T->blocks + i];
+        setMatrixValues(0, 'V', node);
+        for (int r=0; r<m; r++)
+        {
+                memcpy(mptr(node, r, r), mptr(&pass->top[i], r, r), (m-r)*sizeof(double));
+                memcpy(mptr(node, m+r, r), mptr(&pass->top[j], r, r), (m-r)*sizeof(double));
+        }
+
+        householderQR(node, T->nodeTau + ((size_t)l*T->blocks + i)*m, pass->scratch[i]);
+        viewMatrix(node, 0, 0, m, m, &pass->top[i]);
+}
+
+/*
+  applyNode
+
+  apply the tree node of the current level over block i to the first
+  m rows of blocks i and its partner in B, gathered into 2m contiguous
+  rows and back
+*/
+static void applyNode(void *_pass, int i)
+{
+        Pass *pass = _pass;
+        TSQR T = pass->T;
+        Matrix B = pass->B;
+        Arena scratch = pass->scratch[i];
+        int l = pass->level;
+        int m = T->m;
+
+        int j = partner(T, l, i);
+        if (j < 0)
+                return;
+
+        size_t mark = arenaMark(scratch);
+        Matrix S = arenaMatrix(scratch, 2*m, B->m);
+        MatrixView _Bi, _Bj, _Si, _Sj;
+        Matrix Bi = viewMatrix(B, T->rows[i], 0, m, B->m, &_Bi);
+        Matrix Bj = viewMatrix(B, T->rows[j], 0, m, B->m, &_Bj);
+        Matrix Si = viewMatrix(S, 0, 0, m, B->m, &_Si);
+        Matrix Sj = viewMatrix(S, m, 0, m, B->m, &_Sj);
+
+        copyMatrix(Bi, Si);
+        copyMatrix(Bj, Sj);
+        applyHouseholderQ(T->nodes[l*T->blocks + i],
+                          T->nodeTau + ((size_t)l*T->blocks + i)*m,
+                          m, S, pass->transpose, scratch);
+        copyMatrix(Si, Bi);
+        copyMatrix(Sj, Bj);
+
+        arenaRelease(scratch, mark);
+}
+
+static void applyLeaf(void *_pass, int i)
+{
+        Pass *pass = _pass;
+        TSQR T = pass->T;
+
+        MatrixView _leaf, _B;
+        Matrix leaf = leafBlock(T, &T->A, i, &_leaf);
+        Matrix B = leafBlock(T, pass->B, i, &_B);
+
+        applyHouseholderQ(leaf, T->tau + (size_t)i*T->m, T->m, B, pass->transpose,
+                          pass->scratch[i]);
+}
+
+/* bytes of the handle and everything it keeps */
+static size_t handleSize(int m, int blocks)
+{
+        int levels = treeLevels(blocks);
+
+        return arenaAllocSize(sizeof(struct _TSQR_))
+                + arenaAllocSize((blocks+1)*sizeof(int))
+                + arenaAllocSize((size_t)blocks*m*sizeof(double))
+                + arenaAllocSize((size_t)levels*blocks*sizeof(Matrix))
+                + arenaAllocSize((size_t)levels*blocks*m*sizeof(double))
+                + (blocks-1)*arenaMatrixSize(2*m, m);
+}
+
+/* bytes of the per block scratch arenas holding size bytes each */
+static size_t scratchSize(int blocks, size_t size)
+{
+        return arenaAllocSize(blocks*sizeof(Arena))
+                + blocks*arenaAllocSize(arenaBufferSize(size));
+}
+
+static Arena *carveScratch(Arena workspace, int blocks, size_t size)
+{
+        Arena *scratch = arenaAlloc(workspace, blocks*sizeof(Arena));
+        for (int i=0; i<blocks; i++)
+                scratch[i] = initArena(arenaAlloc(workspace, arenaBufferSize(size)),
+                                       arenaBufferSize(size));
+        return scratch;
+}
+
+/* scratch bytes per block while factoring */
+static size_t factorScratch(int n, int m, int blocks)
+{
+        int rows = (n + blocks - 1) / blocks;
+        size_t leaf = householderQRBlockedWorkspaceSize(rows, m, 0);
+        size_t node = householderQRWorkspaceSize(2*m, m);
+
+        return max(leaf, node);
+}
+
+/*
+  TSQR
+
+  A = QR for a tall A, n x m with n >= m, with the row blocks factored
+  on separate threads. A is overwritten by the reflectors of its
+  blocks. The handle, the tree node factors and R are drawn from the
+  workspace and stay there until the caller releases them, scratch
+  used while factoring is given back before returning.
+
+  @param A matrix to be decomposed, overwritten
+  @param threads most blocks to split A into, TSQR_MAX_BLOCKS when not positive
+  @param workspace arena, see tsqrWorkspaceSize
+  @return handle for tsqrR and _tsqrApplyQ
+*/
+TSQR _tsqr(Matrix A, int threads, Arena workspace)
+{
+        int n = A->n;
+        int m = A->m;
+        int blocks = tsqrBlocks(n, m, threads);
+
+        assert(n >= m);
+
+        TSQR T = arenaAlloc(workspace, sizeof(struct _TSQR_));
+        T->n = n;
+        T->m = m;
+        T->blocks = blocks;
+        T->levels = treeLevels(blocks);
+        viewMatrix(A, 0, 0, n, m, &T->A);
+
+        T->rows = arenaAlloc(workspace, (blocks+1)*sizeof(int));
+        for (int i=0; i<=blocks; i++)
+                T->rows[i] = (int)(((long)n * i) / blocks);
+
+        T->tau = arenaAlloc(workspace, (size_t)blocks*m*sizeof(double));
+        T->nodes = arenaAlloc(workspace, (size_t)T->levels*blocks*sizeof(Matrix));
+        T->nodeTau = arenaAlloc(workspace, (size_t)T->levels*blocks*m*sizeof(double));
+
+        for (int l=0; l<T->levels; l++)
+        {
+                for (int i=0; i<blocks; i++)
+                {
+                        Matrix *node = &T->nodes[l*blocks + i];
+                        *node = (partner(T, l, i) >= 0) ? arenaMatrix(workspace, 2*m, m) : NULL;
+                }
+        }
+
+        size_t mark = arenaMark(workspace);
+
+        Pass pass;
+        pass.T = T;
+        pass.scratch = carveScratch(workspace, blocks, factorScratch(n, m, blocks));
+        pass.top = arenaAlloc(workspace, blocks*sizeof(MatrixView));
+
+        poolFor(blocks, factorLeaf, &pass);
+        for (pass.level=0; pass.level<T->levels; pass.level++)
+                poolFor(blocks, mergeNode, &pass);
+
+        T->R = pass.top[0];
+
+        arenaRelease(workspace, mark);
+        return T;
+}
+
+/* workspace bytes needed by _tsqr for an n x m input */
+size_t tsqrWorkspaceSize(int n, int m, int threads)
+{
+        int blocks = tsqrBlocks(n, m, threads);
+
+        return handleSize(m, blocks)
+                + scratchSize(blocks, factorScratch(n, m, blocks))
+                + arenaAllocSize(blocks*sizeof(MatrixView));
+}
+
+/* bytes of the handle _tsqr leaves in the workspace, part of tsqrWorkspaceSize */
+size_t tsqrHandleSize(int n, int m, int threads)
+{
+        return handleSize(m, tsqrBlocks(n, m, threads));
+}
+
+/*
+  R of a TSQR, m x m. Its upper triangle is R, the strict lower
+  triangle holds reflectors, as in householderQR.
+*/
+Matrix tsqrR(TSQR T)
+{
+        return &T->R;
+}
+
+/*
+  Apply the Q of a TSQR
+
+  B <- QT B or B <- Q B in place, Q being the n x n orthogonal factor.
+  QT B leaves the m rows that pair with R at the top of B, so least
+  squares follows with a triangular solve against tsqrR.
+
+  @param T handle from _tsqr
+  @param B matrix with n rows, overwritten
+  @param transpose apply QT, else Q
+  @param workspace arena for scratch, see tsqrApplyQWorkspaceSize
+*/
+void _tsqrApplyQ(TSQR T, Matrix B, int transpose, Arena workspace)
+{
+        assert(B->n == T->n);
+
+        size_t mark = arenaMark(workspace);
+        size_t size = arenaMatrixSize(2*T->m, B->m) + arenaAllocSize(B->m*sizeof(double));
+
+        Pass pass;
+        pass.T = T;
+        pass.B = B;
+        pass.transpose = transpose;
+        pass.scratch = carveScratch(workspace, T->blocks, size);
+
+        /* QT B is leaves then the tree upwards, Q B the reverse */
+        if (transpose)
+        {
+                poolFor(T->blocks, applyLeaf, &pass);
+                for (pass.level=0; pass.level<T->levels; pass.level++)
+                        poolFor(T->blocks, applyNode, &pass);
+        }
+        else
+        {
+                for (pass.level=T->levels-1; pass.level>=0; pass.level--)
+                        poolFor(T->blocks, applyNode, &pass);
+                poolFor(T->blocks, applyLeaf, &pass);
+        }
+
+        arenaRelease(workspace, mark);
+}
+
+/* workspace bytes needed by _tsqrApplyQ for an n x m factorization and B n x k */
+size_t tsqrApplyQWorkspaceSize(int n, int m, int k, int threads)
+{
+        int blocks = tsqrBlocks(n, m, threads);
+        size_t size = arenaMatrixSize(2*m, k) + arenaAllocSize(k*sizeof(double));
+
+        return scratchSize(blocks, size);
+}